@@ -132,6 +132,10 @@ void registerDefaults() {
 	// Graphics
 	ConfMan.registerDefault("fullscreen", false);
 	ConfMan.registerDefault("soft_renderer", "false");
+	ConfMan.registerDefault("soft_width", 640);
+	ConfMan.registerDefault("soft_height", 480);
+	ConfMan.registerDefault("soft_tiles", 0);
+	ConfMan.registerDefault("soft_occlusion", false);
 	ConfMan.registerDefault("show_fps", "false");
 
 	// Sound & Music
@@ -161,6 +165,9 @@ void registerDefaults() {
 
 	ConfMan.registerDefault("dimuse_tempo", 10);
 
+	ConfMan.registerDefault("lab_mmap", true);
+	ConfMan.registerDefault("resource_cache_size", 32 * 1024);	// In KB, 0 means unbounded
+
 	// Miscellaneous
 	ConfMan.registerDefault("joystick_num", -1);
 	ConfMan.registerDefault("confirm_exit", false);
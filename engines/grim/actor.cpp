@@ -27,6 +27,8 @@
 #define FORBIDDEN_SYMBOL_EXCEPTION_mkdir
 #define FORBIDDEN_SYMBOL_EXCEPTION_unlink
 
+#include "common/algorithm.h"
+
 #include "graphics/line3d.h"
 #include "graphics/rect2d.h"
 
@@ -49,6 +51,13 @@ namespace Grim {
 
 int g_winX1, g_winY1, g_winX2, g_winY2;
 
+Common::Array<Actor::CollisionEntry> Actor::_collisionEntries;
+Common::HashMap<int32, Common::Array<int> > Actor::_collisionCells;
+Common::String Actor::_collisionSet;
+float Actor::_collisionCellSize = 1.f;
+float Actor::_collisionMaxReach = 0.f;
+bool Actor::_collisionHashValid = false;
+
 Actor::Actor(const Common::String &actorName) :
 		PoolObject(), _name(actorName), _setName(""),
 		_talkColor(PoolColor::getPool()->getObject(2)), _pos(0, 0, 0),
@@ -79,6 +88,8 @@ Actor::Actor(const Common::String &actorName) :
 	_mustPlaceText = false;
 	_collisionMode = CollisionOff;
 	_collisionScale = 1.f;
+	_collisionEntry = -1;
+	invalidateCollisionHash();
 
 	for (int i = 0; i < 5; i++) {
 		_shadowArray[i].active = false;
@@ -106,6 +117,8 @@ Actor::Actor() :
 	_mustPlaceText = false;
 	_collisionMode = CollisionOff;
 	_collisionScale = 1.f;
+	_collisionEntry = -1;
+	invalidateCollisionHash();
 
 	for (int i = 0; i < 5; i++) {
 		_shadowArray[i].active = false;
@@ -117,6 +130,7 @@ Actor::Actor() :
 
 
 Actor::~Actor() {
+	invalidateCollisionHash();
 	if (_shadowArray) {
 		clearShadowPlanes();
 		delete[] _shadowArray;
@@ -436,6 +450,8 @@ bool Actor::restoreState(SaveGame *savedState) {
 		_path.push_back(savedState->readVector3d());
 	}
 
+	invalidateCollisionHash();
+
 	return true;
 }
 
@@ -468,6 +484,7 @@ void Actor::setPos(Graphics::Vector3d position) {
 	if (_constrain && !_walking) {
 		g_grim->getCurrScene()->findClosestSector(_pos, NULL, &_pos);
 	}
+	updateCollisionHash();
 }
 
 void Actor::turnTo(float pitchParam, float yawParam, float rollParam) {
@@ -480,6 +497,53 @@ void Actor::turnTo(float pitchParam, float yawParam, float rollParam) {
 		_turning = false;
 }
 
+struct PathQueueEntry {
+	float cost;
+	int node;
+
+	bool operator<(const PathQueueEntry &other) const {
+		return cost < other.cost || (cost == other.cost && node < other.node);
+	}
+};
+
+static void pushPathQueue(Common::Array<PathQueueEntry> &queue, float cost, int node) {
+	PathQueueEntry entry;
+	entry.cost = cost;
+	entry.node = node;
+
+	int i = queue.size();
+	queue.push_back(entry);
+	while (i > 0 && entry < queue[(i - 1) / 2]) {
+		queue[i] = queue[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	queue[i] = entry;
+}
+
+static PathQueueEntry popPathQueue(Common::Array<PathQueueEntry> &queue) {
+	PathQueueEntry top = queue[0];
+	PathQueueEntry last = queue.back();
+	queue.pop_back();
+
+	int size = queue.size();
+	int i = 0;
+	if (size > 0) {
+		for (;;) {
+			int child = 2 * i + 1;
+			if (child >= size)
+				break;
+			if (child + 1 < size && queue[child + 1] < queue[child])
+				child++;
+			if (!(queue[child] < last))
+				break;
+			queue[i] = queue[child];
+			i = child;
+		}
+		queue[i] = last;
+	}
+	return top;
+}
+
 void Actor::walkTo(const Graphics::Vector3d &p) {
 	if (p == _pos)
 		_walking = false;
@@ -489,84 +553,81 @@ void Actor::walkTo(const Graphics::Vector3d &p) {
 		_path.clear();
 
 		if (_constrain) {
-			g_grim->getCurrScene()->findClosestSector(p, NULL, &_destPos);
-
-			Common::List<PathNode *> openList;
-			Common::List<PathNode *> closedList;
-
-			PathNode *start = new PathNode;
-			start->parent = NULL;
-			start->pos = _pos;
-			start->dist = 0.f;
-			start->cost = 0.f;
-			openList.push_back(start);
-			g_grim->getCurrScene()->findClosestSector(_pos, &start->sect, NULL);
-
-			Common::List<Sector *> sectors;
-			for (int i = 0; i < g_grim->getCurrScene()->getSectorCount(); ++i) {
-				Sector *s = g_grim->getCurrScene()->getSectorBase(i);
-				int type = s->getType();
-				if ((type == Sector::WalkType || type == Sector::HotType || type == Sector::FunnelType) && s->isVisible()) {
-					sectors.push_back(s);
-				}
+			Scene *scene = g_grim->getCurrScene();
+			scene->findClosestSector(p, NULL, &_destPos);
+
+			Sector *startSec = NULL, *endSec = NULL;
+			scene->findClosestSector(_pos, &startSec, NULL);
+			scene->findClosestSector(_destPos, &endSec, NULL);
+			int endIndex = scene->getSectorIndex(endSec);
+
+			// There is at most one node per sector. The open nodes are kept in
+			// a heap ordered by cost, with the nodes that were opened first
+			// winning ties. A node whose cost went down is pushed again and
+			// its old entry skipped.
+			Common::Array<PathNode> nodes;
+			Common::Array<int> sectorNodes;
+			Common::Array<PathQueueEntry> openQueue;
+			nodes.reserve(scene->getSectorCount());
+			sectorNodes.resize(scene->getSectorCount());
+			for (uint i = 0; i < sectorNodes.size(); ++i)
+				sectorNodes[i] = -1;
+
+			PathNode start;
+			start.sect = scene->getSectorIndex(startSec);
+			start.parent = -1;
+			start.pos = _pos;
+			start.dist = 0.f;
+			start.cost = 0.f;
+			start.closed = false;
+			if (start.sect >= 0) {
+				nodes.push_back(start);
+				sectorNodes[start.sect] = 0;
+				pushPathQueue(openQueue, 0.f, 0);
 			}
 
-			Sector *endSec = NULL;
-			g_grim->getCurrScene()->findClosestSector(_destPos, &endSec, NULL);
-
-			do {
-				PathNode *node = NULL;
-				float cost = -1.f;
-				for (Common::List<PathNode *>::iterator j = openList.begin(); j != openList.end(); ++j) {
-					PathNode *n = *j;
-					float c = n->dist + n->cost;
-					if (cost < 0.f || c < cost) {
-						cost = c;
-						node = n;
-					}
-				}
-				closedList.push_back(node);
-				openList.remove(node);
-				Sector *sector = node->sect;
+			while (!openQueue.empty()) {
+				PathQueueEntry entry = popPathQueue(openQueue);
+				PathNode *node = &nodes[entry.node];
+				if (node->closed || entry.cost != node->dist + node->cost)
+					continue;
+				node->closed = true;
 
-				if (sector == endSec) {
-					PathNode *n = closedList.back();
-					while (n) {
+				if (node->sect == endIndex) {
+					int n = entry.node;
+					while (n >= 0) {
 						// Don't put the start position in the list, or else
 						// the first angle calculated in updateWalk() will be
 						// meaningless.
-						if (n->pos == _pos) {
+						if (nodes[n].pos == _pos) {
 							break;
 						}
-						_path.push_back(n->pos);
-						n = n->parent;
+						_path.push_back(nodes[n].pos);
+						n = nodes[n].parent;
 					}
 
 					break;
 				}
 
-				for (Common::List<Sector *>::iterator i = sectors.begin(); i != sectors.end(); ++i) {
-					Sector *s = *i;
-					bool inClosed = false;
-					for (Common::List<PathNode *>::iterator j = closedList.begin(); j != closedList.end(); ++j) {
-						if ((*j)->sect == s) {
-							inClosed = true;
-							break;
-						}
-					}
-					if (inClosed)
-						continue;
+				// Copied, since adding nodes moves them
+				const Graphics::Vector3d nodePos = node->pos;
+				const float nodeCost = node->cost;
 
-					Common::List<Graphics::Line3d> bridges = sector->getBridgesTo(s);
-					if (bridges.empty())
-						continue; // The sectors are not adjacent.
+				const Common::Array<Scene::SectorLink> &links = scene->getSectorLinks(node->sect);
+				for (uint i = 0; i < links.size(); ++i) {
+					const Scene::SectorLink &link = links[i];
+					Sector *s = scene->getSectorBase(link._sector);
+					int n = sectorNodes[link._sector];
+					if (!s->isVisible() || (n >= 0 && nodes[n].closed))
+						continue;
 
 					Graphics::Vector3d closestPoint = s->getClosestPoint(_destPos);
 					Graphics::Vector3d best;
 					float bestDist = 1e6f;
-					Graphics::Line3d l(node->pos, closestPoint);
-					while (!bridges.empty()) {
-						Graphics::Line3d bridge = bridges.back();
+					Graphics::Line3d l(nodePos, closestPoint);
+					Common::List<Graphics::Line3d>::const_iterator j = link._bridges.end();
+					while (j != link._bridges.begin()) {
+						Graphics::Line3d bridge = *--j;
 						Graphics::Vector3d pos;
 						if (!bridge.intersectLine2d(l, &pos)) {
 							pos = bridge.middle();
@@ -576,41 +637,31 @@ void Actor::walkTo(const Graphics::Vector3d &p) {
 							bestDist = dist;
 							best = pos;
 						}
-						bridges.pop_back();
 					}
 
-					PathNode *n = NULL;
-					for (Common::List<PathNode *>::iterator j = openList.begin(); j != openList.end(); ++j) {
-						if ((*j)->sect == s) {
-							n = *j;
-							break;
-						}
-					}
-					if (n) {
-						float newCost = node->cost + (best - node->pos).magnitude();
-						if (newCost < n->cost) {
-							n->cost = newCost;
-							n->parent = node;
-							n->pos = best;
-							n->dist = (n->pos - _destPos).magnitude();
+					if (n >= 0) {
+						PathNode &other = nodes[n];
+						float newCost = nodeCost + (best - nodePos).magnitude();
+						if (newCost < other.cost) {
+							other.cost = newCost;
+							other.parent = entry.node;
+							other.pos = best;
+							other.dist = (other.pos - _destPos).magnitude();
+							pushPathQueue(openQueue, other.dist + other.cost, n);
 						}
 					} else {
-						n = new PathNode;
-						n->parent = node;
-						n->sect = s;
-						n->pos = best;
-						n->dist = (n->pos - _destPos).magnitude();
-						n->cost = node->cost + (n->pos - node->pos).magnitude();
-						openList.push_back(n);
+						PathNode next;
+						next.parent = entry.node;
+						next.sect = link._sector;
+						next.pos = best;
+						next.dist = (next.pos - _destPos).magnitude();
+						next.cost = nodeCost + (next.pos - nodePos).magnitude();
+						next.closed = false;
+						sectorNodes[link._sector] = nodes.size();
+						nodes.push_back(next);
+						pushPathQueue(openQueue, next.dist + next.cost, nodes.size() - 1);
 					}
 				}
-			} while (!openList.empty());
-
-			for (Common::List<PathNode *>::iterator j = closedList.begin(); j != closedList.end(); ++j) {
-				delete *j;
-			}
-			for (Common::List<PathNode *>::iterator j = openList.begin(); j != openList.end(); ++j) {
-				delete *j;
 			}
 		}
 
@@ -636,17 +687,46 @@ void Actor::moveTo(const Graphics::Vector3d &pos) {
 	// This is necessary for collisions in set hl to work, since
 	// Manny's collision mode isn't set.
 	if (_collisionMode == CollisionOff) {
-		_collisionMode = CollisionSphere;
+		setCollisionMode(CollisionSphere);
 	}
 
 	Graphics::Vector3d v = pos - _pos;
-	for (Actor::Pool::Iterator i = getPool()->getBegin(); i != getPool()->getEnd(); ++i) {
-		Actor *a = i->_value;
-		if (a != this && a->isInSet(_setName) && a->isVisible()) {
-			collidesWith(a, &v);
+	float x, y, reach;
+	if (getCollisionShape(&x, &y, &reach)) {
+		// Test the actors near the destination in pool order, like a walk
+		// over the whole pool would. A collision moves the destination, so
+		// the actors after the one hit are looked for again around it.
+		Common::Array<int> candidates;
+		int last = -1;
+		int lastId = -1;
+		bool collided = true;
+		while (collided) {
+			collided = false;
+			// The collision handlers may have changed the actors. The entries
+			// are then numbered anew, so go on from the pool position of the
+			// actor hit last.
+			if (!_collisionHashValid || _collisionSet != _setName) {
+				buildCollisionHash(_setName);
+				if (lastId >= 0) {
+					last = findCollisionEntryBefore(lastId);
+					if (last < -1)
+						break;
+				}
+			}
+			findCollisionCandidates(x + v.x(), y + v.y(), reach, last, candidates);
+			for (uint i = 0; i < candidates.size(); i++) {
+				last = candidates[i];
+				Actor *a = _collisionEntries[last]._actor;
+				if (a != this && collidesWith(a, &v)) {
+					lastId = a->getId();
+					collided = true;
+					break;
+				}
+			}
 		}
 	}
 	_pos += v;
+	updateCollisionHash();
 }
 
 void Actor::walkForward() {
@@ -660,6 +740,7 @@ void Actor::walkForward() {
 
 	if (! _constrain) {
 		_pos += forwardVec * dist;
+		updateCollisionHash();
 		_walkedCur = true;
 		return;
 	}
@@ -691,6 +772,7 @@ void Actor::walkForward() {
 			return;
 		}
 		_pos = ei.exitPoint;
+		updateCollisionHash();
 		dist -= exitDist;
 		if (exitDist > 0.0001)
 			_walkedCur = true;
@@ -971,6 +1053,7 @@ void Actor::pushCostume(const char *n) {
 
 	newCost->setColormap(NULL);
 	_costumeStack.push_back(newCost);
+	invalidateCollisionHash();
 }
 
 void Actor::setColormap(const char *map) {
@@ -1005,6 +1088,7 @@ void Actor::popCostume() {
 			freeCostumeChore(_costumeStack.back(), _talkCostume[i], _talkChore[i]);
 		delete _costumeStack.back();
 		_costumeStack.pop_back();
+		invalidateCollisionHash();
 
 		if (_costumeStack.empty()) {
 			if (gDebugLevel == DEBUG_NORMAL || gDebugLevel == DEBUG_ALL)
@@ -1069,6 +1153,7 @@ void Actor::updateWalk() {
 	} else {
 		_pos += dir * walkAmt;
 	}
+	updateCollisionHash();
 
 	_walkedCur = true;
 }
@@ -1079,6 +1164,7 @@ void Actor::update(float frameTime) {
 	// walkboxes, etc.
 	if (_constrain && !_walking) {
 		g_grim->getCurrScene()->findClosestSector(_pos, NULL, &_pos);
+		updateCollisionHash();
 	}
 
 	if (_turning) {
@@ -1266,40 +1352,32 @@ void Actor::draw() {
 
 	if (!_costumeStack.empty()) {
 		Costume *costume = _costumeStack.back();
-		if (!g_driver->isHardwareAccelerated()) {
-			for (int l = 0; l < 5; l++) {
-				if (!shouldDrawShadow(l))
-					continue;
-				g_driver->setShadow(&_shadowArray[l]);
-				g_driver->setShadowMode();
-				g_driver->startActorDraw(_pos, _scale, _yaw, _pitch, _roll);
-				costume->draw();
-				g_driver->finishActorDraw();
-				g_driver->clearShadowMode();
-				g_driver->setShadow(NULL);
-			}
-			// normal draw actor
-			g_driver->startActorDraw(_pos, _scale, _yaw, _pitch, _roll);
-			costume->draw(px1, py1, px2, py2);
-			g_driver->finishActorDraw();
-		} else {
-			// normal draw actor
-			g_driver->startActorDraw(_pos, _scale, _yaw, _pitch, _roll);
+		bool shadows = false;
+		for (int l = 0; l < 5; l++) {
+			if (shouldDrawShadow(l))
+				shadows = true;
+		}
+
+		// normal draw actor, keeping its transformed meshes for the shadows
+		if (shadows)
+			g_driver->beginShadowCasters();
+		g_driver->startActorDraw(_pos, _scale, _yaw, _pitch, _roll);
+		if (shadows || isInView(costume))
 			costume->draw(px1, py1, px2, py2);
-			g_driver->finishActorDraw();
+		g_driver->finishActorDraw();
+		if (shadows)
+			g_driver->endShadowCasters();
 
-			for (int l = 0; l < 5; l++) {
-				if (!shouldDrawShadow(l))
-					continue;
-				g_driver->setShadow(&_shadowArray[l]);
-				g_driver->setShadowMode();
+		for (int l = 0; l < 5; l++) {
+			if (!shouldDrawShadow(l))
+				continue;
+			g_driver->setShadow(&_shadowArray[l]);
+			g_driver->setShadowMode();
+			if (g_driver->isHardwareAccelerated())
 				g_driver->drawShadowPlanes();
-				g_driver->startActorDraw(_pos, _scale, _yaw, _pitch, _roll);
-				costume->draw();
-				g_driver->finishActorDraw();
-				g_driver->clearShadowMode();
-				g_driver->setShadow(NULL);
-			}
+			g_driver->drawShadowCasters();
+			g_driver->clearShadowMode();
+			g_driver->setShadow(NULL);
 		}
 	}
 
@@ -1351,6 +1429,19 @@ void Actor::addShadowPlane(const char *n, Scene *scene, int shadowId) {
 	}
 }
 
+bool Actor::isInView(Costume *costume) const {
+	Model *model = costume->getModel();
+	if (!model)
+		return true;
+
+	// The bounding box of the model is taken in its rest pose, grow it so
+	// that it still covers the limbs and the held objects once animated.
+	Graphics::Vector3d size = model->_bboxSize;
+	float margin = MAX(size.x(), MAX(size.y(), size.z()));
+	Graphics::Vector3d grow(margin, margin, margin);
+	return g_driver->isBoxVisible(model->_bboxPos - grow, size + grow * 2);
+}
+
 bool Actor::shouldDrawShadow(int shadowId) {
 	Shadow *shadow = &_shadowArray[shadowId];
 	if (!shadow->active)
@@ -1418,6 +1509,7 @@ void Actor::putInSet(const Common::String &setName) {
 	// The set should change immediately, otherwise a very rapid set change
 	// for an actor will be recognized incorrectly and the actor will be lost.
 	_setName = setName;
+	invalidateCollisionHash();
 }
 
 bool Actor::isInSet(const Common::String &setName) const {
@@ -1450,10 +1542,169 @@ bool Actor::stopMumbleChore() {
 
 void Actor::setCollisionMode(CollisionMode mode) {
 	_collisionMode = mode;
+	invalidateCollisionHash();
 }
 
 void Actor::setCollisionScale(float scale) {
 	_collisionScale = scale;
+	invalidateCollisionHash();
+}
+
+bool Actor::getCollisionShape(float *x, float *y, float *reach) const {
+	Costume *costume = getCurrentCostume();
+	Model *model = costume ? costume->getModel() : NULL;
+	if (!model)
+		return false;
+
+	*x = _pos.x() + model->_insertOffset.x();
+	*y = _pos.y() + model->_insertOffset.y();
+	if (_collisionMode == CollisionBox) {
+		// The box turns around the center, so its farthest corner
+		// is as far away whatever the yaw is
+		float x1 = model->_bboxPos.x(), x2 = x1 + model->_bboxSize.x() * _collisionScale;
+		float y1 = model->_bboxPos.y(), y2 = y1 + model->_bboxSize.y() * _collisionScale;
+		float dx = MAX(fabs(x1), fabs(x2));
+		float dy = MAX(fabs(y1), fabs(y2));
+		*reach = sqrt(dx * dx + dy * dy);
+	} else {
+		*reach = model->_radius * _collisionScale;
+	}
+	return true;
+}
+
+static int32 makeCollisionCell(int32 cx, int32 cy) {
+	return (int32)(((uint32)cx << 16) | ((uint32)cy & 0xffff));
+}
+
+int32 Actor::getCollisionCell(float x, float y) {
+	return makeCollisionCell((int32)floor(x / _collisionCellSize), (int32)floor(y / _collisionCellSize));
+}
+
+void Actor::buildCollisionHash(const Common::String &setName) {
+	_collisionEntries.clear();
+	_collisionCells.clear();
+	_collisionSet = setName;
+	_collisionMaxReach = 0.f;
+
+	for (Actor::Pool::Iterator i = getPool()->getBegin(); i != getPool()->getEnd(); ++i) {
+		Actor *a = i->_value;
+		a->_collisionEntry = -1;
+
+		CollisionEntry entry;
+		if (a->_collisionMode == CollisionOff || !a->isInSet(setName) || !a->isVisible() ||
+		    !a->getCollisionShape(&entry._x, &entry._y, &entry._reach))
+			continue;
+		entry._actor = a;
+		a->_collisionEntry = _collisionEntries.size();
+		_collisionEntries.push_back(entry);
+		_collisionMaxReach = MAX(_collisionMaxReach, entry._reach);
+	}
+
+	// Cells as wide as the largest shape, so that a lookup
+	// only visits a few of them
+	_collisionCellSize = MAX(_collisionMaxReach * 2.f, 0.1f);
+	for (uint i = 0; i < _collisionEntries.size(); i++) {
+		CollisionEntry &entry = _collisionEntries[i];
+		entry._cell = getCollisionCell(entry._x, entry._y);
+		_collisionCells[entry._cell].push_back(i);
+	}
+	_collisionHashValid = true;
+}
+
+int Actor::findCollisionEntryBefore(int id) {
+	// The entries are in pool order, so the last one seen up to the actor
+	// is the last one at or before its position
+	int last = -1;
+	for (Actor::Pool::Iterator i = getPool()->getBegin(); i != getPool()->getEnd(); ++i) {
+		Actor *a = i->_value;
+		if (a->_collisionEntry >= 0)
+			last = a->_collisionEntry;
+		if (a->getId() == id)
+			return last;
+	}
+	return -2;
+}
+
+void Actor::updateCollisionHash() {
+	if (!_collisionHashValid || _collisionEntry < 0)
+		return;
+
+	CollisionEntry &entry = _collisionEntries[_collisionEntry];
+	Costume *costume = getCurrentCostume();
+	Model *model = costume ? costume->getModel() : NULL;
+	if (!model)
+		return;
+	entry._x = _pos.x() + model->_insertOffset.x();
+	entry._y = _pos.y() + model->_insertOffset.y();
+
+	int32 cell = getCollisionCell(entry._x, entry._y);
+	if (cell != entry._cell) {
+		Common::Array<int> &oldCell = _collisionCells[entry._cell];
+		for (uint i = 0; i < oldCell.size(); i++) {
+			if (oldCell[i] == _collisionEntry) {
+				oldCell.remove_at(i);
+				break;
+			}
+		}
+		_collisionCells[cell].push_back(_collisionEntry);
+		entry._cell = cell;
+	}
+}
+
+void Actor::findCollisionCandidates(float x, float y, float reach, int after, Common::Array<int> &candidates) {
+	candidates.clear();
+
+	// The shapes of two actors cannot touch if their centers are farther
+	// apart than their reaches. Leave some room for the rounding of the
+	// narrow phase tests.
+	float range = reach + _collisionMaxReach + 0.01f;
+	int32 x1 = (int32)floor((x - range) / _collisionCellSize);
+	int32 x2 = (int32)floor((x + range) / _collisionCellSize);
+	int32 y1 = (int32)floor((y - range) / _collisionCellSize);
+	int32 y2 = (int32)floor((y + range) / _collisionCellSize);
+
+	if ((x2 - x1 + 1) * (y2 - y1 + 1) > (int32)_collisionEntries.size()) {
+		for (uint i = after + 1; i < _collisionEntries.size(); i++)
+			candidates.push_back(i);
+	} else {
+		for (int32 cy = y1; cy <= y2; cy++) {
+			for (int32 cx = x1; cx <= x2; cx++) {
+				Common::HashMap<int32, Common::Array<int> >::iterator cell =
+					_collisionCells.find(makeCollisionCell(cx, cy));
+				if (cell == _collisionCells.end())
+					continue;
+				for (uint i = 0; i < cell->_value.size(); i++) {
+					if (cell->_value[i] > after)
+						candidates.push_back(cell->_value[i]);
+				}
+			}
+		}
+		Common::sort(candidates.begin(), candidates.end());
+	}
+
+	uint count = 0;
+	for (uint i = 0; i < candidates.size(); i++) {
+		const CollisionEntry &entry = _collisionEntries[candidates[i]];
+		float dx = entry._x - x, dy = entry._y - y;
+		float dist = reach + entry._reach + 0.01f;
+		if (dx * dx + dy * dy < dist * dist)
+			candidates[count++] = candidates[i];
+	}
+	candidates.resize(count);
+}
+
+// The collision box of a model placed at pos, turned by yaw degrees
+static Graphics::Rect2d getCollisionRect(const Graphics::Vector3d &pos, Model *model, float scale, float yaw) {
+	Graphics::Vector3d bboxPos = pos + model->_bboxPos;
+	Graphics::Vector3d size = model->_bboxSize * scale;
+
+	Graphics::Rect2d rect;
+	rect._topLeft = Graphics::Vector2d(bboxPos.x(), bboxPos.y() + size.y());
+	rect._topRight = Graphics::Vector2d(bboxPos.x() + size.x(), bboxPos.y() + size.y());
+	rect._bottomLeft = Graphics::Vector2d(bboxPos.x(), bboxPos.y());
+	rect._bottomRight = Graphics::Vector2d(bboxPos.x() + size.x(), bboxPos.y());
+	rect.rotateAround(Graphics::Vector2d(pos.x(), pos.y()), yaw);
+	return rect;
 }
 
 bool Actor::collidesWith(Actor *actor, Graphics::Vector3d *vec) const {
@@ -1488,35 +1739,33 @@ bool Actor::collidesWith(Actor *actor, Graphics::Vector3d *vec) const {
 			return true;
 		}
 	} else if (mode1 == CollisionBox && mode2 == CollisionBox) {
-		warning("Collision between box and box not implemented!");
-		return false;
+		Graphics::Rect2d rect1 = getCollisionRect(p1 + *vec, model1, _collisionScale, _yaw);
+		Graphics::Rect2d rect2 = getCollisionRect(p2, model2, actor->_collisionScale, actor->_yaw);
+
+		Graphics::Vector2d separation;
+		if (rect1.intersectsRect(rect2, &separation)) {
+			// Move the destination out of the other box the shortest way
+			vec->x() += separation.getX();
+			vec->y() += separation.getY();
+
+			collisionHandlerCallback(actor);
+			return true;
+		}
 	} else {
 		Graphics::Rect2d rect;
-
-		Graphics::Vector3d bboxPos;
-		Graphics::Vector3d size;
-		Graphics::Vector3d pos;
 		Graphics::Vector3d circlePos;
-		float yaw;
-
 		Graphics::Vector2d circle;
 		float radius;
 
 		if (mode1 == CollisionBox) {
-			pos = p1 + *vec;
-			bboxPos = pos + model1->_bboxPos;
-			size = model1->_bboxSize * _collisionScale;
-			yaw = _yaw;
+			rect = getCollisionRect(p1 + *vec, model1, _collisionScale, _yaw);
 
 			circle.setX(p2.x());
 			circle.setY(p2.y());
 			circlePos = p2;
 			radius = size2;
 		} else {
-			pos = p2;
-			bboxPos = p2 + model2->_bboxPos;
-			size = model2->_bboxSize * actor->_collisionScale;
-			yaw = actor->_yaw;
+			rect = getCollisionRect(p2, model2, actor->_collisionScale, actor->_yaw);
 
 			circle.setX(p1.x() + vec->x());
 			circle.setY(p1.y() + vec->y());
@@ -1524,12 +1773,6 @@ bool Actor::collidesWith(Actor *actor, Graphics::Vector3d *vec) const {
 			radius = size1;
 		}
 
-		rect._topLeft = Graphics::Vector2d(bboxPos.x(), bboxPos.y() + size.y());
-		rect._topRight = Graphics::Vector2d(bboxPos.x() + size.x(), bboxPos.y() + size.y());
-		rect._bottomLeft = Graphics::Vector2d(bboxPos.x(), bboxPos.y());
-		rect._bottomRight = Graphics::Vector2d(bboxPos.x() + size.x(), bboxPos.y());
-		rect.rotateAround(Graphics::Vector2d(pos.x(), pos.y()), yaw);
-
 		if (rect.intersectsCircle(circle, radius)) {
 			Graphics::Vector2d center = rect.getCenter();
 			// Draw a line from the center of the rect to the place the character
@@ -23,6 +23,9 @@
 #ifndef GRIM_ACTOR_H
 #define GRIM_ACTOR_H
 
+#include "common/array.h"
+#include "common/hashmap.h"
+
 #include "engines/grim/pool.h"
 #include "engines/grim/object.h"
 #include "graphics/vector3d.h"
@@ -259,7 +262,7 @@ public:
 	 * @param val The value: true if visible, false otherwise.
 	 * @see isVisible
 	 */
-	void setVisibility(bool val) { _visible = val; }
+	void setVisibility(bool val) { _visible = val; invalidateCollisionHash(); }
 	/**
 	 * Returns true if the actor is visible.
 	 *
@@ -457,6 +460,7 @@ private:
 	void updateWalk();
 	void addShadowPlane(const char *n, Scene *scene, int shadowId);
 	bool shouldDrawShadow(int shadowId);
+	bool isInView(Costume *costume) const;
 	void stopTalking();
 	bool stopMumbleChore();
 
@@ -530,17 +534,45 @@ private:
 
 	// struct used for path finding
 	struct PathNode {
-		Sector *sect;
-		PathNode *parent;
+		int sect;		// index of the sector in the scene
+		int parent;		// index of the parent node, -1 for the start
 		Graphics::Vector3d pos;
 		float dist;
 		float cost;
+		bool closed;
 	};
 	Common::List<Graphics::Vector3d> _path;
 
 	CollisionMode _collisionMode;
 	float _collisionScale;
 
+	// A spatial hash over the xy plane of the actors of a set that can be
+	// collided with, so that moveTo only tests the ones near it. It is built
+	// by the first moveTo after an actor was created, deleted, hidden, shown,
+	// put in another set or changed its costume or collision settings, and
+	// an actor updates its own entry whenever it changes its position.
+	struct CollisionEntry {
+		Actor *_actor;
+		float _x, _y;	// center of the collision shape
+		float _reach;	// distance from the center to the farthest point of the shape
+		int32 _cell;
+	};
+	static void buildCollisionHash(const Common::String &setName);
+	static void invalidateCollisionHash() { _collisionHashValid = false; }
+	static int32 getCollisionCell(float x, float y);
+	static void findCollisionCandidates(float x, float y, float reach, int after, Common::Array<int> &candidates);
+	// The last entry at or before the pool position of an actor, -1 if
+	// there is none or -2 if the actor is not in the pool anymore
+	static int findCollisionEntryBefore(int id);
+	bool getCollisionShape(float *x, float *y, float *reach) const;
+	void updateCollisionHash();
+	static Common::Array<CollisionEntry> _collisionEntries;	// in pool order
+	static Common::HashMap<int32, Common::Array<int> > _collisionCells;
+	static Common::String _collisionSet;
+	static float _collisionCellSize, _collisionMaxReach;
+	static bool _collisionHashValid;
+	int _collisionEntry;	// index in _collisionEntries, or -1
+
 	friend class GrimEngine;
 };
 
@@ -38,6 +38,9 @@ Animation::Animation(const Common::String &keyframe, AnimManager *manager, int p
 	_fade(1.f),
 	_fadeMode(None) {
 	_keyframe = g_resourceloader->getKeyframe(keyframe);
+	_cursors.resize(_keyframe->getNumJoints());
+	for (uint i = 0; i < _cursors.size(); i++)
+		_cursors[i] = 0;
 }
 
 Animation::~Animation() {
@@ -202,91 +205,99 @@ void AnimManager::addAnimation(Animation *anim, int priority1, int priority2) {
 	// Keep the list of animations sorted by priorities in descending order. Because
 	// the animations have two different priorities, we add the animation to the list
 	// with both priorities.
-	Common::List<AnimationEntry>::iterator i;
+	uint i;
 	AnimationEntry entry;
 	entry._anim = anim;
 	entry._priority = priority1;
 	entry._tagged = false;
-	for (i = _activeAnims.begin(); i != _activeAnims.end(); ++i) {
-		if (i->_priority < entry._priority) {
-			_activeAnims.insert(i, entry);
+	for (i = 0; i < _activeAnims.size(); ++i) {
+		if (_activeAnims[i]._priority < entry._priority)
 			break;
-		}
 	}
-	if (i == _activeAnims.end())
-		_activeAnims.push_back(entry);
+	_activeAnims.insert_at(i, entry);
 
 	entry._priority = priority2;
 	entry._tagged = true;
-	for (i = _activeAnims.begin(); i != _activeAnims.end(); ++i) {
-		if (i->_priority < entry._priority) {
-			_activeAnims.insert(i, entry);
+	for (i = 0; i < _activeAnims.size(); ++i) {
+		if (_activeAnims[i]._priority < entry._priority)
 			break;
-		}
 	}
-	if (i == _activeAnims.end())
-		_activeAnims.push_back(entry);
+	_activeAnims.insert_at(i, entry);
 }
 
 void AnimManager::removeAnimation(Animation *anim) {
-	Common::List<AnimationEntry>::iterator i;
-	for (i = _activeAnims.begin(); i != _activeAnims.end(); ++i) {
-		if (i->_anim == anim) {
-			i = _activeAnims.erase(i);
-			i--;
-		}
+	for (uint i = 0; i < _activeAnims.size(); ) {
+		if (_activeAnims[i]._anim == anim)
+			_activeAnims.remove_at(i);
+		else
+			++i;
 	}
 }
 
 void AnimManager::animate(ModelNode *hier, int numNodes) {
-	// Apply animation to each hierarchy node separately.
+	_layerPos.resize(numNodes);
+	_layerPitch.resize(numNodes);
+	_layerYaw.resize(numNodes);
+	_layerRoll.resize(numNodes);
+	_totalWeights.resize(numNodes);
+	_remainingWeights.resize(numNodes);
 	for (int i = 0; i < numNodes; i++) {
-		Graphics::Vector3d tempPos;
-		float tempYaw = 0.0f, tempPitch = 0.0f, tempRoll = 0.0f;
-		float totalWeight = 0.0f;
-		float remainingWeight = 1.0f;
-		int currPriority = -1;
-
-		// The animations are layered so that animations with a higher priority
-		// are played regardless of the blend weights of lower priority animations.
-		// The highest priority layer gets as much weight as it wants, while the
-		// next layer gets the remaining amount and so on.
-		for (Common::List<AnimationEntry>::iterator j = _activeAnims.begin(); j != _activeAnims.end(); ++j) {
-			if (currPriority != j->_priority) {
-				currPriority = j->_priority;
-				remainingWeight *= 1 - totalWeight;
-				if (remainingWeight <= 0.0f)
-					break;
+		_layerPos[i].set(0, 0, 0);
+		_layerPitch[i] = 0.0f;
+		_layerYaw[i] = 0.0f;
+		_layerRoll[i] = 0.0f;
+		_totalWeights[i] = 0.0f;
+		_remainingWeights[i] = 1.0f;
+	}
+
+	// The animations are layered so that animations with a higher priority
+	// are played regardless of the blend weights of lower priority animations.
+	// The highest priority layer gets as much weight as it wants, while the
+	// next layer gets the remaining amount and so on. Each animation is
+	// applied to the whole hierarchy at once, and the nodes keep their own
+	// weights, so a node with no weight left is skipped by the later layers.
+	int currPriority = -1;
+	for (uint j = 0; j < _activeAnims.size(); ++j) {
+		const AnimationEntry &entry = _activeAnims[j];
+		if (currPriority != entry._priority) {
+			currPriority = entry._priority;
+			for (int i = 0; i < numNodes; i++) {
+				if (_remainingWeights[i] <= 0.0f)
+					continue;
+				_remainingWeights[i] *= 1 - _totalWeights[i];
+				if (_remainingWeights[i] <= 0.0f)
+					continue;
 
 				float weightFactor = 1.0f;
-				if (totalWeight > 1.0f) {
-					weightFactor = 1.0f / totalWeight;
+				if (_totalWeights[i] > 1.0f) {
+					weightFactor = 1.0f / _totalWeights[i];
 				}
-				tempPos += hier[i]._animPos * weightFactor;
-				tempYaw += hier[i]._animYaw * weightFactor;
-				tempPitch += hier[i]._animPitch * weightFactor;
-				tempRoll += hier[i]._animRoll * weightFactor;
+				_layerPos[i] += hier[i]._animPos * weightFactor;
+				_layerYaw[i] += hier[i]._animYaw * weightFactor;
+				_layerPitch[i] += hier[i]._animPitch * weightFactor;
+				_layerRoll[i] += hier[i]._animRoll * weightFactor;
 				hier[i]._animPos.set(0,0,0);
 				hier[i]._animYaw = 0.0f;
 				hier[i]._animPitch = 0.0f;
 				hier[i]._animRoll = 0.0f;
-				totalWeight = 0.0f;
+				_totalWeights[i] = 0.0f;
 			}
-
-			float time = j->_anim->_time / 1000.0f;
-			float weight = j->_anim->_fade * remainingWeight;
-			if (j->_anim->_keyframe->animate(hier, i, time, weight, j->_tagged))
-				totalWeight += j->_anim->_fade;
 		}
 
+		Animation *anim = entry._anim;
+		anim->_keyframe->animate(hier, numNodes, anim->_time / 1000.0f, anim->_fade, entry._tagged,
+								 anim->_cursors.begin(), _remainingWeights.begin(), _totalWeights.begin());
+	}
+
+	for (int i = 0; i < numNodes; i++) {
 		float weightFactor = 1.0f;
-		if (totalWeight > 1.0f) {
-			weightFactor = 1.0f / totalWeight;
+		if (_totalWeights[i] > 1.0f) {
+			weightFactor = 1.0f / _totalWeights[i];
 		}
-		hier[i]._animPos = hier[i]._animPos * weightFactor + tempPos;
-		hier[i]._animYaw = hier[i]._animYaw * weightFactor + tempYaw;
-		hier[i]._animPitch = hier[i]._animPitch * weightFactor + tempPitch;
-		hier[i]._animRoll = hier[i]._animRoll * weightFactor + tempRoll;
+		hier[i]._animPos = hier[i]._animPos * weightFactor + _layerPos[i];
+		hier[i]._animYaw = hier[i]._animYaw * weightFactor + _layerYaw[i];
+		hier[i]._animPitch = hier[i]._animPitch * weightFactor + _layerPitch[i];
+		hier[i]._animRoll = hier[i]._animRoll * weightFactor + _layerRoll[i];
 	}
 }
 
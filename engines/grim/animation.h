@@ -23,6 +23,8 @@
 #ifndef GRIM_ANIMATION_H
 #define GRIM_ANIMATION_H
 
+#include "common/array.h"
+
 #include "engines/grim/keyframe.h"
 
 namespace Grim {
@@ -72,6 +74,7 @@ private:
 	RepeatMode _repeatMode;
 	FadeMode _fadeMode;
 	int _fadeLength;
+	Common::Array<int> _cursors;	// the keyframe entry last used for each joint
 
 	friend class AnimManager;
 };
@@ -91,7 +94,14 @@ private:
 		bool _tagged;
 	};
 
-	Common::List<AnimationEntry> _activeAnims;
+	// Sorted by priority, in descending order
+	Common::Array<AnimationEntry> _activeAnims;
+
+	// The blending state of each node, kept between calls to avoid
+	// allocating it every frame
+	Common::Array<Graphics::Vector3d> _layerPos;
+	Common::Array<float> _layerPitch, _layerYaw, _layerRoll;
+	Common::Array<float> _totalWeights, _remainingWeights;
 };
 
 }
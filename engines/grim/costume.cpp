@@ -880,6 +880,7 @@ Costume::Costume(const Common::String &fname, const char *data, int len, Costume
 	_joint1Node = NULL;
 	_joint2Node = NULL;
 	_joint3Node = NULL;
+	_hierarchy = new ModelHierarchy();
 	_headYaw = 0;
 	_headPitch = 0;
 	_prevCostume = prevCost;
@@ -1067,6 +1068,7 @@ Costume::~Costume() {
 		delete[] _components;
 		delete[] _chores;
 	}
+	delete _hierarchy;
 }
 
 Costume::Component::Component(Component *p, int parentID, tag32 t)  {
@@ -1387,6 +1389,11 @@ ModelNode *Costume::getModelNodes() {
 	return NULL;
 }
 
+// The matrix of root must already be set, see ModelHierarchy::update()
+void Costume::updateHierarchy(ModelNode *root) {
+	_hierarchy->update(root);
+}
+
 Model *Costume::getModel() {
 	for (int i = 0; i < _numComponents; i++) {
 		if (!_components[i])
@@ -1596,7 +1603,7 @@ void Costume::moveHead(bool lookingMode, const Graphics::Vector3d &lookAt, float
 			p = p->_parent;
 		}
 		p->setMatrix(_matrix);
-		p->update();
+		updateHierarchy(p);
 
 		Graphics::Vector3d v =  lookAt - _joint3Node->_matrix._pos;
 		if (v.isZero()) {
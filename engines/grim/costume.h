@@ -39,6 +39,7 @@ typedef uint32 tag32;
 class CMap;
 class Model;
 class ModelNode;
+class ModelHierarchy;
 class TextSplitter;
 
 class Costume : public Object {
@@ -61,6 +62,7 @@ public:
 	void fadeChoreIn(int chore, int msecs);
 	void fadeChoreOut(int chore, int msecs);
 	ModelNode *getModelNodes();
+	void updateHierarchy(ModelNode *root);
 	Model *getModel();
 	void setColormap(const Common::String &map);
 	void stopChores();
@@ -193,6 +195,7 @@ private:
 	ModelNode *_joint1Node;
 	ModelNode *_joint2Node;
 	ModelNode *_joint3Node;
+	ModelHierarchy *_hierarchy;	// the hierarchy of the model nodes, kept between frames
 
 	float _headPitch;
 	float _headYaw;
@@ -20,15 +20,24 @@
  *
  */
 
+#include "common/algorithm.h"
+
 #include "engines/grim/gfx_base.h"
 #include "engines/grim/savegame.h"
 #include "engines/grim/colormap.h"
+#include "engines/grim/material.h"
+#include "engines/grim/model.h"
 
 namespace Grim {
 
 GfxBase::GfxBase() :
 	_renderBitmaps(true),
-	_renderZBitmaps(true) {
+	_renderZBitmaps(true),
+	_lightsEnabled(false),
+	_collectDrawList(false),
+	_stateChanges(0),
+	_drawnBatches(0),
+	_collectShadowCasters(false) {
 
 }
 
@@ -68,4 +77,384 @@ void GfxBase::renderZBitmaps(bool render) {
 	_renderZBitmaps = render;
 }
 
+void GfxBase::beginDrawList() {
+	_collectDrawList = true;
+	_projectedMeshes.clear();
+	_stateChanges = 0;
+	_drawnBatches = 0;
+}
+
+bool GfxBase::recordMesh(const Mesh *mesh) {
+	if (!_collectDrawList || _currentShadowArray)
+		return false;
+
+	int matrix = _drawListMatrices.size() / 16;
+	_drawListMatrices.resize(_drawListMatrices.size() + 16);
+	if (_modelViewStack.empty())
+		getModelViewMatrix(&_drawListMatrices[16 * matrix]);
+	else
+		memcpy(&_drawListMatrices[16 * matrix], &_modelViewStack[_modelViewStack.size() - 16], 16 * sizeof(float));
+
+	DrawListEntry entry;
+	entry._mesh = mesh;
+	entry._lighting = _lightsEnabled && mesh->_lightingMode != 0;
+	entry._matrix = matrix;
+	for (int i = 0; i < mesh->_numBatches; i++) {
+		const MeshBatch &batch = mesh->_batches[i];
+		if (batch._numIndices == 0)
+			continue;
+		entry._batch = &batch;
+		// Capture the texture now, animated materials may be shared by several actors
+		entry._texture = batch._material ? batch._material->getCurrentTexture() : NULL;
+		_drawList.push_back(entry);
+	}
+	return true;
+}
+
+struct DrawListLess {
+	template<class T>
+	bool operator()(const T &a, const T &b) const {
+		if (a._lighting != b._lighting)
+			return a._lighting < b._lighting;
+		if (a._texture != b._texture)
+			return a._texture < b._texture;
+		if (a._mesh != b._mesh)
+			return a._mesh < b._mesh;
+		return a._matrix < b._matrix;
+	}
+};
+
+void GfxBase::flushDrawList() {
+	_collectDrawList = false;
+	if (_drawList.empty())
+		return;
+
+	Common::sort(_drawList.begin(), _drawList.end(), DrawListLess());
+
+	startDrawList();
+	// The shadow passes toggle the driver's lighting behind _lightsEnabled,
+	// so set it for the first entry instead of trusting the flag
+	const bool lightsEnabled = _lightsEnabled;
+	bool lighting = _drawList[0]._lighting;
+	if (lighting)
+		enableLights();
+	else
+		disableLights();
+	const Texture *texture = NULL;
+	const Mesh *mesh = NULL;
+	int matrix = -1;
+	for (uint i = 0; i < _drawList.size(); i++) {
+		const DrawListEntry &entry = _drawList[i];
+		if (entry._lighting != lighting) {
+			if (entry._lighting)
+				enableLights();
+			else
+				disableLights();
+			lighting = entry._lighting;
+			++_stateChanges;
+		}
+		if (entry._texture && entry._texture != texture) {
+			selectMaterial(entry._texture);
+			texture = entry._texture;
+			++_stateChanges;
+		}
+		if (entry._mesh != mesh || entry._matrix != matrix) {
+			setDrawListMesh(entry._mesh, &_drawListMatrices[16 * entry._matrix]);
+			mesh = entry._mesh;
+			matrix = entry._matrix;
+		}
+		drawMeshBatch(entry._mesh, entry._batch);
+		++_drawnBatches;
+	}
+	if (lightsEnabled)
+		enableLights();
+	else
+		disableLights();
+	finishDrawList();
+
+	// Keep the storage around for the next frame
+	_drawList.resize(0);
+	_drawListMatrices.resize(0);
+}
+
+void GfxBase::getModelViewProjectionMatrix(float *matrix) {
+	float modelView[16], projection[16];
+	getModelViewMatrix(modelView);
+	getProjectionMatrix(projection);
+	for (int col = 0; col < 4; col++) {
+		for (int row = 0; row < 4; row++) {
+			matrix[col * 4 + row] = projection[row] * modelView[col * 4] + projection[4 + row] * modelView[col * 4 + 1] +
+									projection[8 + row] * modelView[col * 4 + 2] + projection[12 + row] * modelView[col * 4 + 3];
+		}
+	}
+}
+
+// Multiplies the column-major matrix m by r on the right, like glMultMatrixf
+static void multMatrix(float *m, const float *r) {
+	float result[16];
+	for (int col = 0; col < 4; col++) {
+		for (int row = 0; row < 4; row++) {
+			result[col * 4 + row] = m[row] * r[col * 4] + m[4 + row] * r[col * 4 + 1] +
+									m[8 + row] * r[col * 4 + 2] + m[12 + row] * r[col * 4 + 3];
+		}
+	}
+	memcpy(m, result, sizeof(result));
+}
+
+// Rotates m around one of the axes, like glRotatef(angle, ...) with a unit axis
+static void rotateMatrix(float *m, float angle, int axis) {
+	float r[16] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+	float c = cos(angle * LOCAL_PI / 180.0f);
+	float s = sin(angle * LOCAL_PI / 180.0f);
+	// The two axes the rotation turns, in the direction of a positive angle
+	int a = (axis + 1) % 3;
+	int b = (axis + 2) % 3;
+	r[a * 4 + a] = c;
+	r[a * 4 + b] = s;
+	r[b * 4 + a] = -s;
+	r[b * 4 + b] = c;
+	multMatrix(m, r);
+}
+
+void GfxBase::startTrackingModelView() {
+	_modelViewStack.resize(0);
+	if (!_collectDrawList || _currentShadowArray)
+		return;
+	_modelViewStack.resize(16);
+	getModelViewMatrix(&_modelViewStack[0]);
+}
+
+void GfxBase::finishTrackingModelView() {
+	_modelViewStack.resize(0);
+}
+
+void GfxBase::pushModelView(const Graphics::Vector3d &pos, float pitch, float yaw, float roll) {
+	if (_modelViewStack.empty())
+		return;
+
+	uint top = _modelViewStack.size();
+	_modelViewStack.resize(top + 16);
+	float *m = &_modelViewStack[top];
+	memcpy(m, m - 16, 16 * sizeof(float));
+	for (int row = 0; row < 4; row++)
+		m[12 + row] += m[row] * pos.x() + m[4 + row] * pos.y() + m[8 + row] * pos.z();
+	if (yaw != 0.0f)
+		rotateMatrix(m, yaw, 2);
+	if (pitch != 0.0f)
+		rotateMatrix(m, pitch, 0);
+	if (roll != 0.0f)
+		rotateMatrix(m, roll, 1);
+}
+
+void GfxBase::popModelView() {
+	// The first matrix is the one of the actor, finishTrackingModelView drops it
+	if (_modelViewStack.size() > 16)
+		_modelViewStack.resize(_modelViewStack.size() - 16);
+}
+
+bool GfxBase::isBoxVisible(const Graphics::Vector3d &pos, const Graphics::Vector3d &size) {
+	float m[16];
+	getModelViewProjectionMatrix(m);
+
+	// The frustum planes are the last row of the matrix plus or minus one
+	// of the others. The box is out if its corner furthest along the normal
+	// of a plane is still behind it.
+	Graphics::Vector3d max = pos + size;
+	for (int i = 0; i < 6; i++) {
+		float sign = (i & 1) ? -1.0f : 1.0f;
+		int row = i / 2;
+		float a = m[3] + sign * m[row];
+		float b = m[7] + sign * m[4 + row];
+		float c = m[11] + sign * m[8 + row];
+		float d = m[15] + sign * m[12 + row];
+		float x = a >= 0 ? max.x() : pos.x();
+		float y = b >= 0 ? max.y() : pos.y();
+		float z = c >= 0 ? max.z() : pos.z();
+		if (a * x + b * y + c * z + d < 0)
+			return false;
+	}
+
+	return !isBoxOccluded(pos, size);
+}
+
+GfxBase::ProjectedMesh *GfxBase::findProjectedMesh(const Mesh *mesh, const float *matrix, const int *viewport) {
+	ProjectedMeshMap::iterator i = _projectedMeshes.find(mesh);
+	if (i == _projectedMeshes.end())
+		return NULL;
+	ProjectedMesh &projected = i->_value;
+	if ((int)projected._vertices.size() != 3 * mesh->_numVertices ||
+			memcmp(projected._matrix, matrix, sizeof(projected._matrix)) != 0 ||
+			memcmp(projected._viewport, viewport, sizeof(projected._viewport)) != 0)
+		return NULL;
+	return &projected;
+}
+
+const GfxBase::ProjectedMesh *GfxBase::projectMesh(const Mesh *mesh) {
+	float m[16];
+	int viewport[4];
+	getModelViewProjectionMatrix(m);
+	getViewport(viewport);
+
+	ProjectedMesh *cached = findProjectedMesh(mesh, m, viewport);
+	if (cached)
+		return cached;
+
+	ProjectedMesh &projected = _projectedMeshes[mesh];
+	memcpy(projected._matrix, m, sizeof(m));
+	memcpy(projected._viewport, viewport, sizeof(viewport));
+	projected._vertices.resize(3 * mesh->_numVertices);
+	projected._x1 = projected._y1 = projected._z1 = 1e10f;
+	projected._x2 = projected._y2 = projected._z2 = -1e10f;
+	projected._inFront = true;
+	if (mesh->_numVertices == 0)
+		return &projected;
+
+	const float *in = mesh->_vertices;
+	float *out = &projected._vertices[0];
+	for (int i = 0; i < mesh->_numVertices; i++, in += 3, out += 3) {
+		float x = m[0] * in[0] + m[4] * in[1] + m[8] * in[2] + m[12];
+		float y = m[1] * in[0] + m[5] * in[1] + m[9] * in[2] + m[13];
+		float z = m[2] * in[0] + m[6] * in[1] + m[10] * in[2] + m[14];
+		float w = m[3] * in[0] + m[7] * in[1] + m[11] * in[2] + m[15];
+		if (w <= 0.0f)
+			projected._inFront = false;
+		if (w == 0.0f)
+			w = 1.0f;
+		out[0] = viewport[0] + viewport[2] * (1.0f + x / w) / 2.0f;
+		out[1] = viewport[1] + viewport[3] * (1.0f + y / w) / 2.0f;
+		out[2] = (1.0f + z / w) / 2.0f;
+	}
+
+	// The bounds only cover the vertices the faces use
+	for (int i = 0; i < mesh->_numFaces; i++) {
+		const MeshFace &face = mesh->_faces[i];
+		for (int j = 0; j < face._numVertices; j++) {
+			const float *win = &projected._vertices[3 * face._vertices[j]];
+			projected._x1 = MIN(projected._x1, win[0]);
+			projected._x2 = MAX(projected._x2, win[0]);
+			projected._y1 = MIN(projected._y1, win[1]);
+			projected._y2 = MAX(projected._y2, win[1]);
+			projected._z1 = MIN(projected._z1, win[2]);
+			projected._z2 = MAX(projected._z2, win[2]);
+		}
+	}
+	return &projected;
+}
+
+bool GfxBase::isMeshVisible(const Mesh *mesh) {
+	float m[16];
+	int viewport[4];
+	getModelViewProjectionMatrix(m);
+	getViewport(viewport);
+
+	// Without a projection from this frame the bounding box is cheaper than
+	// projecting every vertex. Vertices behind the eye have no window position.
+	const ProjectedMesh *projected = findProjectedMesh(mesh, m, viewport);
+	if (!projected || !projected->_inFront)
+		return isBoxVisible(mesh->_bboxPos, mesh->_bboxSize);
+
+	if (projected->_x2 < viewport[0] || projected->_x1 > viewport[0] + viewport[2] ||
+			projected->_y2 < viewport[1] || projected->_y1 > viewport[1] + viewport[3] ||
+			projected->_z2 < 0.0f || projected->_z1 > 1.0f)
+		return false;
+
+	return !isWindowRectOccluded(projected->_x1, projected->_y1, projected->_x2, projected->_y2, projected->_z1);
+}
+
+// Inverts a column-major matrix made of a 3x3 linear part and a translation
+static void invertAffineMatrix(const float *m, float *out) {
+	float det = m[0] * (m[5] * m[10] - m[9] * m[6]) -
+				m[4] * (m[1] * m[10] - m[9] * m[2]) +
+				m[8] * (m[1] * m[6] - m[5] * m[2]);
+	float inv = det != 0.0f ? 1.0f / det : 0.0f;
+
+	out[0] = (m[5] * m[10] - m[9] * m[6]) * inv;
+	out[1] = (m[9] * m[2] - m[1] * m[10]) * inv;
+	out[2] = (m[1] * m[6] - m[5] * m[2]) * inv;
+	out[4] = (m[8] * m[6] - m[4] * m[10]) * inv;
+	out[5] = (m[0] * m[10] - m[8] * m[2]) * inv;
+	out[6] = (m[4] * m[2] - m[0] * m[6]) * inv;
+	out[8] = (m[4] * m[9] - m[8] * m[5]) * inv;
+	out[9] = (m[8] * m[1] - m[0] * m[9]) * inv;
+	out[10] = (m[0] * m[5] - m[4] * m[1]) * inv;
+	for (int i = 0; i < 3; i++)
+		out[12 + i] = -(out[i] * m[12] + out[4 + i] * m[13] + out[8 + i] * m[14]);
+	out[3] = out[7] = out[11] = 0.0f;
+	out[15] = 1.0f;
+}
+
+void GfxBase::beginShadowCasters() {
+	getModelViewMatrix(_shadowCasterInverseView);
+	float view[16];
+	memcpy(view, _shadowCasterInverseView, sizeof(view));
+	invertAffineMatrix(view, _shadowCasterInverseView);
+
+	_shadowCasterVertices.resize(0);
+	_shadowCasterIndices.resize(0);
+	_collectShadowCasters = true;
+}
+
+void GfxBase::recordShadowCaster(const Mesh *mesh) {
+	if (!_collectShadowCasters || _currentShadowArray || mesh->_numBatchIndices == 0)
+		return;
+
+	// Bring the mesh from its own space to world space, the shadow
+	// projection then goes between the view and the world
+	float modelView[16], m[16];
+	getModelViewMatrix(modelView);
+	const float *a = _shadowCasterInverseView;
+	for (int col = 0; col < 4; col++) {
+		for (int row = 0; row < 3; row++) {
+			m[col * 4 + row] = a[row] * modelView[col * 4] + a[4 + row] * modelView[col * 4 + 1] +
+							   a[8 + row] * modelView[col * 4 + 2] + a[12 + row] * modelView[col * 4 + 3];
+		}
+	}
+
+	uint32 first = _shadowCasterVertices.size() / 3;
+	_shadowCasterVertices.resize(_shadowCasterVertices.size() + 3 * mesh->_numBatchVertices);
+	float *out = &_shadowCasterVertices[3 * first];
+	const float *in = mesh->_batchVertices;
+	for (int i = 0; i < mesh->_numBatchVertices; i++, in += 8, out += 3) {
+		out[0] = m[0] * in[0] + m[4] * in[1] + m[8] * in[2] + m[12];
+		out[1] = m[1] * in[0] + m[5] * in[1] + m[9] * in[2] + m[13];
+		out[2] = m[2] * in[0] + m[6] * in[1] + m[10] * in[2] + m[14];
+	}
+
+	uint32 index = _shadowCasterIndices.size();
+	_shadowCasterIndices.resize(index + mesh->_numBatchIndices);
+	for (int i = 0; i < mesh->_numBatchIndices; i++)
+		_shadowCasterIndices[index + i] = first + mesh->_batchIndices[i];
+}
+
+void GfxBase::endShadowCasters() {
+	_collectShadowCasters = false;
+}
+
+void GfxBase::drawShadowCasters() {
+	if (_shadowCasterIndices.empty())
+		return;
+
+	// The vertices are already in world space, only the shadow projection is left
+	startActorDraw(Graphics::Vector3d(0, 0, 0), 1.0f, 0, 0, 0);
+	drawShadowCasterTriangles(&_shadowCasterVertices[0], &_shadowCasterIndices[0], _shadowCasterIndices.size());
+	finishActorDraw();
+}
+
+void GfxBase::drawMeshBatches(const Mesh *mesh) {
+	const Texture *texture = NULL;
+	for (int i = 0; i < mesh->_numBatches; i++) {
+		const MeshBatch &batch = mesh->_batches[i];
+		if (batch._numIndices == 0)
+			continue;
+		const Texture *t = batch._material ? batch._material->getCurrentTexture() : NULL;
+		if (t && t != texture) {
+			selectMaterial(t);
+			texture = t;
+			++_stateChanges;
+		}
+		drawMeshBatch(mesh, &batch);
+		++_drawnBatches;
+	}
+}
+
 }
@@ -23,6 +23,9 @@
 #ifndef GRIM_GFX_BASE_H
 #define GRIM_GFX_BASE_H
 
+#include "common/array.h"
+#include "common/hashmap.h"
+
 #include "graphics/vector3d.h"
 
 namespace Grim {
@@ -40,6 +43,7 @@ class Material;
 class ModelNode;
 class Mesh;
 class MeshFace;
+struct MeshBatch;
 struct Sprite;
 class Light;
 class Texture;
@@ -102,10 +106,124 @@ public:
 	virtual void drawModelFace(const MeshFace *face, float *vertices, float *vertNormals, float *textureVerts) = 0;
 	virtual void drawSprite(const Sprite *sprite) = 0;
 
+	/**
+	 * Prepares a mesh for drawing
+	 * the renderer may upload the triangulated batches of the mesh
+	 * and keep a reference to them in the mesh's user data.
+	 *
+	 * @param mesh	the mesh to be prepared
+	 * @see drawMesh
+	 * @see destroyMesh
+	 */
+	virtual void createMesh(Mesh *mesh) = 0;
+
+	/**
+	 * Draws all the faces of a mesh, one material at a time
+	 *
+	 * @param mesh	the mesh to be drawn
+	 * @see createMesh
+	 */
+	virtual void drawMesh(const Mesh *mesh) = 0;
+
+	/**
+	 * Draws one batch of a mesh, using the vertex data set up by
+	 * setDrawListMesh or drawMesh
+	 */
+	virtual void drawMeshBatch(const Mesh *mesh, const MeshBatch *batch) = 0;
+
+	/**
+	 * Deletes any internal representation of a mesh
+	 *
+	 * @param mesh	the mesh to be destroyed
+	 * @see createMesh
+	 */
+	virtual void destroyMesh(Mesh *mesh) = 0;
+
 	virtual void enableLights() = 0;
 	virtual void disableLights() = 0;
 	virtual void setupLight(Light *light, int lightId) = 0;
 
+	/**
+	 * Starts collecting the meshes drawn from now on into a draw list,
+	 * instead of drawing them right away. Shadows are never collected.
+	 * This also resets the state change counters.
+	 *
+	 * @see recordMesh
+	 * @see flushDrawList
+	 */
+	void beginDrawList();
+
+	/**
+	 * Adds the batches of a mesh to the draw list, along with the current
+	 * modelview matrix, texture and lighting state.
+	 *
+	 * @param mesh	the mesh to be drawn
+	 * @return true if the mesh was collected, false if it must be drawn now
+	 */
+	bool recordMesh(const Mesh *mesh);
+
+	/**
+	 * Sorts the draw list by lighting state and texture and draws it,
+	 * skipping the texture binds and lighting toggles already in effect.
+	 *
+	 * @see beginDrawList
+	 */
+	void flushDrawList();
+
+	/**
+	 * Starts keeping the vertices of the meshes drawn from now on,
+	 * transformed to world space, so that the shadows of an actor can be
+	 * drawn from them instead of walking its costume once per shadow.
+	 * Must be called with the camera matrix current.
+	 *
+	 * @see recordShadowCaster
+	 * @see drawShadowCasters
+	 */
+	void beginShadowCasters();
+
+	/**
+	 * Adds the vertices of a mesh, transformed by the current modelview
+	 * matrix, to the shadow casters, if they are being collected.
+	 *
+	 * @param mesh	the mesh being drawn
+	 */
+	void recordShadowCaster(const Mesh *mesh);
+
+	/**
+	 * Stops collecting shadow casters, keeping the ones collected so far.
+	 */
+	void endShadowCasters();
+
+	/**
+	 * Projects the collected shadow casters onto the plane of the current
+	 * shadow and draws them. Can be called once per shadow.
+	 *
+	 * @see setShadow
+	 */
+	void drawShadowCasters();
+
+	/**
+	 * Checks whether an axis aligned box, given in the space of the current
+	 * modelview matrix, can be seen: it must be at least partly inside the
+	 * view frustum and not hidden behind the depth drawn so far.
+	 *
+	 * @param pos	the corner of the box with the lowest coordinates
+	 * @param size	the extent of the box along each axis
+	 * @see isBoxOccluded
+	 */
+	bool isBoxVisible(const Graphics::Vector3d &pos, const Graphics::Vector3d &size);
+
+	/**
+	 * Checks whether a mesh can be seen with the current modelview matrix,
+	 * like isBoxVisible. When the mesh was already projected this frame with
+	 * the same transformation, such as for its bounding box, the test uses
+	 * the window rectangle of its vertices instead of its bounding box.
+	 */
+	bool isMeshVisible(const Mesh *mesh);
+
+	int getStateChanges() const { return _stateChanges; }
+	int getDrawnBatches() const { return _drawnBatches; }
+
 	virtual void createMaterial(Texture *material, const char *data, const CMap *cmap) = 0;
 	virtual void selectMaterial(const Texture *material) = 0;
 	virtual void destroyMaterial(Texture *material) = 0;
@@ -186,6 +304,10 @@ public:
 	 * Prepare a movie-frame for drawing
 	 * performing any necessary conversion
 	 *
+	 * The bitmap is lent by the movie player and stays valid until the
+	 * next call to prepareMovieFrame or releaseMovieFrame, so it can be
+	 * uploaded or blitted from directly without keeping a copy of it.
+	 *
 	 * @param width			the width of the movie-frame.
 	 * @param height		the height of the movie-frame.
 	 * @param bitmap		a pointer to the data for the movie-frame.
@@ -212,6 +334,89 @@ public:
 	void renderZBitmaps(bool render);
 
 protected:
+	struct DrawListEntry {
+		const Mesh *_mesh;
+		const MeshBatch *_batch;
+		const Texture *_texture;
+		bool _lighting;
+		int _matrix;	// index into _drawListMatrices
+	};
+
+	struct ProjectedMesh {
+		float _matrix[16];			// projection * modelview the vertices were projected with
+		int _viewport[4];
+		Common::Array<float> _vertices;	// window coordinates, sets of 3
+		// Window rectangle and depth range of the vertices used by the faces
+		float _x1, _y1, _z1, _x2, _y2, _z2;
+		bool _inFront;				// no vertex is behind the eye
+	};
+
+	struct MeshHash {
+		uint operator()(const Mesh *mesh) const { return (uint)((size_t)mesh >> 4); }
+	};
+
+	typedef Common::HashMap<const Mesh *, ProjectedMesh, MeshHash> ProjectedMeshMap;
+
+	/**
+	 * Returns the window coordinates of the vertices of a mesh with the
+	 * current modelview and projection matrices, as gluProject would.
+	 * A mesh is projected once per frame for a given transformation, every
+	 * vertex once, and kept until beginDrawList for isMeshVisible and the
+	 * bounding boxes to share.
+	 *
+	 * @param mesh	the mesh to be projected
+	 */
+	const ProjectedMesh *projectMesh(const Mesh *mesh);
+	ProjectedMesh *findProjectedMesh(const Mesh *mesh, const float *matrix, const int *viewport);
+
+	/**
+	 * Gets the product of the current projection and modelview matrices.
+	 */
+	void getModelViewProjectionMatrix(float *matrix);
+
+	/**
+	 * Keep a copy of the modelview matrix in step with the driver's while
+	 * an actor is drawn into the draw list, so that recordMesh doesn't
+	 * read it back for every mesh. startTrackingModelView reads it once,
+	 * the others mirror the driver's push, translate/rotate and pop.
+	 */
+	void startTrackingModelView();
+	void finishTrackingModelView();
+	void pushModelView(const Graphics::Vector3d &pos, float pitch, float yaw, float roll);
+	void popModelView();
+
+	/**
+	 * Checks whether a box, given like for isBoxVisible, is entirely behind
+	 * the depth already in the depth buffer, such as the z-bitmaps of the
+	 * set. Renderers that can't cheaply read back depth return false.
+	 */
+	virtual bool isBoxOccluded(const Graphics::Vector3d &pos, const Graphics::Vector3d &size) = 0;
+
+	/**
+	 * Like isBoxOccluded, for a rectangle in window coordinates and the
+	 * smallest window depth of what covers it.
+	 */
+	virtual bool isWindowRectOccluded(float x1, float y1, float x2, float y2, float z) = 0;
+
+	/**
+	 * Draws the batches of a mesh, skipping redundant texture binds.
+	 * The vertex data of the mesh must already be set up.
+	 */
+	void drawMeshBatches(const Mesh *mesh);
+
+	virtual void getModelViewMatrix(float *matrix) = 0;
+	virtual void getProjectionMatrix(float *matrix) = 0;
+	virtual void getViewport(int *viewport) = 0;
+	virtual void startDrawList() = 0;
+	virtual void setDrawListMesh(const Mesh *mesh, const float *matrix) = 0;
+	virtual void finishDrawList() = 0;
+
+	/**
+	 * Draws indexed world space triangles, with the transformation
+	 * set up by startActorDraw.
+	 */
+	virtual void drawShadowCasterTriangles(const float *vertices, const uint32 *indices, int numIndices) = 0;
+
 	int _screenWidth, _screenHeight, _screenBPP;
 	bool _isFullscreen;
 	Shadow *_currentShadowArray;
@@ -220,6 +425,18 @@ protected:
 	unsigned char _shadowColorB;
 	bool _renderBitmaps;
 	bool _renderZBitmaps;
+	bool _lightsEnabled;
+	bool _collectDrawList;
+	Common::Array<DrawListEntry> _drawList;
+	Common::Array<float> _drawListMatrices;	// sets of 16
+	Common::Array<float> _modelViewStack;	// sets of 16, empty when not tracking
+	int _stateChanges;
+	int _drawnBatches;
+	bool _collectShadowCasters;
+	float _shadowCasterInverseView[16];
+	Common::Array<float> _shadowCasterVertices;	// sets of 3
+	Common::Array<uint32> _shadowCasterIndices;	// sets of 3
+	ProjectedMeshMap _projectedMeshes;
 };
 
 // Factory-like functions:
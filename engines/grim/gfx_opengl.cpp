@@ -56,6 +56,16 @@ PFNGLDELETEPROGRAMSARBPROC glDeleteProgramsARB;
 
 #endif
 
+#if defined (SDL_BACKEND) && defined(GL_ARB_vertex_buffer_object)
+
+// Extension functions needed for vertex buffer objects.
+PFNGLGENBUFFERSARBPROC glGenBuffersARB;
+PFNGLBINDBUFFERARBPROC glBindBufferARB;
+PFNGLBUFFERDATAARBPROC glBufferDataARB;
+PFNGLDELETEBUFFERSARBPROC glDeleteBuffersARB;
+
+#endif
+
 namespace Grim {
 
 GfxBase *CreateGfxOpenGL() {
@@ -93,6 +103,7 @@ byte *GfxOpenGL::setupScreen(int screenW, int screenH, bool fullscreen) {
 	_screenBPP = 24;
 	_isFullscreen = g_system->getFeatureState(OSystem::kFeatureFullscreenMode);
 	_useDepthShader = false;
+	_useVertexBuffers = false;
 
 	g_system->showMouse(!fullscreen);
 
@@ -155,6 +166,29 @@ void GfxOpenGL::initExtensions()
 		}
 	}
 #endif
+
+#if defined (SDL_BACKEND) && defined(GL_ARB_vertex_buffer_object)
+	union {
+		void* obj_ptr;
+		void (APIENTRY *func_ptr)();
+	} b;
+
+	assert(sizeof(b.obj_ptr) == sizeof(b.func_ptr));
+	b.obj_ptr = SDL_GL_GetProcAddress("glGenBuffersARB");
+	glGenBuffersARB = (PFNGLGENBUFFERSARBPROC)b.func_ptr;
+	b.obj_ptr = SDL_GL_GetProcAddress("glBindBufferARB");
+	glBindBufferARB = (PFNGLBINDBUFFERARBPROC)b.func_ptr;
+	b.obj_ptr = SDL_GL_GetProcAddress("glBufferDataARB");
+	glBufferDataARB = (PFNGLBUFFERDATAARBPROC)b.func_ptr;
+	b.obj_ptr = SDL_GL_GetProcAddress("glDeleteBuffersARB");
+	glDeleteBuffersARB = (PFNGLDELETEBUFFERSARBPROC)b.func_ptr;
+
+	const char* bufferExtensions = (const char*)glGetString(GL_EXTENSIONS);
+	if (strstr(bufferExtensions, "ARB_vertex_buffer_object") && glGenBuffersARB && glBindBufferARB &&
+			glBufferDataARB && glDeleteBuffersARB) {
+		_useVertexBuffers = true;
+	}
+#endif
 }
 
 const char *GfxOpenGL::getVideoDeviceName() {
@@ -253,40 +287,11 @@ void GfxOpenGL::getBoundingBoxPos(const Mesh *model, int *x1, int *y1, int *x2,
 		return;
 	}
 
-	GLdouble top = 1000;
-	GLdouble right = -1000;
-	GLdouble left = 1000;
-	GLdouble bottom = -1000;
-	GLdouble winX, winY, winZ;
-
-	for (int i = 0; i < model->_numFaces; i++) {
-		Graphics::Vector3d v;
-		float* pVertices;
-
-		for (int j = 0; j < model->_faces[i]._numVertices; j++) {
-			GLdouble modelView[16], projection[16];
-			GLint viewPort[4];
-
-			glGetDoublev(GL_MODELVIEW_MATRIX, modelView);
-			glGetDoublev(GL_PROJECTION_MATRIX, projection);
-			glGetIntegerv(GL_VIEWPORT, viewPort);
-
-			pVertices = model->_vertices + 3 * model->_faces[i]._vertices[j];
-
-			v.set(*(pVertices), *(pVertices + 1), *(pVertices + 2));
-
-			gluProject(v.x(), v.y(), v.z(), modelView, projection, viewPort, &winX, &winY, &winZ);
-
-			if (winX > right)
-				right = winX;
-			if (winX < left)
-				left = winX;
-			if (winY < top)
-				top = winY;
-			if (winY > bottom)
-				bottom = winY;
-		}
-	}
+	const ProjectedMesh *projected = projectMesh(model);
+	GLdouble left = projected->_x1;
+	GLdouble right = projected->_x2;
+	GLdouble top = projected->_y1;
+	GLdouble bottom = projected->_y2;
 
 	double t = bottom;
 	bottom = 480 - top;
@@ -338,13 +343,17 @@ void GfxOpenGL::startActorDraw(Graphics::Vector3d pos, float scale, float yaw, f
 	glRotatef(yaw, 0, 0, 1);
 	glRotatef(pitch, 1, 0, 0);
 	glRotatef(roll, 0, 1, 0);
+	startTrackingModelView();
 }
 
 void GfxOpenGL::finishActorDraw() {
+	finishTrackingModelView();
 	glPopMatrix();
 	glDisable(GL_TEXTURE_2D);
 	if (_currentShadowArray) {
-		glEnable(GL_LIGHTING);
+		// Back to the lighting the scene set up
+		if (_lightsEnabled)
+			glEnable(GL_LIGHTING);
 		glColor3f(1.0f, 1.0f, 1.0f);
 		glDisable(GL_POLYGON_OFFSET_FILL);
 	}
@@ -437,6 +446,139 @@ void GfxOpenGL::drawModelFace(const MeshFace *face, float *vertices, float *vert
 	glDisable(GL_ALPHA_TEST);
 }
 
+void GfxOpenGL::createMesh(Mesh *mesh) {
+#if defined (SDL_BACKEND) && defined(GL_ARB_vertex_buffer_object)
+	if (!_useVertexBuffers || mesh->_numBatchIndices == 0)
+		return;
+
+	GLuint *buffers = new GLuint[2];
+	glGenBuffersARB(2, buffers);
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, buffers[0]);
+	glBufferDataARB(GL_ARRAY_BUFFER_ARB, 8 * mesh->_numBatchVertices * sizeof(float), mesh->_batchVertices, GL_STATIC_DRAW_ARB);
+	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, buffers[1]);
+	glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, mesh->_numBatchIndices * sizeof(uint32), mesh->_batchIndices, GL_STATIC_DRAW_ARB);
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+	mesh->_userData = buffers;
+#endif
+}
+
+void GfxOpenGL::setupMeshArrays(const Mesh *mesh) {
+	const float *vertices = mesh->_batchVertices;
+#if defined (SDL_BACKEND) && defined(GL_ARB_vertex_buffer_object)
+	GLuint *buffers = (GLuint *)mesh->_userData;
+	if (buffers) {
+		// The pointers below become offsets into the bound buffers
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, buffers[0]);
+		glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, buffers[1]);
+		vertices = NULL;
+	} else if (_useVertexBuffers) {
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+		glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+	}
+#endif
+	glVertexPointer(3, GL_FLOAT, 8 * sizeof(float), vertices);
+	glNormalPointer(GL_FLOAT, 8 * sizeof(float), vertices + 3);
+	glTexCoordPointer(2, GL_FLOAT, 8 * sizeof(float), vertices + 6);
+}
+
+void GfxOpenGL::startMeshArrays() {
+	// Support transparency in actor objects, such as the message tube
+	// in Manny's Office
+	glAlphaFunc(GL_GREATER, 0.5);
+	glEnable(GL_ALPHA_TEST);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+}
+
+void GfxOpenGL::finishMeshArrays() {
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisable(GL_ALPHA_TEST);
+#if defined (SDL_BACKEND) && defined(GL_ARB_vertex_buffer_object)
+	if (_useVertexBuffers) {
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+		glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+	}
+#endif
+}
+
+void GfxOpenGL::drawMesh(const Mesh *mesh) {
+	if (mesh->_numBatchIndices == 0)
+		return;
+
+	startMeshArrays();
+	setupMeshArrays(mesh);
+	drawMeshBatches(mesh);
+	finishMeshArrays();
+}
+
+void GfxOpenGL::drawMeshBatch(const Mesh *mesh, const MeshBatch *batch) {
+	const uint32 *indices = mesh->_userData ? NULL : mesh->_batchIndices;
+	glDrawElements(GL_TRIANGLES, batch->_numIndices, GL_UNSIGNED_INT, indices + batch->_firstIndex);
+}
+
+void GfxOpenGL::getModelViewMatrix(float *matrix) {
+	glGetFloatv(GL_MODELVIEW_MATRIX, matrix);
+}
+
+void GfxOpenGL::getProjectionMatrix(float *matrix) {
+	glGetFloatv(GL_PROJECTION_MATRIX, matrix);
+}
+
+void GfxOpenGL::getViewport(int *viewport) {
+	glGetIntegerv(GL_VIEWPORT, viewport);
+}
+
+bool GfxOpenGL::isBoxOccluded(const Graphics::Vector3d &pos, const Graphics::Vector3d &size) {
+	// Reading the depth buffer back would stall the pipeline
+	return false;
+}
+
+bool GfxOpenGL::isWindowRectOccluded(float x1, float y1, float x2, float y2, float z) {
+	return false;
+}
+
+void GfxOpenGL::startDrawList() {
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glEnable(GL_TEXTURE_2D);
+	startMeshArrays();
+}
+
+void GfxOpenGL::setDrawListMesh(const Mesh *mesh, const float *matrix) {
+	glMatrixMode(GL_MODELVIEW);
+	glLoadMatrixf(matrix);
+	setupMeshArrays(mesh);
+}
+
+void GfxOpenGL::finishDrawList() {
+	finishMeshArrays();
+	glDisable(GL_TEXTURE_2D);
+	glMatrixMode(GL_MODELVIEW);
+	glPopMatrix();
+}
+
+void GfxOpenGL::drawShadowCasterTriangles(const float *vertices, const uint32 *indices, int numIndices) {
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, vertices);
+	glDrawElements(GL_TRIANGLES, numIndices, GL_UNSIGNED_INT, indices);
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void GfxOpenGL::destroyMesh(Mesh *mesh) {
+#if defined (SDL_BACKEND) && defined(GL_ARB_vertex_buffer_object)
+	GLuint *buffers = (GLuint *)mesh->_userData;
+	if (buffers) {
+		glDeleteBuffersARB(2, buffers);
+		delete[] buffers;
+	}
+#endif
+	mesh->_userData = NULL;
+}
+
 void GfxOpenGL::drawSprite(const Sprite *sprite) {
 	glMatrixMode(GL_TEXTURE);
 	glLoadIdentity();
@@ -488,10 +630,12 @@ void GfxOpenGL::translateViewpointStart(Graphics::Vector3d pos, float pitch, flo
 	glRotatef(yaw, 0, 0, 1);
 	glRotatef(pitch, 1, 0, 0);
 	glRotatef(roll, 0, 1, 0);
+	pushModelView(pos, pitch, yaw, roll);
 }
 
 void GfxOpenGL::translateViewpointFinish() {
 	glPopMatrix();
+	popModelView();
 }
 
 void GfxOpenGL::drawHierachyNode(const ModelNode *node, int *x1, int *y1, int *x2, int *y2) {
@@ -503,6 +647,7 @@ void GfxOpenGL::drawHierachyNode(const ModelNode *node, int *x1, int *y1, int *x
 	if (node->_hierVisible) {
 		glPushMatrix();
 		glTranslatef(node->_pivot.x(), node->_pivot.y(), node->_pivot.z());
+		pushModelView(node->_pivot, 0, 0, 0);
 
 		if (!_currentShadowArray) {
 			Sprite* sprite = node->_sprite;
@@ -518,6 +663,7 @@ void GfxOpenGL::drawHierachyNode(const ModelNode *node, int *x1, int *y1, int *x
 
 		glMatrixMode(GL_MODELVIEW);
 		glPopMatrix();
+		popModelView();
 
 		if (node->_child) {
 			node->_child->draw(x1, y1, x2, y2);
@@ -532,14 +678,17 @@ void GfxOpenGL::drawHierachyNode(const ModelNode *node, int *x1, int *y1, int *x
 
 void GfxOpenGL::enableLights() {
 	glEnable(GL_LIGHTING);
+	_lightsEnabled = true;
 }
 
 void GfxOpenGL::disableLights() {
 	glDisable(GL_LIGHTING);
+	_lightsEnabled = false;
 }
 
 void GfxOpenGL::setupLight(Light *light, int lightId) {
 	glEnable(GL_LIGHTING);
+	_lightsEnabled = true;
 	float lightColor[] = { 0.0f, 0.0f, 0.0f, 1.0f };
 	float lightPos[] = { 0.0f, 0.0f, 0.0f, 1.0f };
 	float lightDir[] = { 0.0f, 0.0f, -1.0f };
@@ -1038,15 +1187,7 @@ void GfxOpenGL::drawDepthBitmap(int x, int y, int w, int h, char *data) {
 	glDepthFunc(GL_LESS);
 }
 
-void GfxOpenGL::prepareMovieFrame(int width, int height, byte *bitmap) {
-	// remove if already exist
-	if (_smushNumTex > 0) {
-		glDeleteTextures(_smushNumTex, _smushTexIds);
-		delete[] _smushTexIds;
-		_smushNumTex = 0;
-	}
-
-	// create texture
+void GfxOpenGL::createMovieTextures(int width, int height) {
 	_smushNumTex = ((width + (BITMAP_TEXTURE_SIZE - 1)) / BITMAP_TEXTURE_SIZE) *
 		((height + (BITMAP_TEXTURE_SIZE - 1)) / BITMAP_TEXTURE_SIZE);
 	_smushTexIds = new GLuint[_smushNumTex];
@@ -1059,6 +1200,15 @@ void GfxOpenGL::prepareMovieFrame(int width, int height, byte *bitmap) {
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, BITMAP_TEXTURE_SIZE, BITMAP_TEXTURE_SIZE, 0, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, NULL);
 	}
+}
+
+void GfxOpenGL::prepareMovieFrame(int width, int height, byte *bitmap) {
+	// The textures of the previous frame are refilled if the size did not
+	// change, instead of being created again for every frame
+	if (_smushNumTex > 0 && (width != _smushWidth || height != _smushHeight))
+		releaseMovieFrame();
+	if (_smushNumTex == 0)
+		createMovieTextures(width, height);
 
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
 	glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
@@ -79,6 +79,11 @@ public:
 	void drawModelFace(const MeshFace *face, float *vertices, float *vertNormals, float *textureVerts);
 	void drawSprite(const Sprite *sprite);
 
+	void createMesh(Mesh *mesh);
+	void drawMesh(const Mesh *mesh);
+	void drawMeshBatch(const Mesh *mesh, const MeshBatch *batch);
+	void destroyMesh(Mesh *mesh);
+
 	void enableLights();
 	void disableLights();
 	void setupLight(Light *light, int lightId);
@@ -118,7 +123,21 @@ public:
 
 protected:
 	void drawDepthBitmap(int x, int y, int w, int h, char *data);
+	void getModelViewMatrix(float *matrix);
+	void getProjectionMatrix(float *matrix);
+	void getViewport(int *viewport);
+	bool isBoxOccluded(const Graphics::Vector3d &pos, const Graphics::Vector3d &size);
+	bool isWindowRectOccluded(float x1, float y1, float x2, float y2, float z);
+	void startDrawList();
+	void setDrawListMesh(const Mesh *mesh, const float *matrix);
+	void finishDrawList();
+	void drawShadowCasterTriangles(const float *vertices, const uint32 *indices, int numIndices);
 private:
+	void startMeshArrays();
+	void setupMeshArrays(const Mesh *mesh);
+	void finishMeshArrays();
+	void createMovieTextures(int width, int height);
+
 	GLuint _emergFont;
 	int _smushNumTex;
 	GLuint *_smushTexIds;
@@ -127,6 +146,7 @@ private:
 	byte *_storedDisplay;
 	bool _useDepthShader;
 	GLuint _fragmentProgram;
+	bool _useVertexBuffers;
 };
 
 } // end of namespace Grim
@@ -20,11 +20,15 @@
  *
  */
 
+#define FORBIDDEN_SYMBOL_EXCEPTION_printf
+
+#include "common/config-manager.h"
 #include "common/endian.h"
 #include "common/system.h"
 
 #include "engines/grim/actor.h"
 #include "engines/grim/colormap.h"
+#include "engines/grim/debug.h"
 #include "engines/grim/material.h"
 #include "engines/grim/font.h"
 #include "engines/grim/gfx_tinygl.h"
@@ -35,13 +39,17 @@
 #include "engines/grim/model.h"
 #include "engines/grim/scene.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 namespace Grim {
 
 GfxBase *CreateGfxTinyGL() {
 	return new GfxTinyGL();
 }
 
-// below funcs lookAt, transformPoint and tgluProject are from Mesa glu sources
+// below func lookAt is from Mesa glu sources
 static void lookAt(TGLfloat eyex, TGLfloat eyey, TGLfloat eyez, TGLfloat centerx,
 		TGLfloat centery, TGLfloat centerz, TGLfloat upx, TGLfloat upy, TGLfloat upz) {
 	TGLfloat m[16];
@@ -107,55 +115,77 @@ static void lookAt(TGLfloat eyex, TGLfloat eyey, TGLfloat eyez, TGLfloat centerx
 	tglTranslatef(-eyex, -eyey, -eyez);
 }
 
-static void transformPoint(TGLfloat out[4], const TGLfloat m[16], const TGLfloat in[4]) {
-#define M(row,col)  m[col * 4 + row]
-	out[0] = M(0, 0) * in[0] + M(0, 1) * in[1] + M(0, 2) * in[2] + M(0, 3) * in[3];
-	out[1] = M(1, 0) * in[0] + M(1, 1) * in[1] + M(1, 2) * in[2] + M(1, 3) * in[3];
-	out[2] = M(2, 0) * in[0] + M(2, 1) * in[1] + M(2, 2) * in[2] + M(2, 3) * in[3];
-	out[3] = M(3, 0) * in[0] + M(3, 1) * in[1] + M(3, 2) * in[2] + M(3, 3) * in[3];
-#undef M
+// Copies a line of pixels, leaving the destination alone where the source has
+// the 0xf81f color key. SSE2 handles 8 pixels at a time, the scalar loop the rest.
+static void blitTransparentLine(byte *dst, const byte *src, int width) {
+	int r = 0;
+#ifdef __SSE2__
+	const __m128i key = _mm_set1_epi16((short)0xf81f);
+	for (; r + 8 <= width; r += 8) {
+		__m128i pixels = _mm_loadu_si128((const __m128i *)(src + r * 2));
+		__m128i old = _mm_loadu_si128((const __m128i *)(dst + r * 2));
+		__m128i keyed = _mm_cmpeq_epi16(pixels, key);
+		_mm_storeu_si128((__m128i *)(dst + r * 2), _mm_or_si128(_mm_and_si128(keyed, old), _mm_andnot_si128(keyed, pixels)));
+	}
+#endif
+	for (; r < width; r++) {
+		uint16 pixel = READ_UINT16(src + r * 2);
+		if (pixel != 0xf81f)
+			WRITE_UINT16(dst + r * 2, pixel);
+	}
 }
 
-TGLint tgluProject(TGLfloat objx, TGLfloat objy, TGLfloat objz, const TGLfloat model[16], const TGLfloat proj[16],
-		const TGLint viewport[4], TGLfloat *winx, TGLfloat *winy, TGLfloat *winz) {
-	TGLfloat in[4], out[4];
-
-	in[0] = objx;
-	in[1] = objy;
-	in[2] = objz;
-	in[3] = 1.0f;
-	transformPoint(out, model, in);
-	transformPoint(in, proj, out);
-
-	if (in[3] == 0.0)
-		return TGL_FALSE;
-
-	in[0] /= in[3];
-	in[1] /= in[3];
-	in[2] /= in[3];
-
-	*winx = viewport[0] + (1 + in[0]) * viewport[2] / 2;
-	*winy = viewport[1] + (1 + in[1]) * viewport[3] / 2;
-	*winz = (1 + in[2]) / 2;
-
-	return TGL_TRUE;
+// Rounds up v * num / den, for mapping game coordinates to screen pixels.
+static int scaleCeil(int v, int num, int den) {
+	if (v <= 0)
+		return -((-v * num) / den);
+	return (v * num + den - 1) / den;
 }
 
 GfxTinyGL::GfxTinyGL() {
 	g_driver = this;
 	_zb = NULL;
 	_storedDisplay = NULL;
+	_logicalX = NULL;
+	_logicalY = NULL;
+	_backgroundColor = NULL;
+	_backgroundDepth = NULL;
+	_occlusionCulling = false;
+	_backgroundPending = false;
+	_backgroundValid = false;
 }
 
 GfxTinyGL::~GfxTinyGL() {
 	delete[] _storedDisplay;
+	delete[] _logicalX;
+	delete[] _logicalY;
+	delete[] _backgroundColor;
+	delete[] _backgroundDepth;
 	if (_zb) {
+		int tiles = tglGetTileCount();
+		if (tiles > 1 && (gDebugLevel == DEBUG_NORMAL || gDebugLevel == DEBUG_ALL)) {
+			for (int i = 0; i < tiles; i++) {
+				int triangles, workerFlushes;
+				unsigned int millis;
+				tglGetTileStats(i, &triangles, &millis, &workerFlushes);
+				printf("TinyGL tile %d: %d triangles, %u ms, %d flushes drawn by the timer worker\n",
+					   i, triangles, millis, workerFlushes);
+			}
+		}
 		TinyGL::glClose();
 		ZB_close(_zb);
 	}
 }
 
 byte *GfxTinyGL::setupScreen(int screenW, int screenH, bool fullscreen) {
+	// TinyGL wants the line size to be a multiple of 4 bytes
+	screenW &= ~3;
+	if (screenW < 4 || screenH < 1) {
+		warning("Invalid software renderer resolution %dx%d, using %dx%d", screenW, screenH, kLogicalWidth, kLogicalHeight);
+		screenW = kLogicalWidth;
+		screenH = kLogicalHeight;
+	}
+
 	byte *buffer = g_system->setupScreen(screenW, screenH, fullscreen, false);
 
 	_screenWidth = screenW;
@@ -169,9 +199,22 @@ byte *GfxTinyGL::setupScreen(int screenW, int screenH, bool fullscreen) {
 
 	_zb = TinyGL::ZB_open(screenW, screenH, ZB_MODE_5R6G5B, buffer);
 	TinyGL::glInit(_zb);
+	TinyGL::ZB_enableDirtyBlocks(_zb, 1);
+	tglSetTileCount(ConfMan.getInt("soft_tiles"));
+	_occlusionCulling = ConfMan.getBool("soft_occlusion");
+
+	_storedDisplay = new byte[_screenWidth * _screenHeight * 2];
+	memset(_storedDisplay, 0, _screenWidth * _screenHeight * 2);
+
+	_backgroundColor = new byte[_screenWidth * _screenHeight * 2];
+	_backgroundDepth = new byte[_screenWidth * _screenHeight * 2];
 
-	_storedDisplay = new byte[640 * 480 * 2];
-	memset(_storedDisplay, 0, 640 * 480 * 2);
+	_logicalX = new int[_screenWidth];
+	for (int x = 0; x < _screenWidth; x++)
+		_logicalX[x] = x * kLogicalWidth / _screenWidth;
+	_logicalY = new int[_screenHeight];
+	for (int y = 0; y < _screenHeight; y++)
+		_logicalY[y] = y * kLogicalHeight / _screenHeight;
 
 	_currentShadowArray = NULL;
 
@@ -208,12 +251,75 @@ void GfxTinyGL::positionCamera(Graphics::Vector3d pos, Graphics::Vector3d intere
 }
 
 void GfxTinyGL::clearScreen() {
-	memset(_zb->pbuf, 0, 640 * 480 * 2);
-	memset(_zb->zbuf, 0, 640 * 480 * 2);
-	memset(_zb->zbuf2, 0, 640 * 480 * 4);
+	// The clear is deferred until the bitmaps drawn next are known,
+	// see drawPendingBackground()
+	_backgroundPending = true;
+	_backgroundBlits.clear();
+}
+
+void GfxTinyGL::prepareDraw() {
+	drawPendingBackground();
+	tglFlushTiles();
+}
+
+void GfxTinyGL::drawPendingBackground() {
+	if (!_backgroundPending)
+		return;
+	_backgroundPending = false;
+
+	if (_backgroundValid && _backgroundBlits == _cachedBackgroundBlits) {
+		restoreDirtyBlocks();
+	} else {
+		memset(_zb->pbuf, 0, _screenWidth * _screenHeight * 2);
+		memset(_zb->zbuf, 0, _screenWidth * _screenHeight * 2);
+		memset(_zb->zbuf2, 0, _screenWidth * _screenHeight * 4);
+		for (uint i = 0; i < _backgroundBlits.size(); i++) {
+			const BackgroundBlit &b = _backgroundBlits[i];
+			blit(b._depth ? (byte *)_zb->zbuf : (byte *)_zb->pbuf, (const byte *)b._data,
+				b._x, b._y, b._width, b._height, !b._depth);
+		}
+		memcpy(_backgroundColor, _zb->pbuf, _screenWidth * _screenHeight * 2);
+		memcpy(_backgroundDepth, _zb->zbuf, _screenWidth * _screenHeight * 2);
+		_cachedBackgroundBlits = _backgroundBlits;
+		_backgroundValid = true;
+	}
+
+	// From now on the dirty blocks are the ones that differ from the cached background
+	memset(_zb->dirty_blocks, 0, _zb->dirty_blocks_width * _zb->dirty_blocks_height);
+}
+
+// Copies the cached background over the dirty blocks, merging dirty
+// blocks next to each other on a row into one rectangle.
+void GfxTinyGL::restoreDirtyBlocks() {
+	const int blockSize = 1 << ZB_DIRTY_BLOCK_BITS;
+	const unsigned char *dirty = _zb->dirty_blocks;
+
+	for (int by = 0; by < _zb->dirty_blocks_height; by++, dirty += _zb->dirty_blocks_width) {
+		int bx = 0;
+		while (bx < _zb->dirty_blocks_width) {
+			if (!dirty[bx]) {
+				bx++;
+				continue;
+			}
+			int first = bx;
+			while (bx < _zb->dirty_blocks_width && dirty[bx])
+				bx++;
+
+			int x = first * blockSize;
+			int width = MIN(bx * blockSize, _screenWidth) - x;
+			int y2 = MIN((by + 1) * blockSize, _screenHeight);
+			for (int y = by * blockSize; y < y2; y++) {
+				int offset = y * _screenWidth + x;
+				memcpy(_zb->pbuf + offset, _backgroundColor + offset * 2, width * 2);
+				memcpy(_zb->zbuf + offset, _backgroundDepth + offset * 2, width * 2);
+				memset(_zb->zbuf2 + offset, 0, width * 4);
+			}
+		}
+	}
 }
 
 void GfxTinyGL::flipBuffer() {
+	prepareDraw();
 	g_system->updateScreen();
 }
 
@@ -279,40 +385,12 @@ void GfxTinyGL::getBoundingBoxPos(const Mesh *model, int *x1, int *y1, int *x2,
 		return;
 	}
 
-	TGLfloat top = 1000;
-	TGLfloat right = -1000;
-	TGLfloat left = 1000;
-	TGLfloat bottom = -1000;
-	TGLfloat winX, winY, winZ;
-
-	for (int i = 0; i < model->_numFaces; i++) {
-		Graphics::Vector3d v;
-		float* pVertices;
-
-		for (int j = 0; j < model->_faces[i]._numVertices; j++) {
-			TGLfloat modelView[16], projection[16];
-			TGLint viewPort[4];
-
-			tglGetFloatv(TGL_MODELVIEW_MATRIX, modelView);
-			tglGetFloatv(TGL_PROJECTION_MATRIX, projection);
-			tglGetIntegerv(TGL_VIEWPORT, viewPort);
-
-			pVertices = model->_vertices + 3 * model->_faces[i]._vertices[j];
-
-			v.set(*(pVertices), *(pVertices + 1), *(pVertices + 2));
-
-			tgluProject(v.x(), v.y(), v.z(), modelView, projection, viewPort, &winX, &winY, &winZ);
-
-			if (winX > right)
-				right = winX;
-			if (winX < left)
-				left = winX;
-			if (winY < top)
-				top = winY;
-			if (winY > bottom)
-				bottom = winY;
-		}
-	}
+	// Back to the 640x480 coordinates the engine works with
+	const ProjectedMesh *projected = projectMesh(model);
+	TGLfloat left = projected->_x1 * kLogicalWidth / _screenWidth;
+	TGLfloat right = projected->_x2 * kLogicalWidth / _screenWidth;
+	TGLfloat top = projected->_y1 * kLogicalHeight / _screenHeight;
+	TGLfloat bottom = projected->_y2 * kLogicalHeight / _screenHeight;
 
 	float t = bottom;
 	bottom = 480 - top;
@@ -357,15 +435,13 @@ void GfxTinyGL::getBoundingBoxPos(const Mesh *model, int *x1, int *y1, int *x2,
 }
 
 void GfxTinyGL::startActorDraw(Graphics::Vector3d pos, float scale, float yaw, float pitch, float roll) {
+	drawPendingBackground();
 	tglEnable(TGL_TEXTURE_2D);
 	tglMatrixMode(TGL_MODELVIEW);
 	tglPushMatrix();
 	if (_currentShadowArray) {
 		// TODO find out why shadowMask at device in woods is null
-		if (!_currentShadowArray->shadowMask) {
-			_currentShadowArray->shadowMask = new byte[_screenWidth * _screenHeight];
-			_currentShadowArray->shadowMaskSize = _screenWidth * _screenHeight;
-		}
+		allocShadowMask(_currentShadowArray);
 		assert(_currentShadowArray->shadowMask);
 		//tglSetShadowColor(255, 255, 255);
 		tglSetShadowColor(_shadowColorR, _shadowColorG, _shadowColorB);
@@ -380,9 +456,11 @@ void GfxTinyGL::startActorDraw(Graphics::Vector3d pos, float scale, float yaw, f
 	tglRotatef(yaw, 0, 0, 1);
 	tglRotatef(pitch, 1, 0, 0);
 	tglRotatef(roll, 0, 1, 0);
+	startTrackingModelView();
 }
 
 void GfxTinyGL::finishActorDraw() {
+	finishTrackingModelView();
 	tglMatrixMode(TGL_MODELVIEW);
 	tglPopMatrix();
 	tglDisable(TGL_TEXTURE_2D);
@@ -407,12 +485,22 @@ void GfxTinyGL::finishActorDraw() {
 	}*/
 }
 
+void GfxTinyGL::allocShadowMask(Shadow *shadow) {
+	// The mask may come from a savegame made at another resolution
+	if (shadow->shadowMask && shadow->shadowMaskSize == _screenWidth * _screenHeight)
+		return;
+	// binned triangles may still use the old mask
+	tglFlushTiles();
+	delete[] shadow->shadowMask;
+	shadow->shadowMask = new byte[_screenWidth * _screenHeight];
+	shadow->shadowMaskSize = _screenWidth * _screenHeight;
+	memset(shadow->shadowMask, 0, shadow->shadowMaskSize);
+}
+
 void GfxTinyGL::drawShadowPlanes() {
+	prepareDraw();
 	tglEnable(TGL_SHADOW_MASK_MODE);
-	if (!_currentShadowArray->shadowMask) {
-		_currentShadowArray->shadowMask = new byte[_screenWidth * _screenHeight];
-		_currentShadowArray->shadowMaskSize = _screenWidth * _screenHeight;
-	}
+	allocShadowMask(_currentShadowArray);
 	memset(_currentShadowArray->shadowMask, 0, _screenWidth * _screenHeight);
 
 	tglSetShadowMaskBuf(_currentShadowArray->shadowMask);
@@ -446,7 +534,7 @@ void GfxTinyGL::setShadow(Shadow *shadow) {
 	_currentShadowArray = shadow;
 	if (shadow)
 		tglDisable(TGL_LIGHTING);
-	else
+	else if (_lightsEnabled)
 		tglEnable(TGL_LIGHTING);
 }
 
@@ -476,7 +564,131 @@ void GfxTinyGL::drawModelFace(const MeshFace *face, float *vertices, float *vert
 	tglEnd();
 }
 
+void GfxTinyGL::createMesh(Mesh *mesh) {
+}
+
+void GfxTinyGL::drawMesh(const Mesh *mesh) {
+	drawMeshBatches(mesh);
+}
+
+void GfxTinyGL::drawMeshBatch(const Mesh *mesh, const MeshBatch *batch) {
+	const uint32 *indices = mesh->_batchIndices + batch->_firstIndex;
+	tglBegin(TGL_TRIANGLES);
+	for (int i = 0; i < batch->_numIndices; i++) {
+		float *vertex = mesh->_batchVertices + 8 * indices[i];
+		tglNormal3fv(vertex + 3);
+		tglTexCoord2fv(vertex + 6);
+		tglVertex3fv(vertex);
+	}
+	tglEnd();
+}
+
+void GfxTinyGL::getModelViewMatrix(float *matrix) {
+	tglGetFloatv(TGL_MODELVIEW_MATRIX, matrix);
+}
+
+void GfxTinyGL::getProjectionMatrix(float *matrix) {
+	tglGetFloatv(TGL_PROJECTION_MATRIX, matrix);
+}
+
+void GfxTinyGL::getViewport(int *viewport) {
+	tglGetIntegerv(TGL_VIEWPORT, viewport);
+}
+
+bool GfxTinyGL::isBoxOccluded(const Graphics::Vector3d &pos, const Graphics::Vector3d &size) {
+	if (!_occlusionCulling)
+		return false;
+
+	float m[16];
+	getModelViewProjectionMatrix(m);
+
+	// Find the window rectangle of the box and the depth of its nearest point
+	float x1 = _screenWidth, x2 = -1, y1 = _screenHeight, y2 = -1, z1 = 1;
+	for (int i = 0; i < 8; i++) {
+		float x = pos.x() + ((i & 1) ? size.x() : 0);
+		float y = pos.y() + ((i & 2) ? size.y() : 0);
+		float z = pos.z() + ((i & 4) ? size.z() : 0);
+		float w = m[3] * x + m[7] * y + m[11] * z + m[15];
+		// Crossing the eye plane, don't bother
+		if (w <= 0)
+			return false;
+		float sx = (m[0] * x + m[4] * y + m[8] * z + m[12]) / w;
+		float sy = (m[1] * x + m[5] * y + m[9] * z + m[13]) / w;
+		float sz = (m[2] * x + m[6] * y + m[10] * z + m[14]) / w;
+		sx = (sx + 1) * _screenWidth / 2;
+		sy = (sy + 1) * _screenHeight / 2;
+		sz = (sz + 1) / 2;
+		x1 = MIN(x1, sx);
+		x2 = MAX(x2, sx);
+		y1 = MIN(y1, sy);
+		y2 = MAX(y2, sy);
+		z1 = MIN(z1, sz);
+	}
+
+	return isWindowRectOccluded(x1, y1, x2, y2, z1);
+}
+
+bool GfxTinyGL::isWindowRectOccluded(float x1, float y1, float x2, float y2, float z) {
+	if (!_occlusionCulling)
+		return false;
+
+	// The z-bitmaps of the set must be in the depth buffer
+	drawPendingBackground();
+
+	// The buffers go down the screen, and in the units of the depth
+	// buffer bigger is nearer
+	int left = MAX((int)x1, 0);
+	int right = MIN((int)x2 + 1, _screenWidth - 1);
+	int top = MAX((int)(_screenHeight - y2), 0);
+	int bottom = MIN((int)(_screenHeight - y1) + 1, _screenHeight - 1);
+	float nearest = (1 - z) * (1 << 16);
+	if (left > right || top > bottom || nearest >= 0xffff)
+		return false;
+
+	// Occluded only if every pixel under it is strictly nearer
+	unsigned int depth = (unsigned int)nearest + 1;
+	for (int y = top; y <= bottom; y++) {
+		const uint16 *zbuf = _zb->zbuf + y * _screenWidth;
+		for (int x = left; x <= right; x++) {
+			if (zbuf[x] <= depth)
+				return false;
+		}
+	}
+	return true;
+}
+
+void GfxTinyGL::startDrawList() {
+	drawPendingBackground();
+	tglMatrixMode(TGL_MODELVIEW);
+	tglPushMatrix();
+	tglEnable(TGL_TEXTURE_2D);
+}
+
+void GfxTinyGL::setDrawListMesh(const Mesh *mesh, const float *matrix) {
+	tglMatrixMode(TGL_MODELVIEW);
+	tglLoadMatrixf(matrix);
+}
+
+void GfxTinyGL::finishDrawList() {
+	tglDisable(TGL_TEXTURE_2D);
+	tglMatrixMode(TGL_MODELVIEW);
+	tglPopMatrix();
+}
+
+void GfxTinyGL::drawShadowCasterTriangles(const float *vertices, const uint32 *indices, int numIndices) {
+	tglBegin(TGL_TRIANGLES);
+	for (int i = 0; i < numIndices; i++) {
+		const float *vertex = vertices + 3 * indices[i];
+		tglVertex3f(vertex[0], vertex[1], vertex[2]);
+	}
+	tglEnd();
+}
+
+void GfxTinyGL::destroyMesh(Mesh *mesh) {
+}
+
 void GfxTinyGL::drawSprite(const Sprite *sprite) {
+	drawPendingBackground();
 	tglMatrixMode(TGL_TEXTURE);
 	tglLoadIdentity();
 	tglMatrixMode(TGL_MODELVIEW);
@@ -523,10 +735,12 @@ void GfxTinyGL::translateViewpointStart(Graphics::Vector3d pos, float pitch, flo
 	tglRotatef(yaw, 0, 0, 1);
 	tglRotatef(pitch, 1, 0, 0);
 	tglRotatef(roll, 0, 1, 0);
+	pushModelView(pos, pitch, yaw, roll);
 }
 
 void GfxTinyGL::translateViewpointFinish() {
 	tglPopMatrix();
+	popModelView();
 }
 
 void GfxTinyGL::drawHierachyNode(const ModelNode *node, int *x1, int *y1, int *x2, int *y2) {
@@ -538,6 +752,7 @@ void GfxTinyGL::drawHierachyNode(const ModelNode *node, int *x1, int *y1, int *x
 	if (node->_hierVisible) {
 		tglPushMatrix();
 		tglTranslatef(node->_pivot.x(), node->_pivot.y(), node->_pivot.z());
+		pushModelView(node->_pivot, 0, 0, 0);
 
 		if (!_currentShadowArray) {
 			Sprite* sprite = node->_sprite;
@@ -553,6 +768,7 @@ void GfxTinyGL::drawHierachyNode(const ModelNode *node, int *x1, int *y1, int *x
 
 		tglMatrixMode(TGL_MODELVIEW);
 		tglPopMatrix();
+		popModelView();
 
 		if (node->_child) {
 			node->_child->draw(x1, y1, x2, y2);
@@ -567,15 +783,18 @@ void GfxTinyGL::drawHierachyNode(const ModelNode *node, int *x1, int *y1, int *x
 
 void GfxTinyGL::enableLights() {
 	tglEnable(TGL_LIGHTING);
+	_lightsEnabled = true;
 }
 
 void GfxTinyGL::disableLights() {
 	tglDisable(TGL_LIGHTING);
+	_lightsEnabled = false;
 }
 
 void GfxTinyGL::setupLight(Light *light, int lightId) {
 	assert(lightId < T_MAX_LIGHTS);
 	tglEnable(TGL_LIGHTING);
+	_lightsEnabled = true;
 	float lightColor[] = { 0.0f, 0.0f, 0.0f, 1.0f };
 	float lightPos[] = { 0.0f, 0.0f, 0.0f, 1.0f };
 	float lightDir[] = { 0.0f, 0.0f, -1.0f };
@@ -635,55 +854,51 @@ void GfxTinyGL::createBitmap(BitmapData *bitmap) {
 	}
 }
 
-void TinyGLBlit(byte *dst, byte *src, int x, int y, int width, int height, bool trans) {
-	int srcPitch = width * 2;
-	int dstPitch = 640 * 2;
-	int srcX, srcY;
-	int l, r;
-
-	if (x > 639 || y > 479)
+void GfxTinyGL::blit(byte *dst, const byte *src, int x, int y, int width, int height, bool trans) {
+	// The destination rectangle, in screen pixels
+	int x1 = MAX(scaleCeil(x, _screenWidth, kLogicalWidth), 0);
+	int x2 = MIN(scaleCeil(x + width, _screenWidth, kLogicalWidth), _screenWidth);
+	int y1 = MAX(scaleCeil(y, _screenHeight, kLogicalHeight), 0);
+	int y2 = MIN(scaleCeil(y + height, _screenHeight, kLogicalHeight), _screenHeight);
+	if (x1 >= x2 || y1 >= y2)
 		return;
 
-	if (x < 0) {
-		srcX = -x;
-		x = 0;
-	} else {
-		srcX = 0;
-	}
-	if (y < 0) {
-		srcY = -y;
-		y = 0;
-	} else {
-		srcY = 0;
-	}
-
-	if (x + width > 640)
-		width -= (x + width) - 640;
-
-	if (y + height > 480)
-		height -= (y + height) - 480;
+	int srcPitch = width * 2;
+	int dstPitch = _screenWidth * 2;
+	int l, r;
 
-	dst += (x + (y * 640)) * 2;
-	src += (srcX + (srcY * width)) * 2;
+	markDirty(x1, y1, x2 - 1, y2 - 1);
+	dst += (x1 + (y1 * _screenWidth)) * 2;
 
-	int copyWidth = width * 2;
+	if (_screenWidth == kLogicalWidth && _screenHeight == kLogicalHeight) {
+		src += ((x1 - x) + ((y1 - y) * width)) * 2;
+		int copyWidth = (x2 - x1) * 2;
 
-	if (!trans) {
-		for (l = 0; l < height; l++) {
-			memcpy(dst, src, copyWidth);
-			dst += dstPitch;
-			src += srcPitch;
-		}
-	} else {
-		for (l = 0; l < height; l++) {
-			for (r = 0; r < copyWidth; r += 2) {
-				uint16 pixel = READ_UINT16(src + r);
-				if (pixel != 0xf81f)
-					WRITE_UINT16(dst + r, pixel);
+		if (!trans) {
+			for (l = y1; l < y2; l++) {
+				memcpy(dst, src, copyWidth);
+				dst += dstPitch;
+				src += srcPitch;
 			}
-			dst += dstPitch;
-			src += srcPitch;
+		} else {
+			for (l = y1; l < y2; l++) {
+				blitTransparentLine(dst, src, x2 - x1);
+				dst += dstPitch;
+				src += srcPitch;
+			}
+		}
+		return;
+	}
+
+	// Scaled, take the nearest source pixel
+	for (l = y1; l < y2; l++) {
+		const byte *srcLine = src + (_logicalY[l] - y) * srcPitch;
+		for (r = x1; r < x2; r++) {
+			uint16 pixel = READ_UINT16(srcLine + (_logicalX[r] - x) * 2);
+			if (!trans || pixel != 0xf81f)
+				WRITE_UINT16(dst + (r - x1) * 2, pixel);
 		}
+		dst += dstPitch;
 	}
 }
 
@@ -694,15 +909,31 @@ void GfxTinyGL::drawBitmap(const Bitmap *bitmap) {
 	}
 
 	assert(bitmap->getCurrentImage() > 0);
+	if (_backgroundPending) {
+		BackgroundBlit b;
+		b._data = bitmap->getData(bitmap->getCurrentImage() - 1);
+		b._x = bitmap->getX();
+		b._y = bitmap->getY();
+		b._width = bitmap->getWidth();
+		b._height = bitmap->getHeight();
+		b._depth = format != 1;
+		_backgroundBlits.push_back(b);
+		return;
+	}
+
+	prepareDraw();
 	if (bitmap->getFormat() == 1)
-		TinyGLBlit((byte *)_zb->pbuf, (byte *)bitmap->getData(bitmap->getCurrentImage() - 1),
+		blit((byte *)_zb->pbuf, (const byte *)bitmap->getData(bitmap->getCurrentImage() - 1),
 			bitmap->getX(), bitmap->getY(), bitmap->getWidth(), bitmap->getHeight(), true);
 	else
-		TinyGLBlit((byte *)_zb->zbuf, (byte *)bitmap->getData(bitmap->getCurrentImage() - 1),
+		blit((byte *)_zb->zbuf, (const byte *)bitmap->getData(bitmap->getCurrentImage() - 1),
 			bitmap->getX(), bitmap->getY(), bitmap->getWidth(), bitmap->getHeight(), false);
 }
 
-void GfxTinyGL::destroyBitmap(BitmapData *) { }
+void GfxTinyGL::destroyBitmap(BitmapData *) {
+	// The data may be reused by a new bitmap at the same address
+	_backgroundValid = false;
+}
 
 void GfxTinyGL::createFont(Font *font) {
 }
@@ -787,11 +1018,12 @@ void GfxTinyGL::createTextObject(TextObject *text) {
 }
 
 void GfxTinyGL::drawTextObject(TextObject *text) {
+	prepareDraw();
 	TextObjectData *userData = (TextObjectData *)text->getUserData();
 	if (userData) {
 		int numLines = text->getNumLines();
 		for (int i = 0; i < numLines; ++i) {
-			TinyGLBlit((byte *)_zb->pbuf, userData[i].data, userData[i].x, userData[i].y, userData[i].width, userData[i].height, true);
+			blit((byte *)_zb->pbuf, userData[i].data, userData[i].x, userData[i].y, userData[i].width, userData[i].height, true);
 		}
 	}
 
@@ -811,7 +1043,38 @@ void GfxTinyGL::destroyTextObject(TextObject *text) {
 void GfxTinyGL::createMaterial(Texture *material, const char *data, const CMap *cmap) {
 	material->_texture = new TGLuint[1];
 	tglGenTextures(1, (TGLuint *)material->_texture);
-	char *texdata = new char[material->_width * material->_height * 4];
+	TGLuint *textures = (TGLuint *)material->_texture;
+	tglBindTexture(TGL_TEXTURE_2D, textures[0]);
+	tglTexParameteri(TGL_TEXTURE_2D, TGL_TEXTURE_WRAP_S, TGL_REPEAT);
+	tglTexParameteri(TGL_TEXTURE_2D, TGL_TEXTURE_WRAP_T, TGL_REPEAT);
+	tglTexParameteri(TGL_TEXTURE_2D, TGL_TEXTURE_MAG_FILTER, TGL_LINEAR);
+	tglTexParameteri(TGL_TEXTURE_2D, TGL_TEXTURE_MIN_FILTER, TGL_LINEAR_MIPMAP_NEAREST);
+	tglTexParameteri(TGL_TEXTURE_2D, TGL_GENERATE_MIPMAP, TGL_TRUE);
+
+	int numPixels = material->_width * material->_height;
+	bool powerOfTwo = !(material->_width & (material->_width - 1)) && !(material->_height & (material->_height - 1));
+	bool transparent = false;
+	if (material->_hasAlpha) {
+		for (int i = 0; i < numPixels && !transparent; i++)
+			transparent = data[i] == 0;
+	}
+
+	// Opaque textures are converted straight to 16 bit, TinyGL only needs
+	// RGBA for the transparency and to resample odd sizes
+	if (!transparent && powerOfTwo) {
+		uint16 *texdata = new uint16[numPixels];
+		for (int i = 0; i < numPixels; i++) {
+			const byte *color = (const byte *)cmap->_colors + 3 * (uint8)data[i];
+			texdata[i] = ((color[0] & 0xF8) << 8) | ((color[1] & 0xFC) << 3) | (color[2] >> 3);
+			if (data[i] == 0)
+				texdata[i] = 0;
+		}
+		tglTexImage2D(TGL_TEXTURE_2D, 0, 3, material->_width, material->_height, 0, TGL_RGB, TGL_UNSIGNED_SHORT_5_6_5, texdata);
+		delete[] texdata;
+		return;
+	}
+
+	char *texdata = new char[numPixels * 4];
 	char *texdatapos = texdata;
 	for (int y = 0; y < material->_height; y++) {
 		for (int x = 0; x < material->_width; x++) {
@@ -829,12 +1092,6 @@ void GfxTinyGL::createMaterial(Texture *material, const char *data, const CMap *
 			data++;
 		}
 	}
-	TGLuint *textures = (TGLuint *)material->_texture;
-	tglBindTexture(TGL_TEXTURE_2D, textures[0]);
-	tglTexParameteri(TGL_TEXTURE_2D, TGL_TEXTURE_WRAP_S, TGL_REPEAT);
-	tglTexParameteri(TGL_TEXTURE_2D, TGL_TEXTURE_WRAP_T, TGL_REPEAT);
-	tglTexParameteri(TGL_TEXTURE_2D, TGL_TEXTURE_MAG_FILTER, TGL_LINEAR);
-	tglTexParameteri(TGL_TEXTURE_2D, TGL_TEXTURE_MIN_FILTER, TGL_LINEAR);
 	tglTexImage2D(TGL_TEXTURE_2D, 0, 3, material->_width, material->_height, 0, TGL_RGBA, TGL_UNSIGNED_BYTE, texdata);
 	delete[] texdata;
 }
@@ -862,10 +1119,14 @@ void GfxTinyGL::prepareMovieFrame(int width, int height, byte *bitmap) {
 }
 
 void GfxTinyGL::drawMovieFrame(int offsetX, int offsetY) {
-	if (_smushWidth == 640 && _smushHeight == 480) {
-		memcpy(_zb->pbuf, _smushBitmap, 640 * 480 * 2);
+	prepareDraw();
+	// pbuf is the backend's screen surface, so this copy is what puts the
+	// frame on screen. The frame itself is never copied before this point.
+	if (_smushWidth == _screenWidth && _smushHeight == _screenHeight) {
+		memcpy(_zb->pbuf, _smushBitmap, _screenWidth * _screenHeight * 2);
+		markDirty(0, 0, _screenWidth - 1, _screenHeight - 1);
 	} else {
-		TinyGLBlit((byte *)_zb->pbuf, _smushBitmap, offsetX, offsetY, _smushWidth, _smushHeight, false);
+		blit((byte *)_zb->pbuf, _smushBitmap, offsetX, offsetY, _smushWidth, _smushHeight, false);
 	}
 }
 
@@ -876,21 +1137,26 @@ void GfxTinyGL::loadEmergFont() {
 }
 
 void GfxTinyGL::drawEmergString(int x, int y, const char *text, const Color &fgColor) {
+	prepareDraw();
 	uint16 color = ((fgColor.getRed() & 0xF8) << 8) | ((fgColor.getGreen() & 0xFC) << 3) | (fgColor.getBlue() >> 3);
 
+	// Only the position is scaled, the glyphs are drawn at their native size
+	x = screenX(x);
+	y = screenY(y);
+	markDirty(x, y, x + 10 * (int)strlen(text), y + 12);
 	for (int l = 0; l < (int)strlen(text); l++) {
 		int c = text[l];
 		assert(c >= 32 && c <= 127);
 		const uint8 *ptr = Font::emerFont[c - 32];
 		for (int py = 0; py < 13; py++) {
-			if ((py + y) < 480 && (py + y) >= 0) {
+			if ((py + y) < _screenHeight && (py + y) >= 0) {
 				int line = ptr[12 - py];
 				for (int px = 0; px < 8; px++) {
-					if ((px + x) < 640 && (px + x) >= 0) {
+					if ((px + x) < _screenWidth && (px + x) >= 0) {
 						int pixel = line & 0x80;
 						line <<= 1;
 						if (pixel)
-							WRITE_UINT16(_zb->pbuf + ((py + y) * 640) + (px + x), color);
+							WRITE_UINT16(_zb->pbuf + ((py + y) * _screenWidth) + (px + x), color);
 					}
 				}
 			}
@@ -905,9 +1171,9 @@ Bitmap *GfxTinyGL::getScreenshot(int w, int h) {
 	assert(buffer);
 
 	int step = 0;
-	for (int y = 0; y <= 479; y++) {
-		for (int x = 0; x <= 639; x++) {
-			uint16 pixel = *(src + y * 640 + x);
+	for (int y = 0; y < _screenHeight; y++) {
+		for (int x = 0; x < _screenWidth; x++) {
+			uint16 pixel = *(src + y * _screenWidth + x);
 			uint8 r = (pixel & 0xF800) >> 8;
 			uint8 g = (pixel & 0x07E0) >> 3;
 			uint8 b = (pixel & 0x001F) << 3;
@@ -916,12 +1182,12 @@ Bitmap *GfxTinyGL::getScreenshot(int w, int h) {
 		}
 	}
 
-	float step_x = 640.0f / w;
-	float step_y = 480.0f / h;
+	float step_x = (float)_screenWidth / w;
+	float step_y = (float)_screenHeight / h;
 	step = 0;
-	for (float y = 0; y < 479; y += step_y) {
-		for (float x = 0; x < 639; x += step_x) {
-			uint16 pixel = *(src + (int)y * 640 + (int)x);
+	for (float y = 0; y < _screenHeight - 1; y += step_y) {
+		for (float x = 0; x < _screenWidth - 1; x += step_x) {
+			uint16 pixel = *(src + (int)y * _screenWidth + (int)x);
 			buffer[step++] = pixel;
 		}
 	}
@@ -932,16 +1198,19 @@ Bitmap *GfxTinyGL::getScreenshot(int w, int h) {
 }
 
 void GfxTinyGL::storeDisplay() {
-	memcpy(_storedDisplay, _zb->pbuf, 640 * 480 * 2);
+	prepareDraw();
+	memcpy(_storedDisplay, _zb->pbuf, _screenWidth * _screenHeight * 2);
 }
 
 void GfxTinyGL::copyStoredToDisplay() {
-	memcpy(_zb->pbuf, _storedDisplay, 640 * 480 * 2);
+	prepareDraw();
+	memcpy(_zb->pbuf, _storedDisplay, _screenWidth * _screenHeight * 2);
+	markDirty(0, 0, _screenWidth - 1, _screenHeight - 1);
 }
 
 void GfxTinyGL::dimScreen() {
 	uint16 *data = (uint16 *)_storedDisplay;
-	for (int l = 0; l < 640 * 480; l++) {
+	for (int l = 0; l < _screenWidth * _screenHeight; l++) {
 		uint16 pixel = data[l];
 		uint8 r = (pixel & 0xF800) >> 8;
 		uint8 g = (pixel & 0x07E0) >> 3;
@@ -952,107 +1221,128 @@ void GfxTinyGL::dimScreen() {
 }
 
 void GfxTinyGL::dimRegion(int x, int y, int w, int h, float level) {
+	prepareDraw();
 	uint16 *data = (uint16 *)_zb->pbuf;
-	for (int ly = y; ly < y + h; ly++) {
-		for (int lx = x; lx < x + w; lx++) {
-			uint16 pixel = data[ly * 640 + lx];
+	int x1 = MAX(screenX(x), 0);
+	int y1 = MAX(screenY(y), 0);
+	int x2 = MIN(screenX(x + w), _screenWidth);
+	int y2 = MIN(screenY(y + h), _screenHeight);
+	markDirty(x1, y1, x2 - 1, y2 - 1);
+	for (int ly = y1; ly < y2; ly++) {
+		for (int lx = x1; lx < x2; lx++) {
+			uint16 pixel = data[ly * _screenWidth + lx];
 			uint8 r = (pixel & 0xF800) >> 8;
 			uint8 g = (pixel & 0x07E0) >> 3;
 			uint8 b = (pixel & 0x001F) << 3;
 			uint16 color = (uint16)(((r + g + b) / 3) * level);
-			data[ly * 640 + lx] = ((color & 0xF8) << 8) | ((color & 0xFC) << 3) | (color >> 3);
+			data[ly * _screenWidth + lx] = ((color & 0xF8) << 8) | ((color & 0xFC) << 3) | (color >> 3);
 		}
 	}
 }
 
 void GfxTinyGL::irisAroundRegion(int x1, int y1, int x2, int y2) {
+	prepareDraw();
 	uint16 *data = (uint16 *)_zb->pbuf;
+	x1 = screenX(x1);
+	y1 = screenY(y1);
+	x2 = screenX(x2);
+	y2 = screenY(y2);
+	markDirty(0, 0, _screenWidth - 1, _screenHeight - 1);
 	for (int ly = 0; ly < _screenHeight; ly++) {
 		for (int lx = 0; lx < _screenWidth; lx++) {
 			// Don't do anything with the data in the region we draw Around
 			if(lx > x1 && lx < x2 && ly > y1 && ly < y2)
 				continue;
 			// But set everything around it to black.
-			data[ly * 640 + lx] = (uint16)0.0f;
+			data[ly * _screenWidth + lx] = (uint16)0.0f;
 		}
 	}
 }
 
 void GfxTinyGL::drawRectangle(PrimitiveObject *primitive) {
+	prepareDraw();
 	uint16 *dst = (uint16 *)_zb->pbuf;
-	int x1 = primitive->getP1().x;
-	int y1 = primitive->getP1().y;
-	int x2 = primitive->getP2().x;
-	int y2 = primitive->getP2().y;
+	int x1 = screenX(primitive->getP1().x);
+	int y1 = screenY(primitive->getP1().y);
+	int x2 = screenX(primitive->getP2().x);
+	int y2 = screenY(primitive->getP2().y);
+	markDirty(x1, y1, x2, y2);
 
 	const Color &color = *primitive->getColor();
 	uint16 c = ((color.getRed() & 0xF8) << 8) | ((color.getGreen() & 0xFC) << 3) | (color.getBlue() >> 3);
 
 	if (primitive->isFilled()) {
 		for (; y1 <= y2; y1++)
-			if (y1 >= 0 && y1 < 480)
+			if (y1 >= 0 && y1 < _screenHeight)
 				for (int x = x1; x <= x2; x++)
-					if (x >= 0 && x < 640)
-						WRITE_UINT16(dst + 640 * y1 + x, c);
+					if (x >= 0 && x < _screenWidth)
+						WRITE_UINT16(dst + _screenWidth * y1 + x, c);
 	} else {
-		if (y1 >= 0 && y1 < 480)
+		if (y1 >= 0 && y1 < _screenHeight)
 			for (int x = x1; x <= x2; x++)
-				if (x >= 0 && x < 640)
-					WRITE_UINT16(dst + 640 * y1 + x, c);
-		if (y2 >= 0 && y2 < 480)
+				if (x >= 0 && x < _screenWidth)
+					WRITE_UINT16(dst + _screenWidth * y1 + x, c);
+		if (y2 >= 0 && y2 < _screenHeight)
 			for (int x = x1; x <= x2; x++)
-				if (x >= 0 && x < 640)
-					WRITE_UINT16(dst + 640 * y2 + x, c);
-		if (x1 >= 0 && x1 < 640)
+				if (x >= 0 && x < _screenWidth)
+					WRITE_UINT16(dst + _screenWidth * y2 + x, c);
+		if (x1 >= 0 && x1 < _screenWidth)
 			for (int y = y1; y <= y2; y++)
-				if (y >= 0 && y < 480)
-					WRITE_UINT16(dst + 640 * y + x1, c);
-		if (x2 >= 0 && x2 < 640)
+				if (y >= 0 && y < _screenHeight)
+					WRITE_UINT16(dst + _screenWidth * y + x1, c);
+		if (x2 >= 0 && x2 < _screenWidth)
 			for (int y = y1; y <= y2; y++)
-				if (y >= 0 && y < 480)
-					WRITE_UINT16(dst + 640 * y + x2, c);
+				if (y >= 0 && y < _screenHeight)
+					WRITE_UINT16(dst + _screenWidth * y + x2, c);
 	}
 }
 
 void GfxTinyGL::drawLine(PrimitiveObject *primitive) {
+	prepareDraw();
 	uint16 *dst = (uint16 *)_zb->pbuf;
-	int x1 = primitive->getP1().x;
-	int y1 = primitive->getP1().y;
-	int x2 = primitive->getP2().x;
-	int y2 = primitive->getP2().y;
+	int x1 = screenX(primitive->getP1().x);
+	int y1 = screenY(primitive->getP1().y);
+	int x2 = screenX(primitive->getP2().x);
+	int y2 = screenY(primitive->getP2().y);
+	// the line may stray a pixel from its end points
+	markDirty(MIN(x1, x2) - 1, MIN(y1, y2) - 1, MAX(x1, x2) + 1, MAX(y1, y2) + 1);
 
 	const Color &color = *primitive->getColor();
 	uint16 c = ((color.getRed() & 0xF8) << 8) | ((color.getGreen() & 0xFC) << 3) | (color.getBlue() >> 3);
 
 	if (x2 == x1) {
 		for (int y = y1; y <= y2; y++) {
-			if (x1 >= 0 && x1 < 640 && y >= 0 && y < 480)
-				WRITE_UINT16(dst + 640 * y + x1, c);
+			if (x1 >= 0 && x1 < _screenWidth && y >= 0 && y < _screenHeight)
+				WRITE_UINT16(dst + _screenWidth * y + x1, c);
 		}
 	} else {
 		float m = (y2 - y1) / (x2 - x1);
 		int b = (int)(-m * x1 + y1);
 		for (int x = x1; x <= x2; x++) {
 			int y = (int)(m * x) + b;
-			if (x >= 0 && x < 640 && y >= 0 && y < 480)
-				WRITE_UINT16(dst + 640 * y + x, c);
+			if (x >= 0 && x < _screenWidth && y >= 0 && y < _screenHeight)
+				WRITE_UINT16(dst + _screenWidth * y + x, c);
 		}
 	}
 }
 
 void GfxTinyGL::drawPolygon(PrimitiveObject *primitive) {
+	prepareDraw();
 	uint16 *dst = (uint16 *)_zb->pbuf;
-	int x1 = primitive->getP1().x;
-	int y1 = primitive->getP1().y;
-	int x2 = primitive->getP2().x;
-	int y2 = primitive->getP2().y;
-	int x3 = primitive->getP3().x;
-	int y3 = primitive->getP3().y;
-	int x4 = primitive->getP4().x;
-	int y4 = primitive->getP4().y;
+	int x1 = screenX(primitive->getP1().x);
+	int y1 = screenY(primitive->getP1().y);
+	int x2 = screenX(primitive->getP2().x);
+	int y2 = screenY(primitive->getP2().y);
+	int x3 = screenX(primitive->getP3().x);
+	int y3 = screenY(primitive->getP3().y);
+	int x4 = screenX(primitive->getP4().x);
+	int y4 = screenY(primitive->getP4().y);
 	float m;
 	int b;
 
+	markDirty(MIN(MIN(x1, x2), MIN(x3, x4)) - 1, MIN(MIN(y1, y2), MIN(y3, y4)) - 1,
+			  MAX(MAX(x1, x2), MAX(x3, x4)) + 1, MAX(MAX(y1, y2), MAX(y3, y4)) + 1);
+
 	const Color &color = *primitive->getColor();
 	uint16 c = ((color.getRed() & 0xF8) << 8) | ((color.getGreen() & 0xFC) << 3) | (color.getBlue() >> 3);
 
@@ -1060,15 +1350,15 @@ void GfxTinyGL::drawPolygon(PrimitiveObject *primitive) {
 	b = (int)(-m * x1 + y1);
 	for (int x = x1; x <= x2; x++) {
 		int y = (int)(m * x) + b;
-		if (x >= 0 && x < 640 && y >= 0 && y < 480)
-			WRITE_UINT16(dst + 640 * y + x, c);
+		if (x >= 0 && x < _screenWidth && y >= 0 && y < _screenHeight)
+			WRITE_UINT16(dst + _screenWidth * y + x, c);
 	}
 	m = (y4 - y3) / (x4 - x3);
 	b = (int)(-m * x3 + y3);
 	for (int x = x3; x <= x4; x++) {
 		int y = (int)(m * x) + b;
-		if (x >= 0 && x < 640 && y >= 0 && y < 480)
-			WRITE_UINT16(dst + 640 * y + x, c);
+		if (x >= 0 && x < _screenWidth && y >= 0 && y < _screenHeight)
+			WRITE_UINT16(dst + _screenWidth * y + x, c);
 	}
 }
 
@@ -70,6 +70,11 @@ public:
 	void drawModelFace(const MeshFace *face, float *vertices, float *vertNormals, float *textureVerts);
 	void drawSprite(const Sprite *sprite);
 
+	void createMesh(Mesh *mesh);
+	void drawMesh(const Mesh *mesh);
+	void drawMeshBatch(const Mesh *mesh, const MeshBatch *batch);
+	void destroyMesh(Mesh *mesh);
+
 	void enableLights();
 	void disableLights();
 	void setupLight(Light *light, int lightId);
@@ -109,14 +114,63 @@ public:
 	void releaseMovieFrame();
 
 protected:
+	void getModelViewMatrix(float *matrix);
+	void getProjectionMatrix(float *matrix);
+	void getViewport(int *viewport);
+	bool isBoxOccluded(const Graphics::Vector3d &pos, const Graphics::Vector3d &size);
+	bool isWindowRectOccluded(float x1, float y1, float x2, float y2, float z);
+	void startDrawList();
+	void setDrawListMesh(const Mesh *mesh, const float *matrix);
+	void finishDrawList();
+	void drawShadowCasterTriangles(const float *vertices, const uint32 *indices, int numIndices);
 
 private:
+	// The engine positions everything in 2D on a 640x480 screen,
+	// the software renderer may run at any other size.
+	enum {
+		kLogicalWidth = 640,
+		kLogicalHeight = 480
+	};
+
+	int screenX(int x) const { return x * _screenWidth / kLogicalWidth; }
+	int screenY(int y) const { return y * _screenHeight / kLogicalHeight; }
+	void blit(byte *dst, const byte *src, int x, int y, int width, int height, bool trans);
+	void allocShadowMask(Shadow *shadow);
+	void prepareDraw();
+	void drawPendingBackground();
+	void restoreDirtyBlocks();
+	void markDirty(int x1, int y1, int x2, int y2) { TinyGL::ZB_markDirty(_zb, x1, y1, x2, y2); }
+
+	// A bitmap drawn between clearScreen() and the first other drawing call.
+	// Those make up the background, which is cached and only redrawn if they change.
+	struct BackgroundBlit {
+		const char *_data;
+		int _x, _y, _width, _height;
+		bool _depth;
+
+		bool operator==(const BackgroundBlit &other) const {
+			return _data == other._data && _x == other._x && _y == other._y &&
+				_width == other._width && _height == other._height && _depth == other._depth;
+		}
+		bool operator!=(const BackgroundBlit &other) const { return !(*this == other); }
+	};
+
 	TinyGL::ZBuffer *_zb;
 	byte *_screen;
 	byte *_smushBitmap;
 	int _smushWidth;
 	int _smushHeight;
 	byte *_storedDisplay;
+	int *_logicalX;		// game column of each screen column
+	int *_logicalY;		// game row of each screen row
+
+	bool _occlusionCulling;
+	bool _backgroundPending;
+	bool _backgroundValid;
+	Common::Array<BackgroundBlit> _backgroundBlits;
+	Common::Array<BackgroundBlit> _cachedBackgroundBlits;
+	byte *_backgroundColor;	// color and depth buffer contents right after
+	byte *_backgroundDepth;	// the cached background was drawn
 };
 
 } // end of namespace Grim
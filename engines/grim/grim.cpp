@@ -481,7 +481,10 @@ Common::Error GrimEngine::run() {
 		g_driver = CreateGfxOpenGL();
 #endif
 
-	g_driver->setupScreen(640, 480, fullscreen);
+	if (_softRenderer)
+		g_driver->setupScreen(ConfMan.getInt("soft_width"), ConfMan.getInt("soft_height"), fullscreen);
+	else
+		g_driver->setupScreen(640, 480, fullscreen);
 
 	// refresh the theme engine so that we can show the gui overlay without it crashing.
 	GUI::GuiManager::instance().theme()->refresh();
@@ -1004,13 +1007,15 @@ void GrimEngine::updateDisplayScene() {
 
 		_currScene->setupLights();
 
-		// Draw actors
+		// Draw actors, the opaque meshes are sorted by texture and drawn at once
+		g_driver->beginDrawList();
 		for (Actor::Pool::Iterator i = Actor::getPool()->getBegin(); i != Actor::getPool()->getEnd(); ++i) {
 			Actor *a = i->_value;
 			if (a->isInSet(_currScene->getName()) && a->isVisible())
 				a->draw();
 			a->undraw(a->isInSet(_currScene->getName()) && a->isVisible());
 		}
+		g_driver->flushDrawList();
 		flagRefreshShadowMask(false);
 
 		// Draw overlying scene components
@@ -1027,8 +1032,15 @@ void GrimEngine::updateDisplayScene() {
 }
 
 void GrimEngine::doFlip() {
-	if (_showFps && _doFlip)
+	if (_showFps && _doFlip) {
 		g_driver->drawEmergString(550, 25, _fps, Color(255, 255, 255));
+		if (_mode == ENGINE_MODE_NORMAL) {
+			// State changes and mesh batches drawn this frame
+			char stats[24];
+			sprintf(stats, "%d/%d", g_driver->getStateChanges(), g_driver->getDrawnBatches());
+			g_driver->drawEmergString(550, 40, stats, Color(255, 255, 255));
+		}
+	}
 
 	if (_doFlip && _flipEnable)
 		g_driver->flipBuffer();
@@ -1075,6 +1087,7 @@ void GrimEngine::mainLoop() {
 
 		g_imuse->flushTracks();
 		g_imuse->refreshScripts();
+		g_resourceloader->flushPrefetched();
 
 		// Process events
 		Common::Event event;
@@ -1400,18 +1413,36 @@ Scene *GrimEngine::loadScene(const Common::String &name) {
 		if (g_grim->getGameType() == GType_MONKEY4) {
 			filename += "b";
 		}
-		Block *b = g_resourceloader->getFileBlock(filename);
-		if (!b)
+		// Go through the cache, the set may have been prefetched
+		Block *b = g_resourceloader->getBlock(filename);
+		if (!b) {
 			warning("Could not find scene file %s", name.c_str());
+			return NULL;
+		}
+		// Loading the scene loads other resources, keep the block around meanwhile
+		g_resourceloader->pinBlock(filename);
 		s = new Scene(name, b->getData(), b->getLen());
-		delete b;
+		g_resourceloader->unpinBlock(filename);
 	}
 
 	return s;
 }
 
+void GrimEngine::prefetchScene(const Common::String &name) {
+	if (findScene(name))
+		return;
+
+	Common::String filename(name);
+	if (g_grim->getGameType() == GType_MONKEY4) {
+		filename += "b";
+	}
+	g_resourceloader->prefetchScene(filename);
+}
+
 void GrimEngine::setScene(const char *name) {
-	setScene(loadScene(name));
+	Scene *scene = loadScene(name);
+	if (scene)
+		setScene(scene);
 }
 
 void GrimEngine::setScene(Scene *scene) {
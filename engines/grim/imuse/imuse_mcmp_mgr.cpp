@@ -31,15 +31,71 @@ namespace Grim {
 
 uint16 imuseDestTable[5786];
 
-McmpMgr::McmpMgr() {
+McmpBlockCache::McmpBlockCache() {
+	for (int i = 0; i < kNumBlocks; i++) {
+		_entries[i]._block = -1;
+		_entries[i]._size = 0;
+		_entries[i]._lastUse = 0;
+		_entries[i]._data = NULL;
+	}
+	_lastFound = 0;
+	_useCount = 0;
+}
+
+McmpBlockCache::~McmpBlockCache() {
+	for (int i = 0; i < kNumBlocks; i++)
+		delete[] _entries[i]._data;
+}
+
+const byte *McmpBlockCache::find(const Common::String &sound, int32 block, int32 *size) {
+	// The callback reads the blocks in order, usually the same one again
+	Entry *entry = &_entries[_lastFound];
+	if (entry->_block != block || entry->_sound != sound) {
+		entry = NULL;
+		for (int i = 0; i < kNumBlocks; i++) {
+			if (_entries[i]._block == block && _entries[i]._sound == sound) {
+				entry = &_entries[i];
+				_lastFound = i;
+				break;
+			}
+		}
+		if (!entry)
+			return NULL;
+	}
+
+	entry->_lastUse = ++_useCount;
+	*size = entry->_size;
+	return entry->_data;
+}
+
+byte *McmpBlockCache::insert(const Common::String &sound, int32 block, int32 size) {
+	assert(size <= kBlockSize);
+
+	int oldest = 0;
+	for (int i = 1; i < kNumBlocks; i++) {
+		if (_entries[i]._lastUse < _entries[oldest]._lastUse)
+			oldest = i;
+	}
+
+	Entry *entry = &_entries[oldest];
+	if (!entry->_data)
+		entry->_data = new byte[kBlockSize];
+	entry->_sound = sound;
+	entry->_block = block;
+	entry->_size = size;
+	entry->_lastUse = ++_useCount;
+	_lastFound = oldest;
+	return entry->_data;
+}
+
+McmpMgr::McmpMgr(McmpBlockCache *cache) {
 	_compTable = NULL;
 	_numCompItems = 0;
 	_curSample = -1;
 	_compInput = NULL;
-	_outputSize = 0;
 	_file = NULL;
 	_numCompItems = 0;
-	_lastBlock = -1;
+	_cache = cache;
 }
 
 McmpMgr::~McmpMgr() {
@@ -51,10 +107,11 @@ McmpMgr::~McmpMgr() {
 bool McmpMgr::openSound(const char *filename, byte **resPtr, int &offsetData) {
 	_file = g_resourceloader->openNewStreamFile(filename);
 
-	if (!_file || !_file->isOpen()) {
+	if (!_file) {
 		warning("McmpMgr::openSound() Can't open sound MCMP file: %s", filename);
 		return false;
 	}
+	_soundName = filename;
 
 	uint32 tag = _file->readUint32BE();
 	if (tag != 'MCMP') {
@@ -100,7 +157,7 @@ int32 McmpMgr::decompressSample(int32 offset, int32 size, byte **comp_final) {
 	int32 i, final_size, output_size;
 	int skip, first_block, last_block;
 
-	if (!_file || !_file->isOpen()) {
+	if (!_file) {
 		error("McmpMgr::decompressSampleByName() File is not open!");
 		return 0;
 	}
@@ -118,21 +175,24 @@ int32 McmpMgr::decompressSample(int32 offset, int32 size, byte **comp_final) {
 	final_size = 0;
 
 	for (i = first_block; i <= last_block; i++) {
-		if (_lastBlock != i) {
+		int32 block_size;
+		const byte *block_data = _cache->find(_soundName, i, &block_size);
+		if (!block_data) {
+			block_size = _compTable[i].decompSize;
+			if (block_size > McmpBlockCache::kBlockSize) {
+				error("McmpMgr::decompressSample() block_size: %d", block_size);
+			}
 			// hack: two more zero bytes at the end of input buffer
 			_compInput[_compTable[i].compSize] = 0;
 			_compInput[_compTable[i].compSize + 1] = 0;
 			_file->seek(_compTable[i].offset, SEEK_SET);
 			_file->read(_compInput, _compTable[i].compSize);
-			decompressVima(_compInput, (int16 *)_compOutput, _compTable[i].decompSize, imuseDestTable);
-			_outputSize = _compTable[i].decompSize;
-			if (_outputSize > 0x2000) {
-				error("McmpMgr::decompressSample() _outputSize: %d", _outputSize);
-			}
-			_lastBlock = i;
+			byte *block = _cache->insert(_soundName, i, block_size);
+			decompressVima(_compInput, (int16 *)block, block_size, imuseDestTable);
+			block_data = block;
 		}
 
-		output_size = _outputSize - skip;
+		output_size = block_size - skip;
 
 		if ((output_size + skip) > 0x2000) // workaround
 			output_size -= (output_size + skip) - 0x2000;
@@ -142,7 +202,7 @@ int32 McmpMgr::decompressSample(int32 offset, int32 size, byte **comp_final) {
 
 		assert(final_size + output_size <= blocks_final_size);
 
-		memcpy(*comp_final + final_size, _compOutput + skip, output_size);
+		memcpy(*comp_final + final_size, block_data + skip, output_size);
 		final_size += output_size;
 
 		size -= output_size;
@@ -23,8 +23,49 @@
 #ifndef GRIM_MCMP_MGR_H
 #define GRIM_MCMP_MGR_H
 
+#include "common/str.h"
+
 namespace Grim {
 
+/**
+ * The decoded VIMA blocks of the MCMP sounds, kept so that music which
+ * jumps back and forth between regions does not decode them again. It is
+ * shared by all the sounds and only used under the iMUSE mutex.
+ */
+class McmpBlockCache {
+public:
+	McmpBlockCache();
+	~McmpBlockCache();
+
+	/**
+	 * Returns the decoded block of a sound, or NULL if it is not cached.
+	 */
+	const byte *find(const Common::String &sound, int32 block, int32 *size);
+
+	/**
+	 * Returns the buffer to decode a block to, replacing the least
+	 * recently used one.
+	 */
+	byte *insert(const Common::String &sound, int32 block, int32 size);
+
+	enum { kBlockSize = 0x2000 };
+
+private:
+	enum { kNumBlocks = 64 };
+
+	struct Entry {
+		Common::String _sound;
+		int32 _block;
+		int32 _size;
+		uint32 _lastUse;
+		byte *_data;
+	};
+
+	Entry _entries[kNumBlocks];
+	int _lastFound;
+	uint32 _useCount;
+};
+
 class McmpMgr {
 private:
 
@@ -38,15 +79,14 @@ private:
 	CompTable *_compTable;
 	int16 _numCompItems;
 	int _curSample;
-	Common::File *_file;
-	byte _compOutput[0x2000];
+	Common::SeekableReadStream *_file;
+	Common::String _soundName;
+	McmpBlockCache *_cache;
 	byte *_compInput;
-	int _outputSize;
-	int _lastBlock;
 
 public:
 
-	McmpMgr();
+	McmpMgr(McmpBlockCache *cache);
 	~McmpMgr();
 
 	bool openSound(const char *filename, byte **resPtr, int &offsetData);
@@ -36,12 +36,14 @@ ImuseSndMgr::ImuseSndMgr() {
 	for (int l = 0; l < MAX_IMUSE_SOUNDS; l++) {
 		memset(&_sounds[l], 0, sizeof(SoundDesc));
 	}
+	_blockCache = new McmpBlockCache();
 }
 
 ImuseSndMgr::~ImuseSndMgr() {
 	for (int l = 0; l < MAX_IMUSE_SOUNDS; l++) {
 		closeSound(&_sounds[l]);
 	}
+	delete _blockCache;
 }
 
 void ImuseSndMgr::countElements(byte *ptr, int &numRegions, int &numJumps) {
@@ -186,7 +188,7 @@ ImuseSndMgr::SoundDesc *ImuseSndMgr::openSound(const char *soundName, int volGro
 		}
 	} else if (scumm_stricmp(extension, "wav") == 0 || scumm_stricmp(extension, "imc") == 0 ||
 			(g_grim->getGameFlags() & ADGF_DEMO && scumm_stricmp(extension, "imu") == 0)) {
-		sound->mcmpMgr = new McmpMgr();
+		sound->mcmpMgr = new McmpMgr(_blockCache);
 		if (!sound->mcmpMgr->openSound(soundName, &ptr, headerSize)) {
 			closeSound(sound);
 			return NULL;
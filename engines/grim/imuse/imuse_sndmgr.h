@@ -29,6 +29,7 @@
 namespace Grim {
 
 class McmpMgr;
+class McmpBlockCache;
 class Block;
 
 class ImuseSndMgr {
@@ -83,6 +84,7 @@ public:
 private:
 
 	SoundDesc _sounds[MAX_IMUSE_SOUNDS];
+	McmpBlockCache *_blockCache;
 
 	bool checkForProperHandle(SoundDesc *soundDesc);
 	SoundDesc *allocSlot();
@@ -154,21 +154,25 @@ KeyframeAnim::~KeyframeAnim() {
 	g_resourceloader->uncacheKeyframe(this);
 }
 
-bool KeyframeAnim::animate(ModelNode *nodes, int num, float time, float fade, bool tagged) const {
-	// Without this sending the bread down the tube in "mo" often crashes,
-	// because it goes outside the bounds of the array of the nodes.
-	if (num >= _numJoints)
-		return false;
-
+void KeyframeAnim::animate(ModelNode *nodes, int numNodes, float time, float fade, bool tagged,
+						   int *cursors, const float *remainingWeights, float *totalWeights) const {
 	float frame = time * _fps;
 
 	if (frame > _numFrames)
 		frame = _numFrames;
 
-	if (_nodes[num] && tagged == ((_type & nodes[num]._type) != 0)) {
-		return _nodes[num]->animate(nodes[num], frame, fade, (_flags & 256) == 0);
-	} else {
-		return false;
+	bool useDelta = (_flags & 256) == 0;
+
+	// Without limiting this to the joints sending the bread down the tube in "mo"
+	// often crashes, because it goes outside the bounds of the array of the nodes.
+	int num = MIN(numNodes, _numJoints);
+	for (int i = 0; i < num; i++) {
+		if (remainingWeights[i] <= 0.0f || !_nodes[i] || _nodes[i]->_numEntries == 0 ||
+			tagged != ((_type & nodes[i]._type) != 0))
+			continue;
+
+		_nodes[i]->animate(nodes[i], frame, fade * remainingWeights[i], useDelta, &cursors[i]);
+		totalWeights[i] += fade;
 	}
 }
 
@@ -188,8 +192,8 @@ int KeyframeAnim::getMarker(float startTime, float stopTime) const {
 	return 0;
 }
 
-void KeyframeAnim::KeyframeEntry::loadBinary(const char *&data) {
-	_frame = get_float(data);
+void KeyframeAnim::KeyframeEntry::loadBinary(const char *&data, float *frame) {
+	*frame = get_float(data);
 	_flags = READ_LE_UINT32(data + 4);
 	_pos = Graphics::get_vector3d(data + 8);
 	_pitch = get_float(data + 20);
@@ -211,14 +215,16 @@ void KeyframeAnim::KeyframeNode::loadBinary(const char *&data) {
 		memcpy(_meshName, data, 32);
 	_numEntries = READ_LE_UINT32(data + 36);
 	data += 44;
+	_frames = new float[_numEntries];
 	_entries = new KeyframeEntry[_numEntries];
 	for (int i = 0; i < _numEntries; i++)
-		_entries[i].loadBinary(data);
+		_entries[i].loadBinary(data, &_frames[i]);
 }
 
 void KeyframeAnim::KeyframeNode::loadText(TextSplitter &ts) {
 	ts.scanString("mesh name %s", 1, _meshName);
 	ts.scanString("entries %d", 1, &_numEntries);
+	_frames = new float[_numEntries];
 	_entries = new KeyframeEntry[_numEntries];
 	for (int i = 0; i < _numEntries; i++) {
 		int which;
@@ -226,7 +232,7 @@ void KeyframeAnim::KeyframeNode::loadText(TextSplitter &ts) {
 		float frame, x, y, z, p, yaw, r, dx, dy, dz, dp, dyaw, dr;
 		ts.scanString(" %d: %f %x %f %f %f %f %f %f", 9, &which, &frame, &flags, &x, &y, &z, &p, &yaw, &r);
 		ts.scanString(" %f %f %f %f %f %f", 6, &dx, &dy, &dz, &dp, &dyaw, &dr);
-		_entries[which]._frame = frame;
+		_frames[which] = frame;
 		_entries[which]._flags = (int)flags;
 		_entries[which]._pos = Graphics::Vector3d(x, y, z);
 		_entries[which]._dpos = Graphics::Vector3d(dx, dy, dz);
@@ -240,60 +246,69 @@ void KeyframeAnim::KeyframeNode::loadText(TextSplitter &ts) {
 }
 
 KeyframeAnim::KeyframeNode::~KeyframeNode() {
+	delete[] _frames;
 	delete[] _entries;
 }
 
-bool KeyframeAnim::KeyframeNode::animate(ModelNode &node, float frame, float fade, bool useDelta) const {
-	if (_numEntries == 0)
-		return false;
+int KeyframeAnim::KeyframeNode::findEntry(float frame, int *cursor) const {
+	// Animations mostly play forward, so the entry is usually the one
+	// used last time or one of the next few
+	int low = *cursor;
+	if (low < 0 || low >= _numEntries || _frames[low] > frame)
+		low = 0;
+	int high = _numEntries;
+	for (int i = 0; i < 4 && low + 1 < high; i++) {
+		if (_frames[low + 1] > frame) {
+			high = low + 1;
+			break;
+		}
+		low++;
+	}
 
 	// Do a binary search for the nearest previous frame
-	// Loop invariant: entries_[low].frame_ <= frame < entries_[high].frame_
-	int low = 0, high = _numEntries;
+	// Loop invariant: _frames[low] <= frame < _frames[high]
 	while (high > low + 1) {
 		int mid = (low + high) / 2;
-		if (_entries[mid]._frame <= frame)
+		if (_frames[mid] <= frame)
 			low = mid;
 		else
 			high = mid;
 	}
 
-	float dt = frame - _entries[low]._frame;
-	Graphics::Vector3d pos = _entries[low]._pos;
-	float pitch = _entries[low]._pitch;
-	float yaw = _entries[low]._yaw;
-	float roll = _entries[low]._roll;
+	*cursor = low;
+	return low;
+}
+
+// Brings a difference of angles between -180 and 180 degrees, like
+// repeatedly adding or subtracting 360 would
+static inline float normalizeAngleDelta(float angle) {
+	if (angle > 180.f)
+		angle -= 360.f * ceil((angle - 180.f) / 360.f);
+	else if (angle < -180.f)
+		angle += 360.f * ceil((-180.f - angle) / 360.f);
+	return angle;
+}
+
+void KeyframeAnim::KeyframeNode::animate(ModelNode &node, float frame, float fade, bool useDelta, int *cursor) const {
+	int index = findEntry(frame, cursor);
+	const KeyframeEntry &entry = _entries[index];
+
+	float dt = frame - _frames[index];
+	Graphics::Vector3d pos = entry._pos;
+	float pitch = entry._pitch;
+	float yaw = entry._yaw;
+	float roll = entry._roll;
 	if (useDelta) {
-		pos += dt * _entries[low]._dpos;
-		pitch += dt * _entries[low]._dpitch;
-		yaw += dt * _entries[low]._dyaw;
-		roll += dt * _entries[low]._droll;
+		pos += dt * entry._dpos;
+		pitch += dt * entry._dpitch;
+		yaw += dt * entry._dyaw;
+		roll += dt * entry._droll;
 	}
 
 	node._animPos += (pos - node._pos) * fade;
-
-	float dpitch = pitch - node._pitch;
-	while (dpitch > 180)
-		dpitch -= 360;
-	while (dpitch < -180)
-		dpitch += 360;
-	node._animPitch += dpitch * fade;
-
-	float dyaw = yaw - node._yaw;
-	while (dyaw > 180)
-		dyaw -= 360;
-	while (dyaw < -180)
-		dyaw += 360;
-	node._animYaw += dyaw * fade;
-
-	float droll = roll - node._roll;
-	while (droll > 180)
-		droll -= 360;
-	while (droll < -180)
-		droll += 360;
-	node._animRoll += droll * fade;
-
-	return true;
+	node._animPitch += normalizeAngleDelta(pitch - node._pitch) * fade;
+	node._animYaw += normalizeAngleDelta(yaw - node._yaw) * fade;
+	node._animRoll += normalizeAngleDelta(roll - node._roll) * fade;
 }
 
 } // end of namespace Grim
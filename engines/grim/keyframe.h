@@ -39,10 +39,28 @@ public:
 
 	void loadBinary(const char *data, int len);
 	void loadText(TextSplitter &ts);
-	bool animate(ModelNode *nodes, int num, float time, float fade, bool tagged) const;
+	/**
+	 * Blends the pose at the given time into a whole hierarchy.
+	 *
+	 * @param nodes            The nodes of the hierarchy.
+	 * @param numNodes         The number of nodes.
+	 * @param time             The time in the animation, in seconds.
+	 * @param fade             The fade of the animation.
+	 * @param tagged           Whether to animate the nodes tagged with the type
+	 *                         of this animation, or the others.
+	 * @param cursors          The entry last used for each joint, to start the
+	 *                         search from. Holds getNumJoints() values.
+	 * @param remainingWeights The weight left to each node by the layers of higher
+	 *                         priority. Nodes with nothing left are skipped.
+	 * @param totalWeights     The fade is added to the total weight of each node
+	 *                         that has a track in this animation.
+	 */
+	void animate(ModelNode *nodes, int numNodes, float time, float fade, bool tagged,
+				 int *cursors, const float *remainingWeights, float *totalWeights) const;
 	int getMarker(float startTime, float stopTime) const;
 
 	float getLength() const { return _numFrames / _fps; }
+	int getNumJoints() const { return _numJoints; }
 	const Common::String &getFilename() const { return _fname; }
 
 private:
@@ -59,9 +77,8 @@ private:
 	Marker *_markers;
 
 	struct KeyframeEntry {
-		void loadBinary(const char *&data);
+		void loadBinary(const char *&data, float *frame);
 
-		float _frame;
 		int _flags;
 		Graphics::Vector3d _pos, _dpos;
 		float _pitch, _yaw, _roll, _dpitch, _dyaw, _droll;
@@ -72,10 +89,14 @@ private:
 		void loadText(TextSplitter &ts);
 		~KeyframeNode();
 
-		bool animate(ModelNode &node, float frame, float fade, bool useDelta) const;
+		int findEntry(float frame, int *cursor) const;
+		void animate(ModelNode &node, float frame, float fade, bool useDelta, int *cursor) const;
 
 		char _meshName[32];
 		int _numEntries;
+		// The frames of the entries are kept apart, so that the search
+		// for the current entry only walks through them
+		float *_frames;
 		KeyframeEntry *_entries;
 	};
 
@@ -20,9 +20,21 @@
  *
  */
 
+#if defined(POSIX)
+#define FORBIDDEN_SYMBOL_EXCEPTION_unistd_h
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #include "common/endian.h"
 #include "common/file.h"
+#include "common/fs.h"
+#include "common/memstream.h"
 #include "common/substream.h"
+#include "common/config-manager.h"
 
 #include "engines/grim/grim.h"
 #include "engines/grim/lab.h"
@@ -52,7 +64,67 @@ bool Lab::open(const Common::String &filename) {
 	else
 		parseMonkey4FileTable();
 
+	// With the archive mapped, blocks and streams are views into the mapping
+	// and the file handle is no longer needed.
+	if (ConfMan.getBool("lab_mmap") && mapFile()) {
+		delete _f;
+		_f = NULL;
+	}
+
+	return true;
+}
+
+bool Lab::mapFile() {
+#if defined(POSIX)
+	// Find the file the same way Common::File did when opening it. Only
+	// members of a plain directory have a path that can be mapped.
+	Common::ArchiveMemberPtr member = SearchMan.getMember(_labFileName);
+	const Common::FSNode *node = dynamic_cast<const Common::FSNode *>(member.get());
+	if (!node || !node->exists())
+		return false;
+
+	int fd = ::open(node->getPath().c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		::close(fd);
+		return false;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (data == MAP_FAILED)
+		return false;
+
+	_mapData = (const byte *)data;
+	_mapSize = st.st_size;
+
+	// Don't trust a table pointing outside of the file
+	for (LabMap::const_iterator i = _entries.begin(); i != _entries.end(); ++i) {
+		uint32 offset = (uint32)i->_value.offset;
+		uint32 len = (uint32)i->_value.len;
+		if (offset > _mapSize || len > _mapSize - offset) {
+			warning("Lab::mapFile(): entry %s is out of bounds in %s", i->_key.c_str(), _labFileName.c_str());
+			unmapFile();
+			return false;
+		}
+	}
+
 	return true;
+#else
+	return false;
+#endif
+}
+
+void Lab::unmapFile() {
+#if defined(POSIX)
+	if (_mapData)
+		munmap(const_cast<byte *>(_mapData), _mapSize);
+#endif
+	_mapData = NULL;
+	_mapSize = 0;
 }
 
 void Lab::parseGrimFileTable() {
@@ -127,65 +199,60 @@ bool Lab::getFileExists(const Common::String &filename) const {
 }
 
 bool Lab::isOpen() const {
-	return _f && _f->isOpen();
+	return _mapData || (_f && _f->isOpen());
 }
 
-Block *Lab::getFileBlock(const Common::String &filename) const {
-	if (!getFileExists(filename))
-		return 0;
+Block *Lab::getFileBlock(const LabEntry &entry) const {
+	if (_mapData)
+		return new Block((const char *)_mapData + entry.offset, entry.len, false);
 
-	const LabEntry &i = _entries[filename];
-
-	_f->seek(i.offset, SEEK_SET);
-	char *data = new char[i.len];
-	_f->read(data, i.len);
-	return new Block(data, i.len);
+	_f->seek(entry.offset, SEEK_SET);
+	char *data = new char[entry.len];
+	_f->read(data, entry.len);
+	return new Block(data, entry.len);
 }
 
-LuaFile *Lab::openNewStreamLua(const Common::String &filename) const {
-	if (!getFileExists(filename))
-		return 0;
-
-	Common::File *file = new Common::File();
-	file->open(_labFileName);
-	file->seek(_entries[filename].offset, SEEK_SET);
-
+LuaFile *Lab::openNewStreamLua(const LabEntry &entry) const {
 	LuaFile *filehandle = new LuaFile();
-	filehandle->_in = file;
+	if (_mapData) {
+		filehandle->_in = new Common::MemoryReadStream(_mapData + entry.offset, entry.len);
+	} else {
+		Common::File *file = new Common::File();
+		file->open(_labFileName);
+		file->seek(entry.offset, SEEK_SET);
+		filehandle->_in = file;
+	}
 
 	return filehandle;
 }
 
-Common::File *Lab::openNewStreamFile(const Common::String &filename) const {
-	if (!getFileExists(filename))
-		return 0;
+Common::SeekableReadStream *Lab::openNewStreamFile(const LabEntry &entry) const {
+	if (_mapData)
+		return new Common::MemoryReadStream(_mapData + entry.offset, entry.len);
 
 	Common::File *file = new Common::File();
-	file->open(_labFileName);
-	file->seek(_entries[filename].offset, SEEK_SET);
+	if (!file->open(_labFileName)) {
+		delete file;
+		return 0;
+	}
+	file->seek(entry.offset, SEEK_SET);
 
 	return file;
 }
 // SubStream, for usage with GZipReadStream
-Common::SeekableReadStream *Lab::openNewSubStreamFile(const Common::String &filename) const {
-	if (!getFileExists(filename))
-		return 0;
+Common::SeekableReadStream *Lab::openNewSubStreamFile(const LabEntry &entry) const {
+	if (_mapData)
+		return new Common::MemoryReadStream(_mapData + entry.offset, entry.len);
 
 	Common::File *file = new Common::File();
 	file->open(_labFileName);
 	Common::SeekableSubReadStream *substream;
-	substream = new Common::SeekableSubReadStream(file, _entries[filename].offset, _entries[filename].offset + _entries[filename].len, DisposeAfterUse::YES );
+	substream = new Common::SeekableSubReadStream(file, entry.offset, entry.offset + entry.len, DisposeAfterUse::YES );
 	return substream;
 }
 
-int Lab::getFileLength(const Common::String &filename) const {
-	if (!getFileExists(filename))
-		return -1;
-
-	return _entries[filename].len;
-}
-
 void Lab::close() {
+	unmapFile();
 	delete _f;
 	_f = NULL;
 
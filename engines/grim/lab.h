@@ -29,6 +29,7 @@
 
 namespace Common {
 	class File;
+	class SeekableReadStream;
 }
 
 namespace Grim {
@@ -37,44 +38,56 @@ class LuaFile;
 
 class Block {
 public:
-	Block(const char *dataPtr, int length) : _data(dataPtr), _len(length) {}
+	/**
+	 * If owned is false the block is only a view into memory kept alive
+	 * elsewhere (e.g. a mapped Lab) and the data is not freed with it.
+	 */
+	Block(const char *dataPtr, int length, bool owned = true) : _data(dataPtr), _len(length), _owned(owned) {}
 	const char *getData() const { return _data; }
 	int getLen() const { return _len; }
+	bool isOwned() const { return _owned; }
 
-	~Block() { delete[] _data; }
+	~Block() { if (_owned) delete[] _data; }
 
 private:
 	Block();
 	const char *_data;
 	int _len;
+	bool _owned;
 };
 
 class Lab {
 public:
-	Lab() : _f(NULL) { }
+	struct LabEntry {
+		int offset, len;
+	};
+	typedef Common::HashMap<Common::String, LabEntry, Common::IgnoreCase_Hash, Common::IgnoreCase_EqualTo> LabMap;
+
+	Lab() : _f(NULL), _mapData(NULL), _mapSize(0) { }
 
 	bool open(const Common::String &filename);
 	bool isOpen() const;
+	bool isMapped() const { return _mapData != NULL; }
 	void close();
 	bool getFileExists(const Common::String &filename) const;
-	Block *getFileBlock(const Common::String &filename) const;
-	Common::File *openNewStreamFile(const Common::String &filename) const;
-	Common::SeekableReadStream *openNewSubStreamFile(const Common::String &filename) const;
-	LuaFile *openNewStreamLua(const Common::String &filename) const;
-	int getFileLength(const Common::String &filename) const;
+	const LabMap &getFiles() const { return _entries; }
+	Block *getFileBlock(const LabEntry &entry) const;
+	Common::SeekableReadStream *openNewStreamFile(const LabEntry &entry) const;
+	Common::SeekableReadStream *openNewSubStreamFile(const LabEntry &entry) const;
+	LuaFile *openNewStreamLua(const LabEntry &entry) const;
 
 	~Lab() { close(); }
 
-	struct LabEntry {
-		int offset, len;
-	};
-
 private:
 	void parseGrimFileTable();
 	void parseMonkey4FileTable();
+	bool mapFile();
+	void unmapFile();
 
 	Common::File *_f;
-	typedef Common::HashMap<Common::String, LabEntry, Common::IgnoreCase_Hash, Common::IgnoreCase_EqualTo> LabMap;
+	// Read-only mapping of the whole archive, NULL when unavailable
+	const byte *_mapData;
+	uint32 _mapSize;
 	LabMap _entries;
 	Common::String _labFileName;
 };
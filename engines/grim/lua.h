@@ -192,6 +192,7 @@ void L1_MakeSectorActive();
 void L1_LockSet();
 void L1_UnLockSet();
 void L1_MakeCurrentSet();
+void L1_PrefetchSet();
 void L1_MakeCurrentSetup();
 void L1_GetCurrentSetup();
 void L1_ShrinkBoxes();
@@ -692,6 +692,15 @@ void L1_MakeCurrentSet() {
 	g_grim->setScene(name);
 }
 
+// Residual extension: start reading a set's resources in the background
+void L1_PrefetchSet() {
+	lua_Object nameObj = lua_getparam(1);
+	if (!lua_isstring(nameObj))
+		return;
+
+	g_grim->prefetchScene(lua_getstring(nameObj));
+}
+
 void L1_MakeCurrentSetup() {
 	lua_Object setupObj = lua_getparam(1);
 	if (!lua_isnumber(setupObj))
@@ -1401,6 +1410,7 @@ struct luaL_reg grimMainOpcodes[] = {
 	{ "MakeCurrentSet", L1_MakeCurrentSet },
 	{ "LockSet", L1_LockSet },
 	{ "UnLockSet", L1_UnLockSet },
+	{ "PrefetchSet", L1_PrefetchSet },
 	{ "MakeCurrentSetup", L1_MakeCurrentSetup },
 	{ "GetCurrentSetup", L1_GetCurrentSetup },
 	{ "NextSetup", L1_NextSetup },
@@ -671,7 +671,7 @@ void L1_GetActorNodeLocation() {
 	matrix._pos = actor->getPos();
 	matrix._rot.buildFromPitchYawRoll(actor->getPitch(), actor->getYaw(), actor->getRoll());
 	root->setMatrix(matrix);
-	root->update();
+	actor->getCurrentCostume()->updateHierarchy(root);
 
 	lua_pushnumber(node->_pivotMatrix._pos.x());
 	lua_pushnumber(node->_pivotMatrix._pos.y());
@@ -995,6 +995,7 @@ struct luaL_reg monkeyMainOpcodes[] = {
 	{ "MakeCurrentSet", L1_MakeCurrentSet },
 	{ "LockSet", L2_LockSet },
 	{ "UnLockSet", L2_UnLockSet },
+	{ "PrefetchSet", L1_PrefetchSet },
 	{ "MakeCurrentSetup", L2_MakeCurrentSetup },
 	{ "GetCurrentSetup", L1_GetCurrentSetup },
 	{ "NextSetup", L2_NextSetup },
@@ -170,12 +170,21 @@ void Material::reload(CMap *cmap) {
 }
 
 void Material::select() const {
+	const Texture *t = getCurrentTexture();
+	if (t)
+		g_driver->selectMaterial(t);
+}
+
+const Texture *Material::getCurrentTexture() const {
 	Texture *t = _data->_textures + _currImage;
 	if (t->_width && t->_height)
-		g_driver->selectMaterial(t);
+		return t;
+	return NULL;
 }
 
 Material::~Material() {
+	if (g_resourceloader)
+		g_resourceloader->uncacheMaterial(this);
 	--_data->_refCount;
 	if (_data->_refCount < 1) {
 		delete _data;
@@ -62,6 +62,8 @@ public:
 	void reload(CMap *cmap);
 	// Load this texture into the GL context
 	void select() const;
+	// The texture select() would load, or NULL if the current image is empty
+	const Texture *getCurrentTexture() const;
 
 	// Set which image in an animated texture to use
 	void setNumber(int n) { _currImage = n; }
@@ -59,7 +59,8 @@ Model::Model(const Common::String &filename, const char *data, int len, CMap *cm
 
 	Graphics::Vector3d max;
 
-	_rootHierNode->update();
+	_hierarchy = new ModelHierarchy();
+	_hierarchy->update(_rootHierNode);
 	bool first = true;
 	for (int i = 0; i < _numHierNodes; ++i) {
 		ModelNode &node = _rootHierNode[i];
@@ -102,6 +103,7 @@ Model::~Model() {
 	delete[] _materialNames;
 	delete[] _geosets;
 	delete[] _rootHierNode;
+	delete _hierarchy;
 	g_resourceloader->uncacheModel(this);
 }
 
@@ -375,14 +377,16 @@ int MeshFace::loadBinary(const char *&data, Material *materials[]) {
 			data += 4;
 		}
 	}
+	// -1 for a face without a material, so it isn't mistaken for material 0
+	int materialid = -1;
 	if (materialPtr == 0)
 		_material = 0;
 	else {
-		_material = materials[READ_LE_UINT32(data)];
-		materialPtr = READ_LE_UINT32(data);
+		materialid = READ_LE_UINT32(data);
+		_material = materials[materialid];
 		data += 4;
 	}
-	return materialPtr;
+	return materialid;
 }
 
 void MeshFace::changeMaterial(Material *material) {
@@ -398,6 +402,11 @@ void MeshFace::draw(float *vertices, float *vertNormals, float *textureVerts) co
  * @class Mesh
  */
 Mesh::~Mesh() {
+	if (_userData && g_driver)
+		g_driver->destroyMesh(this);
+	delete[] _batchVertices;
+	delete[] _batchIndices;
+	delete[] _batches;
 	delete[] _vertices;
 	delete[] _verticesI;
 	delete[] _vertNormals;
@@ -443,6 +452,8 @@ void Mesh::loadBinary(const char *&data, Material *materials[]) {
 	_shadow = READ_LE_UINT32(data);
 	_radius = get_float(data + 8);
 	data += 36;
+
+	prepareBatches();
 }
 
 void Mesh::loadText(TextSplitter *ts, Material* materials[]) {
@@ -538,14 +549,104 @@ void Mesh::loadText(TextSplitter *ts, Material* materials[]) {
 		ts->scanString(" %d: %f %f %f", 4, &num, &x, &y, &z);
 		_faces[num]._normal = Graphics::Vector3d(x, y, z);
 	}
+
+	prepareBatches();
+}
+
+void Mesh::prepareBatches() {
+	Graphics::Vector3d max;
+	for (int i = 0; i < _numVertices; i++) {
+		const float *v = _vertices + 3 * i;
+		if (i == 0 || v[0] < _bboxPos.x())
+			_bboxPos.x() = v[0];
+		if (i == 0 || v[1] < _bboxPos.y())
+			_bboxPos.y() = v[1];
+		if (i == 0 || v[2] < _bboxPos.z())
+			_bboxPos.z() = v[2];
+		if (i == 0 || v[0] > max.x())
+			max.x() = v[0];
+		if (i == 0 || v[1] > max.y())
+			max.y() = v[1];
+		if (i == 0 || v[2] > max.z())
+			max.z() = v[2];
+	}
+	_bboxSize = max - _bboxPos;
+
+	_numBatchVertices = 0;
+	_numBatchIndices = 0;
+	for (int i = 0; i < _numFaces; i++) {
+		if (_faces[i]._numVertices < 3)
+			continue;
+		_numBatchVertices += _faces[i]._numVertices;
+		_numBatchIndices += 3 * (_faces[i]._numVertices - 2);
+	}
+
+	_batchVertices = new float[8 * _numBatchVertices];
+	_batchIndices = new uint32[_numBatchIndices];
+	_batches = new MeshBatch[_numFaces];
+	_numBatches = 0;
+
+	bool *done = new bool[_numFaces];
+	memset(done, 0, _numFaces * sizeof(bool));
+
+	float *vert = _batchVertices;
+	uint32 *index = _batchIndices;
+	uint32 base = 0;
+	for (int i = 0; i < _numFaces; i++) {
+		if (done[i])
+			continue;
+
+		MeshBatch &batch = _batches[_numBatches++];
+		batch._material = _faces[i]._material;
+		batch._materialid = _materialid[i];
+		batch._firstIndex = index - _batchIndices;
+
+		for (int j = i; j < _numFaces; j++) {
+			const MeshFace &face = _faces[j];
+			if (done[j] || _materialid[j] != batch._materialid)
+				continue;
+			done[j] = true;
+			if (face._numVertices < 3)
+				continue;
+
+			for (int k = 0; k < face._numVertices; k++) {
+				memcpy(vert, _vertices + 3 * face._vertices[k], 3 * sizeof(float));
+				memcpy(vert + 3, _vertNormals + 3 * face._vertices[k], 3 * sizeof(float));
+				if (face._texVertices) {
+					memcpy(vert + 6, _textureVerts + 2 * face._texVertices[k], 2 * sizeof(float));
+				} else {
+					vert[6] = 0.0f;
+					vert[7] = 0.0f;
+				}
+				vert += 8;
+			}
+			// The faces are convex polygons, so a fan covers them.
+			for (int k = 1; k < face._numVertices - 1; k++) {
+				*index++ = base;
+				*index++ = base + k;
+				*index++ = base + k + 1;
+			}
+			base += face._numVertices;
+		}
+		batch._numIndices = (index - _batchIndices) - batch._firstIndex;
+	}
+	delete[] done;
+
+	g_driver->createMesh(this);
 }
 
 void Mesh::update() {
 }
 
 void Mesh::changeMaterials(Material *materials[]) {
-	for (int i = 0; i < _numFaces; i++)
-		_faces[i].changeMaterial(materials[_materialid[i]]);
+	for (int i = 0; i < _numFaces; i++) {
+		if (_materialid[i] != -1)
+			_faces[i].changeMaterial(materials[_materialid[i]]);
+	}
+	for (int i = 0; i < _numBatches; i++) {
+		if (_batches[i]._materialid != -1)
+			_batches[i]._material = materials[_batches[i]._materialid];
+	}
 }
 
 void Mesh::draw(int *x1, int *y1, int *x2, int *y2) const {
@@ -560,11 +661,18 @@ void Mesh::draw(int *x1, int *y1, int *x2, int *y2) const {
 		}
 	}
 
+	g_driver->recordShadowCaster(this);
+
+	if (!g_driver->isMeshVisible(this))
+		return;
+
+	if (g_driver->recordMesh(this))
+		return;
+
 	if (_lightingMode == 0)
 		g_driver->disableLights();
 
-	for (int i = 0; i < _numFaces; i++)
-		_faces[i].draw(_vertices, _vertNormals, _textureVerts);
+	g_driver->drawMesh(this);
 
 	if (_lightingMode == 0)
 		g_driver->enableLights();
@@ -573,12 +681,15 @@ void Mesh::draw(int *x1, int *y1, int *x2, int *y2) const {
 /**
  * @class ModelNode
  */
+uint32 ModelNode::_hierarchyVersion = 0;
+
 ModelNode::~ModelNode() {
 	ModelNode *child = _child;
 	while (child) {
 		child->_parent = NULL;
 		child = child->_sibling;
 	}
+	_hierarchyVersion++;
 }
 
 void ModelNode::loadBinary(const char *&data, ModelNode *hierNodes, const Model::Geoset *g) {
@@ -639,6 +750,7 @@ void ModelNode::addChild(ModelNode *child) {
 		childPos = &(*childPos)->_sibling;
 	*childPos = child;
 	child->_parent = this;
+	_hierarchyVersion++;
 }
 
 void ModelNode::removeChild(ModelNode *child) {
@@ -648,42 +760,124 @@ void ModelNode::removeChild(ModelNode *child) {
 	if (*childPos) {
 		*childPos = child->_sibling;
 		child->_parent = NULL;
+		_hierarchyVersion++;
 	}
 }
 
 void ModelNode::setMatrix(Graphics::Matrix4 matrix) {
 	_matrix = matrix;
+	_dirty = true;
 }
 
-void ModelNode::update() {
-	if (!_initialized)
-		return;
-
+bool ModelNode::updateLocalMatrix() {
 	Graphics::Vector3d animPos = _pos + _animPos;
 	float animPitch = _pitch + _animPitch;
 	float animYaw = _yaw + _animYaw;
 	float animRoll = _roll + _animRoll;
 
-	_localMatrix._pos.set(animPos.x(), animPos.y(), animPos.z());
-	_localMatrix._rot.buildFromPitchYawRoll(animPitch, animYaw, animRoll);
+	bool changed = false;
+	if (!_localValid || animPitch != _localPitch || animYaw != _localYaw || animRoll != _localRoll) {
+		_localMatrix._rot.buildFromPitchYawRoll(animPitch, animYaw, animRoll);
+		_localPitch = animPitch;
+		_localYaw = animYaw;
+		_localRoll = animRoll;
+		_localValid = true;
+		changed = true;
+	}
+	if (_localMatrix._pos != animPos) {
+		_localMatrix._pos.set(animPos.x(), animPos.y(), animPos.z());
+		changed = true;
+	}
+	return changed;
+}
 
-	_matrix *= _localMatrix;
+/**
+ * @class ModelHierarchy
+ */
+
+ModelHierarchy::ModelHierarchy() :
+	_root(NULL), _version(0) {
 
-	_pivotMatrix = _matrix;
+}
 
-	_pivotMatrix.translate(_pivot.x(), _pivot.y(), _pivot.z());
+void ModelHierarchy::build(ModelNode *root) {
+	_entries.clear();
+	addNode(root, -1);
+	_root = root;
+	_version = ModelNode::_hierarchyVersion;
+}
+
+void ModelHierarchy::addNode(ModelNode *node, int parent) {
+	int index = _entries.size();
+	Entry entry;
+	entry._node = node;
+	entry._parent = parent;
+	entry._changed = true;
+	_entries.push_back(entry);
+	// The node may have been moved to another parent since it was updated
+	node->_dirty = true;
+
+	for (ModelNode *child = node->_child; child; child = child->_sibling)
+		addNode(child, index);
+	_entries[index]._end = _entries.size();
+}
 
-	if (_mesh) {
-		_mesh->_matrix = _pivotMatrix;
+static bool equalMatrices(const Graphics::Matrix4 &m1, const Graphics::Matrix4 &m2) {
+	return m1._pos == m2._pos && m1._rot._right == m2._rot._right &&
+		   m1._rot._up == m2._rot._up && m1._rot._at == m2._rot._at;
+}
+
+void ModelHierarchy::update(ModelNode *root) {
+	if (root != _root || _version != ModelNode::_hierarchyVersion)
+		build(root);
+
+	// First the local matrices of all the nodes, then the matrices of the
+	// nodes from the parents down. A node that is not initialized is not
+	// updated, and neither are its descendants.
+	for (uint i = 0; i < _entries.size(); ) {
+		Entry &entry = _entries[i];
+		if (!entry._node->_initialized) {
+			i = entry._end;
+			continue;
+		}
+		entry._changed = entry._node->updateLocalMatrix();
+		i++;
 	}
 
-	ModelNode *child = _child;
-	while (child) {
-		child->setMatrix(_matrix);
-		child->update();
+	for (uint i = 0; i < _entries.size(); ) {
+		Entry &entry = _entries[i];
+		ModelNode *node = entry._node;
+		if (!node->_initialized) {
+			i = entry._end;
+			continue;
+		}
+		i++;
 
-		child = child->_sibling;
+		if (entry._parent < 0) {
+			node->_matrix *= node->_localMatrix;
+			entry._changed = !equalMatrices(node->_matrix, node->_updatedMatrix);
+		} else {
+			const Entry &parent = _entries[entry._parent];
+			if (!parent._changed && !entry._changed && !node->_dirty)
+				continue;
+			node->_matrix = parent._node->_matrix;
+			node->_matrix *= node->_localMatrix;
+			entry._changed = true;
+		}
+		node->_dirty = false;
+		node->_updatedMatrix = node->_matrix;
+
+		node->_pivotMatrix = node->_matrix;
+		node->_pivotMatrix.translate(node->_pivot.x(), node->_pivot.y(), node->_pivot.z());
+
+		if (node->_mesh) {
+			node->_mesh->_matrix = node->_pivotMatrix;
+		}
 	}
+
+	// The matrix of the root was set by the caller, and may not be the one
+	// of its parent, so it is updated again by any update of its ancestors
+	root->_dirty = true;
 }
 
 void ModelNode::addSprite(Sprite *sprite) {
@@ -23,6 +23,7 @@
 #ifndef GRIM_MODEL_H
 #define GRIM_MODEL_H
 
+#include "common/array.h"
 #include "common/memstream.h"
 #include "engines/grim/object.h"
 #include "graphics/matrix4.h"
@@ -33,6 +34,7 @@ class TextSplitter;
 class Material;
 class Mesh;
 class ModelNode;
+class ModelHierarchy;
 class CMap;
 
 struct Sprite {
@@ -90,6 +92,7 @@ public:
 	float _radius;
 	int _numHierNodes;
 	ModelNode *_rootHierNode;
+	ModelHierarchy *_hierarchy;	// updates the matrices of _rootHierNode
 	Graphics::Vector3d _bboxPos;
 	Graphics::Vector3d _bboxSize;
 };
@@ -109,6 +112,14 @@ public:
 	Graphics::Vector3d _normal;
 };
 
+// A run of triangles in Mesh::_batchIndices sharing the same material.
+struct MeshBatch {
+	Material *_material;
+	int _materialid;	// -1 for the faces without a material
+	int _firstIndex;
+	int _numIndices;
+};
+
 class Mesh {
 public:
 	void loadBinary(const char *&data, Material *materials[]);
@@ -116,7 +127,8 @@ public:
 	void changeMaterials(Material *materials[]);
 	void draw(int *x1, int *y1, int *x2, int *y2) const;
 	void update();
-	Mesh() : _numFaces(0) { }
+	Mesh() : _numFaces(0), _numBatchVertices(0), _batchVertices(NULL), _numBatchIndices(0),
+		_batchIndices(NULL), _numBatches(0), _batches(NULL), _userData(NULL) { }
 	~Mesh();
 
 	char _name[32];
@@ -135,18 +147,32 @@ public:
 	int _numFaces;
 	MeshFace *_faces;
 	Graphics::Matrix4 _matrix;
+	Graphics::Vector3d _bboxPos;	// bounds of the vertices, for culling
+	Graphics::Vector3d _bboxSize;
+
+	// The faces triangulated once at load time, grouped by material.
+	int _numBatchVertices;
+	float *_batchVertices;	// sets of 8: position, normal, texture coordinate
+	int _numBatchIndices;
+	uint32 *_batchIndices;	// sets of 3
+	int _numBatches;
+	MeshBatch *_batches;
+	void *_userData;		// renderer side copy of the buffers
+
+private:
+	void prepareBatches();
 };
 
 class ModelNode {
 public:
-	ModelNode() : _initialized(false) { }
+	ModelNode() : _initialized(false), _localValid(false), _dirty(true) { }
 	~ModelNode();
 	void loadBinary(const char *&data, ModelNode *hierNodes, const Model::Geoset *g);
 	void draw(int *x1, int *y1, int *x2, int *y2) const;
 	void addChild(ModelNode *child);
 	void removeChild(ModelNode *child);
 	void setMatrix(Graphics::Matrix4 matrix);
-	void update();
+	bool updateLocalMatrix();
 	void addSprite(Sprite *sprite);
 	void removeSprite(Sprite *sprite);
 
@@ -165,6 +191,53 @@ public:
 	Graphics::Matrix4 _localMatrix;
 	Graphics::Matrix4 _pivotMatrix;
 	Sprite* _sprite;
+
+	// The angles _localMatrix was built from, so that its rotation is
+	// only built again when they change
+	float _localPitch, _localYaw, _localRoll;
+	bool _localValid;
+	// Set when _matrix was set from outside of an update, so that the
+	// node is updated even if its parent and local matrix did not change
+	bool _dirty;
+	// The matrix of the node after it was last updated
+	Graphics::Matrix4 _updatedMatrix;
+
+	// Increased whenever a node is added to or removed from a hierarchy
+	static uint32 _hierarchyVersion;
+};
+
+/**
+ * The nodes of a hierarchy, which can span the nodes of several models,
+ * in depth first order with the index of the parent of each one. The
+ * matrices are updated in one pass over them, and the nodes whose parent
+ * and local matrix did not change keep their matrices.
+ */
+class ModelHierarchy {
+public:
+	ModelHierarchy();
+
+	/**
+	 * Updates the matrices of a node and all of its descendants.
+	 * The matrix of the node must have been set to the one of its parent.
+	 * The node list is kept for the next update of the same node, until a
+	 * hierarchy changes anywhere.
+	 */
+	void update(ModelNode *root);
+
+private:
+	struct Entry {
+		ModelNode *_node;
+		int _parent;	// index of the parent, -1 for the root
+		int _end;		// index past the last descendant
+		bool _changed;
+	};
+
+	void build(ModelNode *root);
+	void addNode(ModelNode *node, int parent);
+
+	Common::Array<Entry> _entries;
+	ModelNode *_root;
+	uint32 _version;
 };
 
 } // end of namespace Grim
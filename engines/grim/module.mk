@@ -77,6 +77,11 @@ MODULE_OBJS := \
 	textsplit.o \
 	object.o
 
+ifdef USE_SMUSH
+MODULE_OBJS += \
+	movie/zlib_checkpoints.o
+endif
+
 # This module can be built as a plugin
 ifeq ($(ENABLE_GRIM), DYNAMIC_PLUGIN)
 PLUGIN := 1
@@ -61,8 +61,6 @@ void BinkPlayer::timerCallback(void *) {
 BinkPlayer::BinkPlayer() : MoviePlayer() {
 	g_movie = this;
 	_binkDecoder = new Video::BinkDecoder();
-	_surface = new Graphics::Surface();
-	_externalSurface = new Graphics::Surface();
 	_speed = 1000;
 }
 
@@ -75,25 +73,21 @@ void BinkPlayer::init() {
 	_movieTime = 0;
 	_updateNeeded = false;
 	_videoFinished = false;
-	_width = 0;
-	_height = 0;
+	_width = _binkDecoder->getWidth();
+	_height = _binkDecoder->getHeight();
 	_x = 0;
 	_y = 0;
 
 	assert(!_externalBuffer);
-	
+	allocFrameQueue(_width * _height * _binkDecoder->getPixelFormat().bytesPerPixel);
+
 	g_system->getTimerManager()->installTimerProc(&timerCallback, _speed, NULL);
 }
 
 void BinkPlayer::deinit() {
 	g_system->getTimerManager()->removeTimerProc(&timerCallback);
 	_binkDecoder->close();
-	_surface->free();
-	
-	if (_externalBuffer) {
-		delete[] _externalBuffer;
-		_externalBuffer = NULL;
-	}
+	freeFrameQueue();
 
 	if (_stream) {
 		_stream->finish();
@@ -104,9 +98,6 @@ void BinkPlayer::deinit() {
 }
 
 void BinkPlayer::handleFrame() {
-	if (_binkDecoder->endOfVideo())
-		_videoFinished = true;
-
 	if (_videoPause)
 		return;
 
@@ -116,29 +107,25 @@ void BinkPlayer::handleFrame() {
 		return;
 	}
 
-	if (_binkDecoder->getTimeToNextFrame() > 0)
-		return;
-
-	_surface->copyFrom(*_binkDecoder->decodeNextFrame());
-
-	_width = _surface->w;
-	_height = _surface->h;
-	
-	_internalBuffer = (byte *)_surface->pixels;
-
-	// Avoid updating the _externalBuffer if it's flagged as updateNeeded
-	// since the draw-loop might access it then. This way, any late frames
-	// will be dropped, and the sound will continue, in synch.
-	if (!_updateNeeded) {
-		_externalSurface->copyFrom(*_surface);
-		_externalBuffer = (byte *)_externalSurface->pixels; 
-		_updateNeeded = true;
+	// Decode ahead into the free slots of the frame queue, each frame is
+	// shown when the clock of the decoder reaches its begin time
+	float frameTime = 1000 / _binkDecoder->getFrameRate().toDouble();
+	byte *buffer;
+	while (!_binkDecoder->endOfVideo() && (buffer = getFreeFrame())) {
+		const Graphics::Surface *surface = _binkDecoder->decodeNextFrame();
+		int pitch = _width * surface->format.bytesPerPixel;
+		for (int y = 0; y < _height; y++)
+			memcpy(buffer + y * pitch, (const byte *)surface->pixels + y * surface->pitch, pitch);
+
+		int32 frame = _binkDecoder->getCurFrame();
+		float dueTime = frame * frameTime;
+		queueFrame(frame, dueTime, dueTime);
 	}
-		
-	_movieTime = _binkDecoder->getElapsedTime();
-	_frame = _binkDecoder->getCurFrame();
 
-	return;
+	// The video ends when the last frame was shown for its duration
+	setClock(_binkDecoder->getElapsedTime());
+	if (_binkDecoder->endOfVideo() && _clock >= _binkDecoder->getFrameCount() * frameTime)
+		_videoFinished = true;
 }
 
 void BinkPlayer::stop() {
@@ -39,16 +39,11 @@ namespace Video{
 	class BinkDecoder;
 }
 
-namespace Graphics{
-	struct Surface;
-}
-
 namespace Grim {
 
 class BinkPlayer : public MoviePlayer {
 private:
 	Video::BinkDecoder *_binkDecoder;
-	Graphics::Surface *_surface, *_externalSurface;
 public:
 	BinkPlayer();
 	~BinkPlayer();
@@ -35,6 +35,80 @@ void MoviePlayer::pause(bool p) {
 	g_system->getMixer()->pauseHandle(_soundHandle, p);
 }
 
+bool MoviePlayer::isUpdateNeeded() {
+	Common::StackLock lock(_queueMutex);
+
+	// Show the latest frame that is due, dropping the ones before it
+	// if the drawing fell behind
+	while (_queueCount > 0 && _queue[_queueFirst]._dueTime <= _clock) {
+		QueuedFrame &queued = _queue[_queueFirst];
+		_externalBuffer = queued._buffer;
+		_frame = queued._frame;
+		_movieTime = queued._movieTime;
+		_updateNeeded = true;
+		_queueFirst = (_queueFirst + 1) % kFrameQueueSize;
+		_queueCount--;
+	}
+	return _updateNeeded;
+}
+
+void MoviePlayer::allocFrameQueue(int size) {
+	freeFrameQueue();
+	for (int i = 0; i < kFrameQueueSize; i++)
+		_queue[i]._buffer = new byte[size];
+}
+
+void MoviePlayer::freeFrameQueue() {
+	Common::StackLock lock(_queueMutex);
+
+	for (int i = 0; i < kFrameQueueSize; i++) {
+		if (_externalBuffer == _queue[i]._buffer)
+			_externalBuffer = NULL;
+		delete[] _queue[i]._buffer;
+		_queue[i]._buffer = NULL;
+	}
+	_queueFirst = 0;
+	_queueCount = 0;
+	_clock = 0;
+}
+
+void MoviePlayer::clearFrameQueue() {
+	Common::StackLock lock(_queueMutex);
+
+	// The frame on screen keeps its slot, before _queueFirst
+	_queueCount = 0;
+	_clock = 0;
+}
+
+byte *MoviePlayer::getFreeFrame() {
+	Common::StackLock lock(_queueMutex);
+
+	if (!_queue[0]._buffer || _queueCount >= kFrameQueueSize - 1)
+		return NULL;
+	return _queue[(_queueFirst + _queueCount) % kFrameQueueSize]._buffer;
+}
+
+void MoviePlayer::queueFrame(int32 frame, float dueTime, float movieTime) {
+	Common::StackLock lock(_queueMutex);
+
+	assert(_queueCount < kFrameQueueSize - 1);
+	QueuedFrame &queued = _queue[(_queueFirst + _queueCount) % kFrameQueueSize];
+	queued._frame = frame;
+	queued._dueTime = dueTime;
+	queued._movieTime = movieTime;
+	_queueCount++;
+}
+
+bool MoviePlayer::isFrameQueueEmpty() {
+	Common::StackLock lock(_queueMutex);
+	return _queueCount == 0;
+}
+
+void MoviePlayer::setClock(float time) {
+	Common::StackLock lock(_queueMutex);
+	_clock = time;
+}
+
 // Fallback for when USE_MPEG2 isnt defined, might want to do something similar
 // for USE_BINK if that comes over from ScummVM
 
@@ -26,6 +26,7 @@
 #include <zlib.h>
 
 #include "common/file.h"
+#include "common/mutex.h"
 #include "common/system.h"
 
 #include "audio/mixer.h"
@@ -62,6 +63,29 @@ protected:
 	int _width, _height;
 	byte *_internalBuffer, *_externalBuffer;
 
+	// Frames decoded ahead by the timer callback, waiting to be shown. The
+	// frame on screen stays in the slot just before _queueFirst, so that its
+	// buffer is not written to until the next one replaces it.
+	enum { kFrameQueueSize = 4 };
+	struct QueuedFrame {
+		byte *_buffer;
+		int32 _frame;
+		float _dueTime;		// value of _clock at which the frame is shown
+		float _movieTime;
+	};
+	QueuedFrame _queue[kFrameQueueSize];
+	int _queueFirst, _queueCount;
+	float _clock;
+	Common::Mutex _queueMutex;
+
+	void allocFrameQueue(int size);
+	void freeFrameQueue();
+	void clearFrameQueue();
+	byte *getFreeFrame();
+	void queueFrame(int32 frame, float dueTime, float movieTime);
+	bool isFrameQueueEmpty();
+	void setClock(float time);
+
 public:
 	MoviePlayer() {
 		_internalBuffer = NULL;
@@ -81,6 +105,11 @@ public:
 		_frame = 0;
 		_x = 0;
 		_y = 0;
+		for (int i = 0; i < kFrameQueueSize; i++)
+			_queue[i]._buffer = NULL;
+		_queueFirst = 0;
+		_queueCount = 0;
+		_clock = 0;
 	};
 	virtual ~MoviePlayer() {}
 
@@ -88,7 +117,7 @@ public:
 	virtual void stop() = 0;
 	virtual void pause(bool p);
 	virtual bool isPlaying() { return !_videoFinished; }
-	virtual bool isUpdateNeeded() { return _updateNeeded; }
+	virtual bool isUpdateNeeded();
 	virtual byte *getDstPtr() { return _externalBuffer; }
 	virtual int getX() { return _x; }
 	virtual int getY() { return _y; }
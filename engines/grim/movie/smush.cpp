@@ -39,6 +39,7 @@
 #include "audio/decoders/raw.h"
 
 #include "engines/grim/movie/smush.h"
+#include "engines/grim/movie/zlib_checkpoints.h"
 
 #include "engines/grim/debug.h"
 #include "engines/grim/grim.h"
@@ -74,6 +75,13 @@ SmushPlayer::SmushPlayer() {
 	_IACTpos = 0;
 	_nbframes = 0;
 	_file = 0;
+	_nextFrame = 0;
+	_decodedFrames = 0;
+	_ticks = 0;
+	_decodeFinished = false;
+	_frameData = NULL;
+	_frameDataSize = 0;
+	_lastPicture = NULL;
 }
 
 SmushPlayer::~SmushPlayer() {
@@ -88,13 +96,18 @@ void SmushPlayer::init() {
 	_videoFinished = false;
 	_videoPause = false;
 	_updateNeeded = false;
+	_nextFrame = 0;
+	_decodedFrames = 0;
+	_ticks = 0;
+	_decodeFinished = false;
+	_lastPicture = NULL;
 
 	assert(!_internalBuffer);
 	assert(!_externalBuffer);
 
 	if (!(g_grim->getGameFlags() & ADGF_DEMO)) {
 		_internalBuffer = new byte[_width * _height * 2];
-		_externalBuffer = new byte[_width * _height * 2];
+		allocFrameQueue(_width * _height * 2);
 		vimaInit(smushDestTable);
 	}
 	g_system->getTimerManager()->installTimerProc(&timerCallback, _speed, NULL);
@@ -105,6 +118,7 @@ void SmushPlayer::init() {
 void SmushPlayer::deinit() {
 	g_system->getTimerManager()->removeTimerProc(&timerCallback);
 
+	freeFrameQueue();
 	if (_internalBuffer) {
 		delete[] _internalBuffer;
 		_internalBuffer = NULL;
@@ -126,6 +140,10 @@ void SmushPlayer::deinit() {
 	_videoLooping = false;
 	_videoFinished = true;
 	_videoPause = true;
+	_index.clear();
+	delete[] _frameData;
+	_frameData = NULL;
+	_frameDataSize = 0;
 	if (g_grim->getGameFlags() & ADGF_DEMO)
 		_f.close();
 	else if (_file) {
@@ -154,10 +172,6 @@ void SmushPlayer::handleWave(const byte *src, uint32 size) {
 }
 
 void SmushPlayer::handleFrame() {
-	uint32 tag;
-	int32 size;
-	int pos = 0;
-
 	if (_videoPause)
 		return;
 
@@ -166,15 +180,60 @@ void SmushPlayer::handleFrame() {
 		return;
 	}
 
-	if (_frame == _nbframes) {
-		// If the video has been looping and was previously on the last
-		// frame then reset the frame number and the movie time, this
-		// needs to occur at the beginning so the last frame has time to
-		// render appropriately
-		_frame = 1;
-		_movieTime = 0;
+	// The clock is the time of this tick, so the frame decoded now is due
+	// now, together with the sound queued while decoding it
+	setClock(_ticks * _speed / 1000.f);
+	_ticks++;
+
+	// Decode one frame per tick at most, the timer thread also runs iMUSE.
+	// When the main thread falls behind, the frames wait in the queue.
+	byte *buffer = _decodeFinished ? NULL : getFreeFrame();
+	if (buffer && _nextFrame == _nbframes) {
+		// If we're not supposed to loop (or looping fails) then stop
+		// decoding, the video ends when the last frame was shown
+		if (!_videoLooping || !_file->seek(_startPos->filePos, SEEK_SET)) {
+			_decodeFinished = true;
+			buffer = NULL;
+		} else {
+			_nextFrame = 0;
+		}
+	}
+
+	if (buffer) {
+		int32 size;
+		int32 pos = _file->pos();
+		const byte *frame = readFrame(&size);
+		if (_nextFrame == (int32)_index.size()) {
+			IndexEntry entry;
+			entry._pos = pos;
+			entry._keyFrame = isKeyFrame(frame, size);
+			_index.push_back(entry);
+		}
+		// Blocky16 decodes straight into the queued buffer. A frame without
+		// a picture repeats the one decoded last.
+		if (!decodeFrame(buffer, frame, size, true)) {
+			if (_lastPicture)
+				memcpy(buffer, _lastPicture, _width * _height * 2);
+			else
+				memset(buffer, 0, _width * _height * 2);
+		}
+		_lastPicture = buffer;
+
+		_nextFrame++;
+		queueFrame(_nextFrame, _decodedFrames * _speed / 1000.f, _nextFrame * _speed / 1000.f);
+		_decodedFrames++;
 	}
 
+	if (_decodeFinished && _clock >= _decodedFrames * _speed / 1000.f) {
+		_videoFinished = true;
+		g_grim->setMode(ENGINE_MODE_NORMAL);
+	}
+}
+
+const byte *SmushPlayer::readFrame(int32 *frameSize) {
+	uint32 tag;
+	int32 size;
+
 	tag = _file->readUint32BE();
 	if (tag == MKTAG('A','N','N','O')) {
 		char *anno;
@@ -210,39 +269,104 @@ void SmushPlayer::handleFrame() {
 
 	assert(tag == MKTAG('F','R','M','E'));
 	size = _file->readUint32BE();
-	byte *frame = new byte[size];
-	_file->read(frame, size);
+	if (size > _frameDataSize) {
+		delete[] _frameData;
+		_frameData = new byte[size];
+		_frameDataSize = size;
+	}
+	_file->read(_frameData, size);
+
+	*frameSize = size;
+	return _frameData;
+}
+
+bool SmushPlayer::decodeFrame(byte *dst, const byte *frame, int32 size, bool sound) {
+	bool picture = false;
+	int pos = 0;
 
 	do {
 		if (READ_BE_UINT32(frame + pos) == MKTAG('B','l','1','6')) {
-			_blocky16.decode(_internalBuffer, frame + pos + 8);
+			_blocky16.decode(dst, frame + pos + 8);
+			picture = true;
 			pos += READ_BE_UINT32(frame + pos + 4) + 8;
 		} else if (READ_BE_UINT32(frame + pos) == MKTAG('W','a','v','e')) {
-			int decompressed_size = READ_BE_UINT32(frame + pos + 8);
-			if (decompressed_size < 0)
-				handleWave(frame + pos + 8 + 4 + 8, READ_BE_UINT32(frame + pos + 8 + 8));
-			else
-				handleWave(frame + pos + 8 + 4, decompressed_size);
+			if (sound) {
+				int decompressed_size = READ_BE_UINT32(frame + pos + 8);
+				if (decompressed_size < 0)
+					handleWave(frame + pos + 8 + 4 + 8, READ_BE_UINT32(frame + pos + 8 + 8));
+				else
+					handleWave(frame + pos + 8 + 4, decompressed_size);
+			}
 			pos += READ_BE_UINT32(frame + pos + 4) + 8;
 		} else if (gDebugLevel == DEBUG_SMUSH || gDebugLevel == DEBUG_ERROR || gDebugLevel == DEBUG_ALL) {
 			error("SmushPlayer::handleFrame() unknown tag");
 		}
 	} while (pos < size);
-	delete[] frame;
+	return picture;
+}
 
-	memcpy(_externalBuffer, _internalBuffer, _width * _height * 2);
-	_updateNeeded = true;
+bool SmushPlayer::isKeyFrame(const byte *frame, int32 size) {
+	int pos = 0;
 
-	_frame++;
-	_movieTime += _speed / 1000.f;
-	if (_frame == _nbframes) {
-		// If we're not supposed to loop (or looping fails) then end the video
-		if (!_videoLooping || !_file->seek(_startPos->filePos, SEEK_SET)) {
-			_videoFinished = true;
-			g_grim->setMode(ENGINE_MODE_NORMAL);
-			return;
+	// Blocky16 resets its buffers on sequence number 0, so the video can
+	// be decoded from there without the frames before
+	while (pos + 8 + 18 <= size) {
+		if (READ_BE_UINT32(frame + pos) == MKTAG('B','l','1','6'))
+			return READ_LE_UINT16(frame + pos + 8 + 16) == 0;
+		pos += READ_BE_UINT32(frame + pos + 4) + 8;
+	}
+	return false;
+}
+
+bool SmushPlayer::seekToFrame(int32 frame) {
+	if (frame < 0 || frame >= _nbframes)
+		return false;
+
+	// Extend the index up to the frame, reading the frames after the
+	// last one indexed. The first frame is indexed when the video starts.
+	if ((int32)_index.size() <= frame) {
+		if (_index.empty())
+			return false;
+		int32 size;
+		_file->seek(_index.back()._pos, SEEK_SET);
+		readFrame(&size);
+		while ((int32)_index.size() <= frame) {
+			IndexEntry entry;
+			entry._pos = _file->pos();
+			const byte *data = readFrame(&size);
+			entry._keyFrame = isKeyFrame(data, size);
+			if (_file->err())
+				return false;
+			_index.push_back(entry);
 		}
 	}
+
+	// Decode the frames from the closest key frame on, without playing
+	// their sound, then show the wanted one with the sound from there
+	int32 first = frame;
+	while (first > 0 && !_index[first]._keyFrame)
+		first--;
+	_file->seek(_index[first]._pos, SEEK_SET);
+	for (int32 i = first; i < frame; i++) {
+		int32 size;
+		const byte *data = readFrame(&size);
+		if (decodeFrame(_internalBuffer, data, size, false))
+			_lastPicture = _internalBuffer;
+	}
+
+	if (_stream) {
+		_stream->finish();
+		_stream = NULL;
+		g_system->getMixer()->stopHandle(_soundHandle);
+	}
+	clearFrameQueue();
+	_nextFrame = frame;
+	_decodedFrames = 0;
+	_ticks = 0;
+	_decodeFinished = false;
+	_videoFinished = false;
+	handleFrame();
+	return true;
 }
 
 static byte delta_color(byte org_color, int16 delta_color) {
@@ -467,7 +591,7 @@ bool SmushPlayer::setupAnim(const char *file, bool looping, int x, int y) {
 	int32 size;
 	int16 flags;
 
-	_file = wrapCompressedReadStream(g_resourceloader->openNewSubStreamFile(file));
+	_file = wrapCheckpointedReadStream(g_resourceloader->openNewSubStreamFile(file));
 	if (!_file)
 		return false;
 
@@ -575,8 +699,12 @@ void SmushPlayer::restoreState(SaveGame *state) {
 	int x = state->readLESint32();
 	int y = state->readLESint32();
 
-	if (!videoFinished) {
-		play(_fname.c_str(), videoLooping, x, y);
+	if (!videoFinished && play(_fname.c_str(), videoLooping, x, y)) {
+		// Show the picture the video was at, instead of starting it over
+		if (frame > 0 && !(g_grim->getGameFlags() & ADGF_DEMO)) {
+			Common::StackLock lock(_frameMutex);
+			seekToFrame(frame - 1);
+		}
 	}
 	_frame = frame;
 	_movieTime = movieTime;
@@ -23,7 +23,7 @@
 #ifndef GRIM_SMUSH_PLAYER_H
 #define GRIM_SMUSH_PLAYER_H
 
-#include "common/zlib.h"
+#include "common/array.h"
 #include "common/file.h"
 
 #include "engines/grim/movie/movie.h"
@@ -56,6 +56,20 @@ private:
 	byte _IACToutput[4096];
 	int32 _IACTpos;
 
+	struct IndexEntry {
+		int32 _pos;			// position of the frame in _file
+		bool _keyFrame;		// the video can be decoded from here on
+	};
+	Common::Array<IndexEntry> _index;	// the frames read so far
+
+	int32 _nextFrame;			// the frame decoded next
+	int32 _decodedFrames;		// frames queued since the clock was reset
+	int32 _ticks;				// timer ticks since the clock was reset
+	bool _decodeFinished;
+	byte *_frameData;			// reused by readFrame
+	int32 _frameDataSize;
+	const byte *_lastPicture;	// the last frame Blocky16 decoded into
+
 public:
 	SmushPlayer();
 	virtual ~SmushPlayer();
@@ -75,6 +89,10 @@ private:
 	void handleFramesHeader();
 	void handleFrameDemo();
 	void handleFrame();
+	const byte *readFrame(int32 *size);
+	bool decodeFrame(byte *dst, const byte *frame, int32 size, bool sound);
+	bool isKeyFrame(const byte *frame, int32 size);
+	bool seekToFrame(int32 frame);
 	void handleBlocky16(byte *src);
 	void handleWave(const byte *src, uint32 size);
 	void handleIACT(const byte *src, int32 size);
@@ -0,0 +1,218 @@
+/* Residual - A 3D game interpreter
+ *
+ * Residual is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ *
+ */
+
+// Disable symbol overrides so that we can use zlib.h
+#define FORBIDDEN_SYMBOL_ALLOW_ALL
+
+#include "common/array.h"
+
+#include "engines/grim/movie/zlib_checkpoints.h"
+
+#ifdef USE_SMUSH
+
+#if defined(USE_ZLIB)
+#include <zlib.h>
+#endif
+
+namespace Grim {
+
+#if defined(USE_ZLIB)
+
+class CheckpointedZlibStream : public Common::SeekableReadStream {
+public:
+	CheckpointedZlibStream(Common::SeekableReadStream *wrapped);
+	~CheckpointedZlibStream();
+
+	bool err() const { return (_zlibErr != Z_OK) && (_zlibErr != Z_STREAM_END); }
+	void clearErr() { _eos = false; }
+	uint32 read(void *dataPtr, uint32 dataSize);
+	bool eos() const { return _eos; }
+	int32 pos() const { return _pos; }
+	int32 size() const { return _origSize; }
+	bool seek(int32 offset, int whence = SEEK_SET);
+
+private:
+	enum {
+		BUFSIZE = 16384,
+		CHECKPOINT_INTERVAL = 1024 * 1024	// bytes of output between two checkpoints
+	};
+
+	struct Checkpoint {
+		uint32 pos;			// position in the decompressed data
+		int32 inputPos;		// position in the wrapped stream
+		z_stream stream;	// must not move, zlib keeps a pointer back to it
+	};
+
+	void addCheckpoint();
+	bool restoreCheckpoint(const Checkpoint *checkpoint);
+
+	byte _buf[BUFSIZE];
+	Common::SeekableReadStream *_wrapped;
+	z_stream _stream;
+	int _zlibErr;
+	uint32 _pos;
+	uint32 _origSize;
+	bool _eos;
+	Common::Array<Checkpoint *> _checkpoints;	// sorted by position
+};
+
+CheckpointedZlibStream::CheckpointedZlibStream(Common::SeekableReadStream *wrapped) : _wrapped(wrapped) {
+	_stream.zalloc = Z_NULL;
+	_stream.zfree = Z_NULL;
+	_stream.opaque = Z_NULL;
+
+	uint16 header = _wrapped->readUint16BE();
+	if (header == 0x1F8B) {
+		// Retrieve the original file size
+		_wrapped->seek(-4, SEEK_END);
+		_origSize = _wrapped->readUint32LE();
+	} else {
+		// Original size not available in zlib format
+		_origSize = 0;
+	}
+	_wrapped->seek(0, SEEK_SET);
+	_pos = 0;
+	_eos = false;
+
+	// Let zlib detect whether gzip or zlib headers are used
+	_zlibErr = inflateInit2(&_stream, MAX_WBITS + 32);
+	if (_zlibErr != Z_OK)
+		return;
+
+	_stream.next_in = _buf;
+	_stream.avail_in = 0;
+	addCheckpoint();
+}
+
+CheckpointedZlibStream::~CheckpointedZlibStream() {
+	for (uint i = 0; i < _checkpoints.size(); i++) {
+		inflateEnd(&_checkpoints[i]->stream);
+		delete _checkpoints[i];
+	}
+	inflateEnd(&_stream);
+	delete _wrapped;
+}
+
+uint32 CheckpointedZlibStream::read(void *dataPtr, uint32 dataSize) {
+	_stream.next_out = (byte *)dataPtr;
+	_stream.avail_out = dataSize;
+
+	while (_zlibErr == Z_OK && _stream.avail_out) {
+		if (_stream.avail_in == 0 && !_wrapped->eos()) {
+			_stream.next_in = _buf;
+			_stream.avail_in = _wrapped->read(_buf, BUFSIZE);
+		}
+		_zlibErr = inflate(&_stream, Z_NO_FLUSH);
+	}
+
+	_pos += dataSize - _stream.avail_out;
+
+	if (_zlibErr == Z_STREAM_END && _stream.avail_out > 0)
+		_eos = true;
+
+	if (_zlibErr == Z_OK && !_checkpoints.empty() && _pos >= _checkpoints.back()->pos + CHECKPOINT_INTERVAL)
+		addCheckpoint();
+
+	return dataSize - _stream.avail_out;
+}
+
+bool CheckpointedZlibStream::seek(int32 offset, int whence) {
+	int32 newPos = 0;
+	assert(whence != SEEK_END);	// SEEK_END not supported
+	switch (whence) {
+	case SEEK_SET:
+		newPos = offset;
+		break;
+	case SEEK_CUR:
+		newPos = _pos + offset;
+	}
+
+	assert(newPos >= 0);
+
+	// Start again from the last checkpoint before the new position, unless
+	// the current position is already between the two
+	const Checkpoint *checkpoint = NULL;
+	for (uint i = 0; i < _checkpoints.size() && _checkpoints[i]->pos <= (uint32)newPos; i++)
+		checkpoint = _checkpoints[i];
+	if (checkpoint && ((uint32)newPos < _pos || checkpoint->pos > _pos)) {
+		if (!restoreCheckpoint(checkpoint))
+			return false;
+	}
+
+	byte tmpBuf[4096];
+	offset = newPos - _pos;
+	while (!err() && offset > 0) {
+		uint32 skipped = read(tmpBuf, MIN((int32)sizeof(tmpBuf), offset));
+		if (skipped == 0)
+			break;
+		offset -= skipped;
+	}
+
+	_eos = false;
+	return !err();
+}
+
+void CheckpointedZlibStream::addCheckpoint() {
+	Checkpoint *checkpoint = new Checkpoint;
+	checkpoint->pos = _pos;
+	checkpoint->inputPos = _wrapped->pos() - _stream.avail_in;
+	if (inflateCopy(&checkpoint->stream, &_stream) != Z_OK) {
+		delete checkpoint;
+		return;
+	}
+	_checkpoints.push_back(checkpoint);
+}
+
+bool CheckpointedZlibStream::restoreCheckpoint(const Checkpoint *checkpoint) {
+	inflateEnd(&_stream);
+	// inflateCopy doesn't change the source, zlib just doesn't declare it const
+	_zlibErr = inflateCopy(&_stream, const_cast<z_stream *>(&checkpoint->stream));
+	if (_zlibErr != Z_OK)
+		return false;
+
+	_wrapped->seek(checkpoint->inputPos, SEEK_SET);
+	_stream.next_in = _buf;
+	_stream.avail_in = 0;
+	_pos = checkpoint->pos;
+	_eos = false;
+	return true;
+}
+
+#endif // USE_ZLIB
+
+Common::SeekableReadStream *wrapCheckpointedReadStream(Common::SeekableReadStream *toBeWrapped) {
+#if defined(USE_ZLIB)
+	if (toBeWrapped) {
+		uint16 header = toBeWrapped->readUint16BE();
+		bool isCompressed = (header == 0x1F8B ||
+							 ((header & 0x0F00) == 0x0800 && header % 31 == 0));
+		toBeWrapped->seek(-2, SEEK_CUR);
+		if (isCompressed)
+			return new CheckpointedZlibStream(toBeWrapped);
+	}
+#endif
+	return toBeWrapped;
+}
+
+} // end of namespace Grim
+
+#endif // USE_SMUSH
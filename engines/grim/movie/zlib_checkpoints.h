@@ -0,0 +1,50 @@
+/* Residual - A 3D game interpreter
+ *
+ * Residual is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ *
+ */
+
+#ifndef GRIM_ZLIB_CHECKPOINTS_H
+#define GRIM_ZLIB_CHECKPOINTS_H
+
+#include "common/stream.h"
+
+#ifdef USE_SMUSH
+
+namespace Grim {
+
+/**
+ * Wraps a stream that may be compressed with zlib or gzip, like
+ * Common::wrapCompressedReadStream does, but keeps a copy of the
+ * decompressor state every megabyte of output. A seek, backward too,
+ * then starts decompressing again from the closest copy before the wanted
+ * position instead of from the start of the stream.
+ * Streams that aren't compressed, or all of them without zlib, are
+ * returned as they are.
+ *
+ * @param toBeWrapped	the stream to be wrapped, owned by the result
+ * @return the wrapped stream
+ */
+Common::SeekableReadStream *wrapCheckpointedReadStream(Common::SeekableReadStream *toBeWrapped);
+
+} // end of namespace Grim
+
+#endif // USE_SMUSH
+
+#endif
@@ -20,6 +20,11 @@
  *
  */
 
+#define FORBIDDEN_SYMBOL_EXCEPTION_printf
+
+#include "common/config-manager.h"
+#include "common/timer.h"
+
 #include "engines/grim/resource.h"
 #include "engines/grim/colormap.h"
 #include "engines/grim/costume.h"
@@ -32,15 +37,27 @@
 #include "engines/grim/bitmap.h"
 #include "engines/grim/font.h"
 #include "engines/grim/model.h"
+#include "engines/grim/debug.h"
+#include "engines/grim/textsplit.h"
 
 namespace Grim {
 
 ResourceLoader *g_resourceloader = NULL;
 
+enum {
+	kPrefetchInterval = 10000,		// Timer period in microseconds
+	// Bytes read or paged in per timer tick. The timer thread also runs
+	// iMUSE, so a tick must not block it for long.
+	kPrefetchChunkSize = 16 * 1024
+};
+
 ResourceLoader::ResourceLoader() {
 	int lab_counter = 0;
-	_cacheDirty = false;
 	_cacheMemorySize = 0;
+	_cacheMemoryBudget = ConfMan.getInt("resource_cache_size") * 1024;
+	_cacheHits = 0;
+	_cacheMisses = 0;
+	_cacheEvictions = 0;
 
 	Lab *l;
 	Common::ArchiveMemberList files;
@@ -83,6 +100,11 @@ ResourceLoader::ResourceLoader() {
 			}
 		}
 	}
+
+	buildIndex();
+
+	_prefetchBusy = false;
+	g_system->getTimerManager()->installTimerProc(prefetchHandler, kPrefetchInterval, this);
 }
 
 template<typename T>
@@ -95,122 +117,302 @@ void clearList(Common::List<T> &list) {
 }
 
 ResourceLoader::~ResourceLoader() {
-	for (Common::Array<ResourceCache>::iterator i = _cache.begin(); i != _cache.end(); ++i) {
-		ResourceCache &r = *i;
-		delete[] r.fname;
-		delete r.resPtr;
-	}
+	if (gDebugLevel == DEBUG_NORMAL || gDebugLevel == DEBUG_ALL)
+		printf("Resource cache: %u hits, %u misses, %u evictions\n", _cacheHits, _cacheMisses, _cacheEvictions);
+
+	g_system->getTimerManager()->removeTimerProc(prefetchHandler);
+	if (_prefetchBusy)
+		freePrefetchRequest(_prefetchCurrent);
+	for (PrefetchList::iterator i = _prefetchQueue.begin(); i != _prefetchQueue.end(); ++i)
+		freePrefetchRequest(*i);
+	for (PrefetchList::iterator i = _prefetchDone.begin(); i != _prefetchDone.end(); ++i)
+		freePrefetchRequest(*i);
+
+	while (!_lru.empty())
+		removeFromCache(_lru.front());
+
+	// Deleting an object removes it from its entry through the uncache functions
+	for (ResourceIndex::iterator i = _index.begin(); i != _index.end(); ++i)
+		clearList(i->_value.objects);
+
 	clearList(_labs);
-	clearList(_models);
-	clearList(_colormaps);
-	clearList(_keyframeAnims);
-	clearList(_lipsyncs);
 }
 
-const Lab *ResourceLoader::getLab(const Common::String &filename) const {
-	for (LabList::const_iterator i = _labs.begin(); i != _labs.end(); ++i)
-		if ((*i)->getFileExists(filename))
-			return *i;
+void ResourceLoader::buildIndex() {
+	for (LabList::const_iterator l = _labs.begin(); l != _labs.end(); ++l) {
+		const Lab::LabMap &files = (*l)->getFiles();
+		for (Lab::LabMap::const_iterator f = files.begin(); f != files.end(); ++f) {
+			// The first archive containing a file wins, data005.lab is at the front
+			if (_index.contains(f->_key))
+				continue;
 
-	return NULL;
+			ResourceEntry &entry = _index[f->_key];
+			entry.lab = *l;
+			entry.location = f->_value;
+		}
+	}
 }
 
-static int sortCallback(const void *entry1, const void *entry2) {
-	return scumm_stricmp(((ResourceLoader::ResourceCache *)entry1)->fname, ((ResourceLoader::ResourceCache *)entry2)->fname);
+ResourceLoader::ResourceEntry *ResourceLoader::getEntry(const Common::String &filename) {
+	ResourceIndex::iterator i = _index.find(filename);
+	if (i == _index.end())
+		return NULL;
+	return &i->_value;
 }
 
-Block *ResourceLoader::getFileFromCache(const Common::String &filename) {
-	ResourceLoader::ResourceCache *entry = getEntryFromCache(filename);
-	if (entry)
-		return entry->resPtr;
-	else
+const ResourceLoader::ResourceEntry *ResourceLoader::getEntry(const Common::String &filename) const {
+	ResourceIndex::const_iterator i = _index.find(filename);
+	if (i == _index.end())
 		return NULL;
+	return &i->_value;
 }
 
-ResourceLoader::ResourceCache *ResourceLoader::getEntryFromCache(const Common::String &filename) {
-	if (_cache.empty())
+Block *ResourceLoader::getFileFromCache(const Common::String &filename) {
+	ResourceEntry *entry = getEntry(filename);
+	// Pick up what the prefetcher has finished in the meantime
+	if (entry && !entry->block && entry->prefetching)
+		flushPrefetched();
+
+	if (entry && entry->block) {
+		++_cacheHits;
+		_lru.erase(entry->lruPos);
+		_lru.push_back(entry);
+		entry->lruPos = _lru.reverse_begin();
+		return entry->block;
+	} else {
+		++_cacheMisses;
 		return NULL;
-
-	if (_cacheDirty) {
-		qsort(_cache.begin(), _cache.size(), sizeof(ResourceCache), sortCallback);
-		_cacheDirty = false;
 	}
-
-	ResourceCache key;
-	key.fname = const_cast<char *>(filename.c_str());
-
-	return (ResourceLoader::ResourceCache *)bsearch(&key, _cache.begin(), _cache.size(), sizeof(ResourceCache), sortCallback);
 }
 
 bool ResourceLoader::getFileExists(const Common::String &filename) const {
-	return getLab(filename) != NULL;
+	return getEntry(filename) != NULL;
 }
 
 Block *ResourceLoader::getFileBlock(const Common::String &filename) const {
-	const Lab *l = getLab(filename);
-	if (!l)
+	const ResourceEntry *entry = getEntry(filename);
+	if (!entry)
 		return NULL;
 	else
-		return l->getFileBlock(filename);
+		return entry->lab->getFileBlock(entry->location);
 }
 
 Block *ResourceLoader::getBlock(const Common::String &filename) {
-    Common::String fname = filename;
-    fname.toLowercase();
-    Block *b = getFileFromCache(fname);
-    if (!b) {
-        b = getFileBlock(fname);
+	Block *b = getFileFromCache(filename);
+	if (!b) {
+		b = getFileBlock(filename);
 		if (b) {
-			putIntoCache(fname, b);
+			putIntoCache(filename, b);
 		}
-    }
+	}
 
-    return b;
+	return b;
 }
 
 LuaFile *ResourceLoader::openNewStreamLuaFile(const char *filename) const {
-	const Lab *l = getLab(filename);
+	const ResourceEntry *entry = getEntry(filename);
 
-	if (!l)
+	if (!entry)
 		return NULL;
 	else
-		return l->openNewStreamLua(filename);
+		return entry->lab->openNewStreamLua(entry->location);
 }
 
-Common::File *ResourceLoader::openNewStreamFile(const char *filename) const {
-	const Lab *l = getLab(filename);
+Common::SeekableReadStream *ResourceLoader::openNewStreamFile(const char *filename) const {
+	const ResourceEntry *entry = getEntry(filename);
 
-	if (!l)
+	if (!entry)
 		return NULL;
 	else
-		return l->openNewStreamFile(filename);
+		return entry->lab->openNewStreamFile(entry->location);
 }
 
 Common::SeekableReadStream *ResourceLoader::openNewSubStreamFile(const char *filename) const {
-	const Lab *l = getLab(filename);
+	const ResourceEntry *entry = getEntry(filename);
 
-	if (!l)
+	if (!entry)
 		return NULL;
 	else
-		return l->openNewSubStreamFile(filename);
+		return entry->lab->openNewSubStreamFile(entry->location);
 }
 
 int ResourceLoader::getFileLength(const char *filename) const {
-	const Lab *l = getLab(filename);
-	if (l)
-		return l->getFileLength(filename);
+	const ResourceEntry *entry = getEntry(filename);
+	if (entry)
+		return entry->location.len;
 	else
 		return 0;
 }
 
 void ResourceLoader::putIntoCache(const Common::String &fname, Block *res) {
-	ResourceCache entry;
-	entry.resPtr = res;
-	entry.fname = new char[fname.size() + 1];
-	strcpy(entry.fname, fname.c_str());
-	_cacheMemorySize += res->getLen();
-	_cache.push_back(entry);
-	_cacheDirty = true;
+	putIntoCache(getEntry(fname), res);
+}
+
+void ResourceLoader::putIntoCache(ResourceEntry *entry, Block *res) {
+	assert(entry && !entry->block);
+
+	// Blocks viewing a mapped Lab don't hold any memory of their own
+	int32 size = res->isOwned() ? res->getLen() : 0;
+	trimCache(size);
+
+	entry->block = res;
+	_cacheMemorySize += size;
+	_lru.push_back(entry);
+	entry->lruPos = _lru.reverse_begin();
+}
+
+void ResourceLoader::removeFromCache(ResourceEntry *entry) {
+	if (!entry->block)
+		return;
+
+	if (entry->block->isOwned())
+		_cacheMemorySize -= entry->block->getLen();
+	delete entry->block;
+	entry->block = NULL;
+	_lru.erase(entry->lruPos);
+}
+
+void ResourceLoader::trimCache(int32 reserve) {
+	if (_cacheMemoryBudget <= 0)
+		return;
+
+	ResourceList::iterator i = _lru.begin();
+	while (_cacheMemorySize + reserve > _cacheMemoryBudget && i != _lru.end()) {
+		ResourceEntry *entry = *i;
+		++i;
+		if (entry->refCount > 0 || !entry->block->isOwned())
+			continue;
+
+		removeFromCache(entry);
+		++_cacheEvictions;
+	}
+}
+
+void ResourceLoader::pinBlock(const Common::String &fname) {
+	ResourceEntry *entry = getEntry(fname);
+	if (entry)
+		++entry->refCount;
+}
+
+void ResourceLoader::unpinBlock(const Common::String &fname) {
+	ResourceEntry *entry = getEntry(fname);
+	if (entry && entry->refCount > 0)
+		--entry->refCount;
+}
+
+void ResourceLoader::prefetch(const Common::String &fname) {
+	ResourceEntry *entry = getEntry(fname);
+	if (!entry || entry->block || entry->prefetching)
+		return;
+
+	PrefetchRequest r;
+	r.entry = entry;
+	r.stream = NULL;
+	r.data = NULL;
+	r.block = NULL;
+	r.pos = 0;
+	// Opening files goes through SearchMan, so it's done here and not in the timer
+	if (entry->lab->isMapped()) {
+		r.block = entry->lab->getFileBlock(entry->location);
+	} else {
+		r.stream = entry->lab->openNewStreamFile(entry->location);
+		if (!r.stream)
+			return;
+		r.data = new char[entry->location.len];
+	}
+	entry->prefetching = true;
+
+	Common::StackLock lock(_prefetchMutex);
+	_prefetchQueue.push_back(r);
+}
+
+void ResourceLoader::prefetchScene(const Common::String &fname) {
+	Block *b = getBlock(fname);
+	if (!b)
+		return;
+
+	// Only text sets are looked into, binary ones are just read
+	if (b->getLen() < 7 || memcmp(b->getData(), "section", 7) != 0)
+		return;
+
+	TextSplitter ts(b->getData(), b->getLen());
+	char buf[256];
+	while (!ts.isEof()) {
+		const char *line = ts.getCurrentLine();
+		if (sscanf(line, " colormap %255s", buf) == 1 || sscanf(line, " background %255s", buf) == 1)
+			prefetch(buf);
+		else if (sscanf(line, " zbuffer %255s", buf) == 1 && strcmp(buf, "<none>.lbm") != 0)
+			prefetch(buf);
+		ts.nextLine();
+	}
+}
+
+void ResourceLoader::flushPrefetched() {
+	PrefetchList done;
+	{
+		Common::StackLock lock(_prefetchMutex);
+		if (_prefetchDone.empty())
+			return;
+		done = _prefetchDone;
+		_prefetchDone.clear();
+	}
+
+	for (PrefetchList::iterator i = done.begin(); i != done.end(); ++i) {
+		ResourceEntry *entry = i->entry;
+		entry->prefetching = false;
+		// It was loaded the usual way while the prefetcher was at it
+		if (entry->block)
+			delete i->block;
+		else
+			putIntoCache(entry, i->block);
+	}
+}
+
+void ResourceLoader::prefetchHandler(void *refCon) {
+	((ResourceLoader *)refCon)->prefetchStep();
+}
+
+void ResourceLoader::prefetchStep() {
+	if (!_prefetchBusy) {
+		Common::StackLock lock(_prefetchMutex);
+		if (_prefetchQueue.empty())
+			return;
+		_prefetchCurrent = _prefetchQueue.front();
+		_prefetchQueue.pop_front();
+		_prefetchBusy = true;
+	}
+
+	PrefetchRequest &r = _prefetchCurrent;
+	const int len = r.entry->location.len;
+	int end = MIN(r.pos + kPrefetchChunkSize, len);
+	if (r.stream) {
+		r.stream->read(r.data + r.pos, end - r.pos);
+	} else {
+		// Fault the pages of the mapping in, so the main thread doesn't have to
+		const volatile char *data = r.block->getData();
+		for (int i = r.pos; i < end; i += 4096)
+			(void)data[i];
+	}
+	r.pos = end;
+	if (r.pos < len)
+		return;
+
+	if (r.stream) {
+		delete r.stream;
+		r.stream = NULL;
+		r.block = new Block(r.data, len);
+		r.data = NULL;
+	}
+
+	Common::StackLock lock(_prefetchMutex);
+	_prefetchDone.push_back(r);
+	_prefetchBusy = false;
+}
+
+void ResourceLoader::freePrefetchRequest(PrefetchRequest &r) {
+	delete r.stream;
+	delete[] r.data;
+	delete r.block;
 }
 
 Bitmap *ResourceLoader::loadBitmap(const Common::String &filename) {
@@ -242,7 +444,7 @@ CMap *ResourceLoader::loadColormap(const Common::String &filename) {
 	}
 
 	CMap *result = new CMap(filename, b->getData(), b->getLen());
-	_colormaps.push_back(result);
+	getEntry(filename)->objects.push_back(result);
 
 	return result;
 }
@@ -273,7 +475,10 @@ Costume *ResourceLoader::loadCostume(const Common::String &filename, Costume *pr
 			error("Could not find costume \"%s\"", filename.c_str());
 		putIntoCache(fname, b);
 	}
+	// Loading the costume loads other resources, keep the block around meanwhile
+	pinBlock(fname);
 	Costume *result = new Costume(filename, b->getData(), b->getLen(), prevCost);
+	unpinBlock(fname);
 
 	return result;
 }
@@ -301,8 +506,9 @@ KeyframeAnim *ResourceLoader::loadKeyframe(const Common::String &filename) {
 		putIntoCache(filename, b);
 	}
 
+	pinBlock(filename);
 	KeyframeAnim *result = new KeyframeAnim(filename, b->getData(), b->getLen());
-	_keyframeAnims.push_back(result);
+	getEntry(filename)->objects.push_back(result);
 
 	return result;
 }
@@ -324,7 +530,7 @@ LipSync *ResourceLoader::loadLipSync(const Common::String &filename) {
 	if (result->isValid()) {
 		if (!cached)
 			putIntoCache(filename, b);
-		_lipsyncs.push_back(result);
+		getEntry(filename)->objects.push_back(result);
 	} else {
 		delete result;
 		delete b;
@@ -342,9 +548,10 @@ Material *ResourceLoader::loadMaterial(const Common::String &filename, CMap *c)
 		b = getFileBlock(fname);
 		if (!b)
 			error("Could not find material %s", filename.c_str());
-		putIntoCache(filename, b);
+		putIntoCache(fname, b);
 	}
 
+	pinBlock(fname);
 	Material *result = new Material(fname, b->getData(), b->getLen(), c);
 
 	return result;
@@ -360,55 +567,56 @@ Model *ResourceLoader::loadModel(const Common::String &filename, CMap *c, Model
 		putIntoCache(fname, b);
 	}
 
+	pinBlock(fname);
 	Model *result = new Model(filename, b->getData(), b->getLen(), c, parent);
-	_models.push_back(result);
+	getEntry(fname)->objects.push_back(result);
 
 	return result;
 }
 
 void ResourceLoader::uncache(const char *filename) {
-	Common::String fname = filename;
-	fname.toLowercase();
-
-	if (_cacheDirty) {
-		qsort(_cache.begin(), _cache.size(), sizeof(ResourceCache), sortCallback);
-		_cacheDirty = false;
-	}
+	ResourceEntry *entry = getEntry(filename);
+	if (entry)
+		removeFromCache(entry);
+}
 
-	for (unsigned int i = 0; i < _cache.size(); i++) {
-		if (fname.compareTo(_cache[i].fname) == 0) {
-			delete[] _cache[i].fname;
-			_cacheMemorySize -= _cache[i].resPtr->getLen();
-			delete _cache[i].resPtr;
-			_cache.remove_at(i);
-			_cacheDirty = true;
-		}
-	}
+void ResourceLoader::uncacheObject(const Common::String &fname, Object *o) {
+	ResourceEntry *entry = getEntry(fname);
+	if (entry)
+		entry->objects.remove(o);
 }
 
 void ResourceLoader::uncacheModel(Model *m) {
-	_models.remove(m);
+	Common::String fname = fixFilename(m->_fname);
+	unpinBlock(fname);
+	uncacheObject(fname, m);
+}
+
+void ResourceLoader::uncacheMaterial(Material *m) {
+	unpinBlock(m->getFilename());
 }
 
 void ResourceLoader::uncacheColormap(CMap *c) {
-	_colormaps.remove(c);
+	uncacheObject(c->getFilename(), c);
 }
 
 void ResourceLoader::uncacheKeyframe(KeyframeAnim *k) {
-	_keyframeAnims.remove(k);
+	unpinBlock(k->getFilename());
+	uncacheObject(k->getFilename(), k);
 }
 
 void ResourceLoader::uncacheLipSync(LipSync *s) {
-	_lipsyncs.remove(s);
+	uncacheObject(s->getFilename(), s);
 }
 
 ModelPtr ResourceLoader::getModel(const Common::String &fname, CMap *c) {
-	Common::String filename = fname;
-	filename.toLowercase();
-	for (Common::List<Model *>::const_iterator i = _models.begin(); i != _models.end(); ++i) {
-		Model *m = *i;
-		if (filename == m->_fname && *m->_cmap == *c) {
-			return m;
+	ResourceEntry *entry = getEntry(fixFilename(fname));
+	if (entry) {
+		for (Common::List<Object *>::const_iterator i = entry->objects.begin(); i != entry->objects.end(); ++i) {
+			Model *m = static_cast<Model *>(*i);
+			if (*m->_cmap == *c) {
+				return m;
+			}
 		}
 	}
 
@@ -416,40 +624,25 @@ ModelPtr ResourceLoader::getModel(const Common::String &fname, CMap *c) {
 }
 
 CMapPtr ResourceLoader::getColormap(const Common::String &fname) {
-	Common::String filename = fname;
-	filename.toLowercase();
-	for (Common::List<CMap *>::const_iterator i = _colormaps.begin(); i != _colormaps.end(); ++i) {
-		CMap *c = *i;
-		if (filename.equals(c->_fname)) {
-			return c;
-		}
-	}
+	ResourceEntry *entry = getEntry(fname);
+	if (entry && !entry->objects.empty())
+		return static_cast<CMap *>(entry->objects.front());
 
 	return loadColormap(fname);
 }
 
 KeyframeAnimPtr ResourceLoader::getKeyframe(const Common::String &fname) {
-	Common::String filename = fname;
-	filename.toLowercase();
-	for (Common::List<KeyframeAnim *>::const_iterator i = _keyframeAnims.begin(); i != _keyframeAnims.end(); ++i) {
-		KeyframeAnim *k = *i;
-		if (filename == k->getFilename()) {
-			return k;
-		}
-	}
+	ResourceEntry *entry = getEntry(fname);
+	if (entry && !entry->objects.empty())
+		return static_cast<KeyframeAnim *>(entry->objects.front());
 
 	return loadKeyframe(fname);
 }
 
 LipSyncPtr ResourceLoader::getLipSync(const Common::String &fname) {
-	Common::String filename = fname;
-	filename.toLowercase();
-	for (Common::List<LipSync *>::const_iterator i = _lipsyncs.begin(); i != _lipsyncs.end(); ++i) {
-		LipSync *l = *i;
-		if (filename == l->getFilename()) {
-			return l;
-		}
-	}
+	ResourceEntry *entry = getEntry(fname);
+	if (entry && !entry->objects.empty())
+		return static_cast<LipSync *>(entry->objects.front());
 
 	return loadLipSync(fname);
 }
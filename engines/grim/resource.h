@@ -25,8 +25,10 @@
 
 #include "common/archive.h"
 #include "common/file.h"
+#include "common/mutex.h"
 
 #include "engines/grim/object.h"
+#include "engines/grim/lab.h"
 
 namespace Grim {
 
@@ -40,9 +42,7 @@ class Model;
 class LipSync;
 class TrackedObject;
 class SaveGame;
-class Block;
 class LuaFile;
-class Lab;
 
 typedef ObjectPtr<Material> MaterialPtr;
 typedef ObjectPtr<Bitmap> BitmapPtr;
@@ -67,7 +67,10 @@ public:
 	LipSync *loadLipSync(const Common::String &fname);
 	Block *getFileBlock(const Common::String &filename) const;
 	Block *getBlock(const Common::String &filename);
-	Common::File *openNewStreamFile(const char *filename) const;
+	// Keeps a cached block from being evicted while it is being parsed
+	void pinBlock(const Common::String &fname);
+	void unpinBlock(const Common::String &fname);
+	Common::SeekableReadStream *openNewStreamFile(const char *filename) const;
 	Common::SeekableReadStream *openNewSubStreamFile(const char *filename) const;
 	LuaFile *openNewStreamLuaFile(const char *filename) const;
 	void uncache(const char *fname);
@@ -79,33 +82,93 @@ public:
 	KeyframeAnimPtr getKeyframe(const Common::String &fname);
 	LipSyncPtr getLipSync(const Common::String &fname);
 	void uncacheModel(Model *m);
+	void uncacheMaterial(Material *m);
 	void uncacheColormap(CMap *c);
 	void uncacheKeyframe(KeyframeAnim *kf);
 	void uncacheLipSync(LipSync *l);
 
-	struct ResourceCache {
-		char *fname;
-		Block *resPtr;
-	};
+	/**
+	 * Queue a file to be read in the background. Finished blocks enter
+	 * the cache on the main thread through flushPrefetched().
+	 */
+	void prefetch(const Common::String &fname);
+	// Queue a set file and the colormaps and bitmaps it refers to
+	void prefetchScene(const Common::String &fname);
+	void flushPrefetched();
+
+	uint32 getCacheHits() const { return _cacheHits; }
+	uint32 getCacheMisses() const { return _cacheMisses; }
+	uint32 getCacheEvictions() const { return _cacheEvictions; }
 
 private:
-	const Lab *getLab(const Common::String &filename) const;
+	struct ResourceEntry;
+	typedef Common::List<ResourceEntry *> ResourceList;
+
+	/**
+	 * One entry per file in all the opened archives, built once at startup.
+	 * It also holds the cached block and the objects loaded from the file.
+	 */
+	struct ResourceEntry {
+		ResourceEntry() : lab(NULL), block(NULL), refCount(0), prefetching(false) { }
+
+		const Lab *lab;
+		Lab::LabEntry location;
+		Block *block;
+		// Position in _lru, only valid while block is set
+		ResourceList::iterator lruPos;
+		// Number of live objects loaded from this block; pinned blocks are never evicted
+		int32 refCount;
+		// Queued for the prefetcher and not yet flushed
+		bool prefetching;
+		// Models, colormaps, keyframes or lipsyncs loaded from this file
+		Common::List<Object *> objects;
+	};
+	typedef Common::HashMap<Common::String, ResourceEntry, Common::IgnoreCase_Hash, Common::IgnoreCase_EqualTo> ResourceIndex;
+
+	struct PrefetchRequest {
+		ResourceEntry *entry;
+		// Set when the archive isn't mapped, read into data
+		Common::SeekableReadStream *stream;
+		char *data;
+		// The view into a mapped archive, or the finished block
+		Block *block;
+		int pos;
+	};
+	typedef Common::List<PrefetchRequest> PrefetchList;
+
+	static void prefetchHandler(void *refCon);
+	void prefetchStep();
+	void freePrefetchRequest(PrefetchRequest &r);
+
+	void buildIndex();
+	ResourceEntry *getEntry(const Common::String &filename);
+	const ResourceEntry *getEntry(const Common::String &filename) const;
 	Block *getFileFromCache(const Common::String &filename);
-	ResourceLoader::ResourceCache *getEntryFromCache(const Common::String &filename);
 	void putIntoCache(const Common::String &fname, Block *res);
+	void putIntoCache(ResourceEntry *entry, Block *res);
+	void removeFromCache(ResourceEntry *entry);
+	void uncacheObject(const Common::String &fname, Object *o);
+	void trimCache(int32 reserve);
 
 	typedef Common::List<Lab *> LabList;
 	LabList _labs;
-	Common::SearchSet _files;
+	ResourceIndex _index;
 
-	Common::Array<ResourceCache> _cache;
-	bool _cacheDirty;
+	// Entries with a cached block, least recently used first
+	ResourceList _lru;
 	int32 _cacheMemorySize;
-
-	Common::List<Model *> _models;
-	Common::List<CMap *> _colormaps;
-	Common::List<KeyframeAnim *> _keyframeAnims;
-	Common::List<LipSync *> _lipsyncs;
+	int32 _cacheMemoryBudget;
+	uint32 _cacheHits;
+	uint32 _cacheMisses;
+	uint32 _cacheEvictions;
+
+	// Only touched by the prefetch timer
+	PrefetchRequest _prefetchCurrent;
+	bool _prefetchBusy;
+	// Guards the two lists below, shared with the prefetch timer
+	Common::Mutex _prefetchMutex;
+	PrefetchList _prefetchQueue;
+	PrefetchList _prefetchDone;
 };
 
 extern ResourceLoader *g_resourceloader;
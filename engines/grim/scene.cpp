@@ -40,7 +40,9 @@ namespace Grim {
 
 Scene::Scene(const Common::String &sceneName, const char *buf, int len) :
 		PoolObject(), _locked(false), _name(sceneName), _enableLights(false),
-		_lightsConfigured(false) {
+		_lightsConfigured(false), _sectorLinksRadius(0.f), _shrinkRadius(0.f), _sectorGridRadius(0.f),
+		_sectorVisit(0) {
+	_sectorLinksValid[0] = _sectorLinksValid[1] = false;
 
 	if (len >= 7 && memcmp(buf, "section", 7) == 0) {
 		TextSplitter ts(buf, len);
@@ -52,7 +54,9 @@ Scene::Scene(const Common::String &sceneName, const char *buf, int len) :
 }
 
 Scene::Scene() :
-	PoolObject(), _cmaps(NULL) {
+	PoolObject(), _cmaps(NULL), _sectorLinksRadius(0.f), _shrinkRadius(0.f), _sectorGridRadius(0.f),
+	_sectorVisit(0) {
+	_sectorLinksValid[0] = _sectorLinksValid[1] = false;
 
 }
 
@@ -328,6 +332,15 @@ bool Scene::restoreState(SaveGame *savedState) {
 	} else {
 		_sectors = NULL;
 	}
+	_shrinkRadius = 0.f;
+	for (int i = 0; i < _numSectors; ++i) {
+		if (_sectors[i]->getShrinkRadius() != 0.f)
+			_shrinkRadius = _sectors[i]->getShrinkRadius();
+	}
+	_sectorLinksRadius = _shrinkRadius;
+	_sectorLinksValid[0] = _sectorLinksValid[1] = false;
+	_sectorGridRadius = _shrinkRadius;
+	_sectorGrids[0]._valid = _sectorGrids[1]._valid = false;
 
 	_numLights = savedState->readLEUint32();
 	_lights = new Light[_numLights];
@@ -523,10 +536,102 @@ void Scene::drawBitmaps(ObjectState::Position stage) {
 	}
 }
 
-Sector *Scene::findPointSector(const Graphics::Vector3d &p, Sector::SectorType type) {
+// The distance in the xy plane from a point to a box, which is never more
+// than the distance to a point inside the box
+static float getBoxDistance(float minX, float minY, float maxX, float maxY, const Graphics::Vector3d &p) {
+	float dx = MAX(MAX(minX - p.x(), p.x() - maxX), 0.f);
+	float dy = MAX(MAX(minY - p.y(), p.y() - maxY), 0.f);
+	return sqrt(dx * dx + dy * dy);
+}
+
+void Scene::buildSectorGrid(SectorGrid &grid) {
+	grid._boxes.resize(_numSectors);
+	_sectorVisits.resize(_numSectors);
+	grid._cells.clear();
+	grid._width = 0;
+	grid._height = 0;
+
+	bool empty = true;
 	for (int i = 0; i < _numSectors; i++) {
+		_sectorVisits[i] = 0;
 		Sector *sector = _sectors[i];
-		if (sector && (sector->getType() & type) && sector->isVisible() && sector->isPointInSector(p))
+		SectorBox &box = grid._boxes[i];
+		Graphics::Vector3d *vertices = sector->getVertices();
+		box._minX = box._maxX = vertices[0].x();
+		box._minY = box._maxY = vertices[0].y();
+		for (int j = 1; j < sector->getNumVertices(); j++) {
+			box._minX = MIN(box._minX, vertices[j].x());
+			box._minY = MIN(box._minY, vertices[j].y());
+			box._maxX = MAX(box._maxX, vertices[j].x());
+			box._maxY = MAX(box._maxY, vertices[j].y());
+		}
+		// Grow the box a bit, so that the rounding of the edge tests
+		// cannot find a point just outside of it in the sector
+		box._minX -= 0.001f;
+		box._minY -= 0.001f;
+		box._maxX += 0.001f;
+		box._maxY += 0.001f;
+
+		if (empty) {
+			grid._box = box;
+			empty = false;
+		} else {
+			grid._box._minX = MIN(grid._box._minX, box._minX);
+			grid._box._minY = MIN(grid._box._minY, box._minY);
+			grid._box._maxX = MAX(grid._box._maxX, box._maxX);
+			grid._box._maxY = MAX(grid._box._maxY, box._maxY);
+		}
+	}
+	grid._valid = true;
+	if (empty)
+		return;
+
+	// About one cell per sector
+	int size = (int)ceil(sqrt((float)_numSectors));
+	grid._width = size;
+	grid._height = size;
+	grid._cellWidth = (grid._box._maxX - grid._box._minX) / size;
+	grid._cellHeight = (grid._box._maxY - grid._box._minY) / size;
+	grid._cells.resize(size * size);
+
+	for (int i = 0; i < _numSectors; i++) {
+		const SectorBox &box = grid._boxes[i];
+		int x1, y1, x2, y2;
+		grid.getCell(Graphics::Vector3d(box._minX, box._minY, 0), &x1, &y1);
+		grid.getCell(Graphics::Vector3d(box._maxX, box._maxY, 0), &x2, &y2);
+		for (int y = y1; y <= y2; y++) {
+			for (int x = x1; x <= x2; x++)
+				grid._cells[y * size + x].push_back(i);
+		}
+	}
+}
+
+void Scene::SectorGrid::getCell(const Graphics::Vector3d &p, int *x, int *y) const {
+	*x = CLIP((int)floor((p.x() - _box._minX) / _cellWidth), 0, _width - 1);
+	*y = CLIP((int)floor((p.y() - _box._minY) / _cellHeight), 0, _height - 1);
+}
+
+const Scene::SectorGrid &Scene::getSectorGrid() {
+	SectorGrid &grid = _sectorGrids[_shrinkRadius != 0.f];
+	if (!grid._valid)
+		buildSectorGrid(grid);
+	return grid;
+}
+
+Sector *Scene::findPointSector(const Graphics::Vector3d &p, Sector::SectorType type) {
+	const SectorGrid &grid = getSectorGrid();
+	if (grid._cells.empty() || getBoxDistance(grid._box._minX, grid._box._minY,
+	                                          grid._box._maxX, grid._box._maxY, p) > 0.f)
+		return NULL;
+
+	// The sectors are listed in index order, so the first one found is
+	// the one the linear search used to return
+	int x, y;
+	grid.getCell(p, &x, &y);
+	const Common::Array<int> &cell = grid._cells[y * grid._width + x];
+	for (uint i = 0; i < cell.size(); i++) {
+		Sector *sector = _sectors[cell[i]];
+		if ((sector->getType() & type) && sector->isVisible() && sector->isPointInSector(p))
 			return sector;
 	}
 	return NULL;
@@ -534,20 +639,65 @@ Sector *Scene::findPointSector(const Graphics::Vector3d &p, Sector::SectorType t
 
 void Scene::findClosestSector(const Graphics::Vector3d &p, Sector **sect, Graphics::Vector3d *closestPoint) {
 	Sector *resultSect = NULL;
+	int resultIndex = -1;
 	Graphics::Vector3d resultPt = p;
 	float minDist = 0.0;
 
-	for (int i = 0; i < _numSectors; i++) {
-		Sector *sector = _sectors[i];
-		if ((sector->getType() & Sector::WalkType) == 0 || !sector->isVisible())
-			continue;
-		Graphics::Vector3d closestPt = sector->getClosestPoint(p);
-		float thisDist = (closestPt - p).magnitude();
-		if (!resultSect || thisDist < minDist) {
-			resultSect = sector;
-			resultPt = closestPt;
-			minDist = thisDist;
+	const SectorGrid &grid = getSectorGrid();
+
+	// Visit the cells in rings around the one of the point, until a whole
+	// ring is farther away than the closest sector found. The boxes give a
+	// lower bound of the distance to the sectors, and most of them do not
+	// need to be looked at.
+	int cx = 0, cy = 0;
+	if (!grid._cells.empty())
+		grid.getCell(p, &cx, &cy);
+	++_sectorVisit;
+	int maxRing = MAX(grid._width, grid._height);
+	for (int r = 0; r < maxRing; r++) {
+		bool ringInRange = false;
+		for (int y = MAX(cy - r, 0); y <= MIN(cy + r, grid._height - 1); y++) {
+			// Only the cells on the border of the ring
+			int step = (y == cy - r || y == cy + r) ? 1 : 2 * r;
+			for (int x = cx - r; x <= cx + r; x += step) {
+				if (x < 0 || x >= grid._width)
+					continue;
+
+				float cellMinX = grid._box._minX + x * grid._cellWidth;
+				float cellMinY = grid._box._minY + y * grid._cellHeight;
+				if (resultSect && getBoxDistance(cellMinX, cellMinY, cellMinX + grid._cellWidth,
+				                                 cellMinY + grid._cellHeight, p) > minDist)
+					continue;
+				ringInRange = true;
+
+				const Common::Array<int> &cell = grid._cells[y * grid._width + x];
+				for (uint i = 0; i < cell.size(); i++) {
+					int index = cell[i];
+					if (_sectorVisits[index] == _sectorVisit)
+						continue;
+					_sectorVisits[index] = _sectorVisit;
+
+					Sector *sector = _sectors[index];
+					if ((sector->getType() & Sector::WalkType) == 0 || !sector->isVisible())
+						continue;
+					const SectorBox &box = grid._boxes[index];
+					if (resultSect && getBoxDistance(box._minX, box._minY, box._maxX, box._maxY, p) > minDist)
+						continue;
+
+					Graphics::Vector3d closestPt = sector->getClosestPoint(p);
+					float thisDist = (closestPt - p).magnitude();
+					// Ties go to the lowest index, like in a linear search
+					if (!resultSect || thisDist < minDist || (thisDist == minDist && index < resultIndex)) {
+						resultSect = sector;
+						resultIndex = index;
+						resultPt = closestPt;
+						minDist = thisDist;
+					}
+				}
+			}
 		}
+		if (!ringInRange)
+			break;
 	}
 
 	if (sect)
@@ -562,6 +712,15 @@ void Scene::shrinkBoxes(float radius) {
 		Sector *sector = _sectors[i];
 		sector->shrink(radius);
 	}
+	_shrinkRadius = radius;
+	if (radius != _sectorLinksRadius) {
+		_sectorLinksRadius = radius;
+		_sectorLinksValid[1] = false;
+	}
+	if (radius != _sectorGridRadius) {
+		_sectorGridRadius = radius;
+		_sectorGrids[1]._valid = false;
+	}
 }
 
 void Scene::unshrinkBoxes() {
@@ -569,6 +728,46 @@ void Scene::unshrinkBoxes() {
 		Sector *sector = _sectors[i];
 		sector->unshrink();
 	}
+	_shrinkRadius = 0.f;
+}
+
+int Scene::getSectorIndex(const Sector *sector) const {
+	for (int i = 0; i < _numSectors; i++) {
+		if (_sectors[i] == sector)
+			return i;
+	}
+	return -1;
+}
+
+const Common::Array<Scene::SectorLink> &Scene::getSectorLinks(int sector) {
+	int shrunk = _shrinkRadius != 0.f;
+	if (!_sectorLinksValid[shrunk])
+		buildSectorLinks();
+	return _sectorLinks[shrunk][sector];
+}
+
+void Scene::buildSectorLinks() {
+	// Only the shape of the sectors matters here, their visibility is
+	// checked when walking, since scripts toggle it all the time
+	int shrunk = _shrinkRadius != 0.f;
+	Common::Array<Common::Array<SectorLink> > &links = _sectorLinks[shrunk];
+	links.clear();
+	links.resize(_numSectors);
+	for (int i = 0; i < _numSectors; i++) {
+		for (int j = 0; j < _numSectors; j++) {
+			int type = _sectors[j]->getType();
+			if (i == j || (type != Sector::WalkType && type != Sector::HotType && type != Sector::FunnelType))
+				continue;
+
+			SectorLink link;
+			link._bridges = _sectors[i]->getBridgesTo(_sectors[j]);
+			if (link._bridges.empty())
+				continue; // The sectors are not adjacent.
+			link._sector = j;
+			links[i].push_back(link);
+		}
+	}
+	_sectorLinksValid[shrunk] = true;
 }
 
 ObjectState *Scene::findState(const char *filename) {
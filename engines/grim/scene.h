@@ -23,6 +23,8 @@
 #ifndef GRIM_SCENE_H
 #define GRIM_SCENE_H
 
+#include "common/array.h"
+
 #include "engines/grim/pool.h"
 #include "engines/grim/object.h"
 #include "engines/grim/color.h"
@@ -92,6 +94,15 @@ public:
 	void findClosestSector(const Graphics::Vector3d &p, Sector **sect, Graphics::Vector3d *closestPt);
 	void shrinkBoxes(float radius);
 	void unshrinkBoxes();
+	int getSectorIndex(const Sector *sector) const;
+
+	// A sector the path finding can walk into from another one, with the
+	// bridges between them as returned by Sector::getBridgesTo()
+	struct SectorLink {
+		int _sector;
+		Common::List<Graphics::Line3d> _bridges;
+	};
+	const Common::Array<SectorLink> &getSectorLinks(int sector);
 
 	void addObjectState(ObjectState *s);
 	void deleteObjectState(ObjectState *s) {
@@ -140,6 +151,40 @@ private:
 	typedef Common::List<ObjectState*> StateList;
 	StateList _states;
 
+	// The links from each sector, built when the path finding first needs
+	// them. The unshrunk sectors use the first set and the shrunk ones the
+	// second, so shrinking the boxes and restoring them keeps both.
+	void buildSectorLinks();
+	Common::Array<Common::Array<SectorLink> > _sectorLinks[2];
+	bool _sectorLinksValid[2];
+	float _sectorLinksRadius;	// the radius the shrunk links were built for
+	float _shrinkRadius;	// the radius the sectors are shrunk by, 0 if they are not
+
+	// A uniform grid over the bounding boxes of the sectors in the xy plane,
+	// each cell listing the sectors whose box overlaps it in index order.
+	// It is built on the first query. Like the links, the unshrunk and the
+	// shrunk sectors have a grid each.
+	struct SectorBox {
+		float _minX, _minY, _maxX, _maxY;
+	};
+	struct SectorGrid {
+		SectorGrid() : _width(0), _height(0), _valid(false) {}
+		void getCell(const Graphics::Vector3d &p, int *x, int *y) const;
+
+		Common::Array<SectorBox> _boxes;
+		Common::Array<Common::Array<int> > _cells;
+		int _width, _height;
+		SectorBox _box;
+		float _cellWidth, _cellHeight;
+		bool _valid;
+	};
+	void buildSectorGrid(SectorGrid &grid);
+	const SectorGrid &getSectorGrid();
+	SectorGrid _sectorGrids[2];
+	float _sectorGridRadius;	// the radius the shrunk grid was built for
+	Common::Array<uint32> _sectorVisits;	// when findClosestSector last saw each sector
+	uint32 _sectorVisit;
+
 	friend class GrimEngine;
 };
 
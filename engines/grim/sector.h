@@ -66,6 +66,7 @@ public:
 	int getSectorId() const { return _id; }
 	SectorType getType() const { return _type; } // FIXME: Implement type de-masking
 	bool isVisible() const { return _visible && !_invalid; }
+	float getShrinkRadius() const { return _shrinkRadius; }
 	bool isPointInSector(const Graphics::Vector3d &point) const;
 	Common::List<Graphics::Line3d> getBridgesTo(Sector *sector) const;
 
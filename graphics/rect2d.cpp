@@ -63,8 +63,50 @@ void Rect2d::rotateAroundCenter(float angle) {
 	rotateAround(center, angle);
 }
 
-bool Rect2d::intersectsRect(const Rect2d &rect) const {
+static void projectRect(const Rect2d &rect, const Vector2d &axis, float *min, float *max) {
+	const Vector2d corners[4] = { rect._topLeft, rect._topRight, rect._bottomLeft, rect._bottomRight };
+	*min = *max = corners[0].getX() * axis.getX() + corners[0].getY() * axis.getY();
+	for (int i = 1; i < 4; i++) {
+		float d = corners[i].getX() * axis.getX() + corners[i].getY() * axis.getY();
+		if (d < *min)
+			*min = d;
+		if (d > *max)
+			*max = d;
+	}
+}
+
+bool Rect2d::intersectsRect(const Rect2d &rect, Vector2d *separation) const {
+	// Two rects do not overlap if their projections on the direction
+	// of one of their edges do not
+	Vector2d axes[4] = { _topRight - _topLeft, _bottomLeft - _topLeft,
+	                     rect._topRight - rect._topLeft, rect._bottomLeft - rect._topLeft };
+	Vector2d minAxis;
+	float minOverlap = 0.f;
+	bool found = false;
+
+	for (int i = 0; i < 4; i++) {
+		if (axes[i].getMagnitude() == 0.f)
+			continue;
+		Vector2d axis = axes[i].getNormalized();
+
+		float min1, max1, min2, max2;
+		projectRect(*this, axis, &min1, &max1);
+		projectRect(rect, axis, &min2, &max2);
+		float overlap = (max1 < max2 ? max1 : max2) - (min1 > min2 ? min1 : min2);
+		if (overlap <= 0.f)
+			return false;
+
+		if (!found || overlap < minOverlap) {
+			minOverlap = overlap;
+			// Push this rect away from the other one
+			minAxis = (min1 + max1 < min2 + max2) ? axis * -1.f : axis;
+			found = true;
+		}
+	}
 
+	if (found && separation)
+		*separation = minAxis * minOverlap;
+	return found;
 }
 
 bool Rect2d::intersectsCircle(const Vector2d &center, float radius) const {
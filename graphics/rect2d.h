@@ -41,7 +41,14 @@ public:
 
 	void rotateAround(const Vector2d &point, float angle);
 	void rotateAroundCenter(float angle);
-	bool intersectsRect(const Rect2d &rect) const;
+	/**
+	 * Tests whether this rect overlaps another one.
+	 *
+	 * @param rect       The other rect.
+	 * @param separation If not NULL and the rects overlap, receives the
+	 *                   shortest translation of this rect that separates them.
+	 */
+	bool intersectsRect(const Rect2d &rect, Vector2d *separation = NULL) const;
 	bool intersectsCircle(const Vector2d &center, float radius) const;
 	bool containsPoint(const Vector2d &point) const;
 
@@ -616,3 +616,23 @@ void tglSetShadowColor(unsigned char r, unsigned char g, unsigned char b) {
 	c->zb->shadow_color_g = g << 8;
 	c->zb->shadow_color_b = b << 8;
 }
+
+void tglSetTileCount(int count) {
+	TinyGL::GLContext *c = TinyGL::gl_get_context();
+	TinyGL::gl_set_tile_count(c, count);
+}
+
+void tglFlushTiles() {
+	TinyGL::GLContext *c = TinyGL::gl_get_context();
+	TinyGL::gl_flush_tiles(c);
+}
+
+int tglGetTileCount() {
+	TinyGL::GLContext *c = TinyGL::gl_get_context();
+	return c->tile_count;
+}
+
+void tglGetTileStats(int tile, int *triangles, unsigned int *millis, int *workerFlushes) {
+	TinyGL::GLContext *c = TinyGL::gl_get_context();
+	TinyGL::gl_get_tile_stats(c, tile, triangles, millis, workerFlushes);
+}
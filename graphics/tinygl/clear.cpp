@@ -21,6 +21,7 @@ void glopClear(GLContext *c,GLParam *p) {
 	int g = (int)(c->clear_color.v[1] * 65535);
 	int b = (int)(c->clear_color.v[2] * 65535);
 
+	gl_flush_tiles(c);
 	// TODO : correct value of Z
 	ZB_clear(c->zb,mask & TGL_DEPTH_BUFFER_BIT, z, mask & TGL_COLOR_BUFFER_BIT, r, g, b);
 }
@@ -62,6 +62,7 @@ static void gl_add_select1(GLContext *c, int z1, int z2, int z3) {
 // point
 
 void gl_draw_point(GLContext *c, GLVertex *p0) {
+	gl_flush_tiles(c);
 	if (p0->clip_code == 0) {
 		if (c->render_mode == TGL_SELECT) {
 			gl_add_select(c,p0->zp.z,p0->zp.z);
@@ -114,6 +115,8 @@ void gl_draw_line(GLContext *c, GLVertex *p1, GLVertex *p2) {
 	float tmin, tmax;
 	GLVertex q1, q2;
 	int cc1, cc2;
+
+	gl_flush_tiles(c);
   
 	cc1 = p1->clip_code;
 	cc2 = p2->clip_code;
@@ -387,28 +390,47 @@ void gl_draw_triangle_fill(GLContext *c, GLVertex *p0, GLVertex *p1, GLVertex *p
 	}
 #endif
     
+	ZB_fillTriangleFunc fill;
+	GLImage *texture = NULL;
+
 	if (c->shadow_mode & 1) {
 		assert(c->zb->shadow_mask_buf);
-		ZB_fillTriangleFlatShadowMask(c->zb, &p0->zp, &p1->zp, &p2->zp);
+		fill = ZB_fillTriangleFlatShadowMask;
 	} else if (c->shadow_mode & 2) {
 		assert(c->zb->shadow_mask_buf);
-		ZB_fillTriangleFlatShadow(c->zb, &p0->zp, &p1->zp, &p2->zp);
-	} else if (c->texture_2d_enabled) {
+		fill = ZB_fillTriangleFlatShadow;
+	} else if (c->texture_2d_enabled && c->current_texture->num_levels > 0) {
+		// a texture without a level 0 image is drawn untextured
 #ifdef TINYGL_PROFILE
 		count_triangles_textured++;
 #endif
-		ZB_setTexture(c->zb, (PIXEL *)c->current_texture->images[0].pixmap);
-		ZB_fillTriangleMappingPerspective(c->zb, &p0->zp, &p1->zp, &p2->zp);
+		texture = gl_select_texture_level(c, &p0->zp, &p1->zp, &p2->zp);
+		fill = ZB_fillTriangleMappingPerspective;
 	} else if (c->current_shade_model == TGL_SMOOTH) {
-		ZB_fillTriangleSmooth(c->zb, &p0->zp, &p1->zp, &p2->zp);
+		fill = ZB_fillTriangleSmooth;
 	} else {
-		ZB_fillTriangleFlat(c->zb, &p0->zp, &p1->zp, &p2->zp);
+		fill = ZB_fillTriangleFlat;
 	}
+
+	// the shadow mask pass only writes the mask
+	if (!(c->shadow_mode & 1))
+		ZB_markDirty(c->zb, MIN(p0->zp.x, MIN(p1->zp.x, p2->zp.x)), MIN(p0->zp.y, MIN(p1->zp.y, p2->zp.y)),
+					 MAX(p0->zp.x, MAX(p1->zp.x, p2->zp.x)), MAX(p0->zp.y, MAX(p1->zp.y, p2->zp.y)));
+
+	if (c->tile_count > 1) {
+		gl_add_tile_triangle(c, fill, texture, &p0->zp, &p1->zp, &p2->zp);
+		return;
+	}
+
+	if (texture)
+		ZB_setTexture(c->zb, (PIXEL *)texture->pixmap, texture->xsize_bits, texture->ysize_bits);
+	fill(c->zb, &p0->zp, &p1->zp, &p2->zp);
 }
 
 // Render a clipped triangle in line mode
 
 void gl_draw_triangle_line(GLContext *c, GLVertex *p0, GLVertex *p1,GLVertex *p2) {
+	gl_flush_tiles(c);
 	if (c->depth_test) {
 		if (p0->edge_flag)
 			ZB_line_z(c->zb, &p0->zp, &p1->zp);
@@ -428,6 +450,7 @@ void gl_draw_triangle_line(GLContext *c, GLVertex *p0, GLVertex *p1,GLVertex *p2
 
 // Render a clipped triangle in point mode
 void gl_draw_triangle_point(GLContext *c, GLVertex *p0, GLVertex *p1, GLVertex *p2) {
+	gl_flush_tiles(c);
 	if (p0->edge_flag)
 		ZB_plot(c->zb, &p0->zp);
 	if (p1->edge_flag)
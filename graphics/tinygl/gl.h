@@ -23,6 +23,7 @@ enum {
 	TGL_2_BYTES						= 0x1407,
 	TGL_3_BYTES						= 0x1408,
 	TGL_4_BYTES						= 0x1409,
+	TGL_UNSIGNED_SHORT_5_6_5		= 0x8363,
 
 	// Primitives
 	TGL_LINES						= 0x0001,
@@ -500,6 +501,7 @@ enum {
 	TGL_NEAREST_MIPMAP_LINEAR		= 0x2702,
 	TGL_LINEAR_MIPMAP_NEAREST		= 0x2701,
 	TGL_LINEAR_MIPMAP_LINEAR		= 0x2703,
+	TGL_GENERATE_MIPMAP				= 0x8191,
 	TGL_OBJECT_LINEAR				= 0x2401,
 	TGL_OBJECT_PLANE				= 0x2501,
 	TGL_EYE_LINEAR					= 0x2400,
@@ -788,6 +790,13 @@ void tglFrontFace(int mode);
 void tglSetShadowMaskBuf(unsigned char *buf);
 void tglSetShadowColor(unsigned char r, unsigned char g, unsigned char b);
 
+// tiled rasterization: filled triangles are binned into horizontal tiles, which are
+// rasterized in parallel on tglFlushTiles() or before anything else touches the buffers
+void tglSetTileCount(int count);
+void tglFlushTiles();
+int tglGetTileCount();
+void tglGetTileStats(int tile, int *triangles, unsigned int *millis, int *workerFlushes);
+
 // opengl 1.2 arrays
 void tglEnableClientState(TGLenum array);
 void tglDisableClientState(TGLenum array);
@@ -1,4 +1,6 @@
 
+#include "common/endian.h"
+
 #include "graphics/tinygl/zgl.h"
 
 namespace TinyGL {
@@ -26,6 +28,53 @@ void gl_convertRGB_to_5R6G5B8A(unsigned short *pixmap, unsigned char *rgba, int
 	}
 }
 
+// 16 bit 5R6G5B pixels in native byte order, all opaque
+void gl_convert565_to_5R6G5B8A(unsigned char *pixmap, const unsigned short *rgb, int xsize, int ysize) {
+	int i, n;
+
+	n = xsize * ysize;
+	for (i = 0; i < n; i++) {
+		WRITE_UINT16(pixmap + 3 * i, rgb[i]);
+		pixmap[3 * i + 2] = 0xff;
+	}
+}
+
+// Box filters a 5R6G5B8A image to half its size, for the next mip level.
+// The texture filler only draws texels with an alpha of 0xff, so alpha stays
+// binary: a texel is opaque when at least half of its sources are, and only
+// the opaque sources contribute to its color.
+void gl_halveImage5R6G5B8A(unsigned char *dest, const unsigned char *src, int xsize_src, int ysize_src) {
+	int xsize = MAX(xsize_src >> 1, 1);
+	int ysize = MAX(ysize_src >> 1, 1);
+	int dx = xsize_src > 1 ? 3 : 0;
+	int dy = ysize_src > 1 ? 3 * xsize_src : 0;
+	int x, y, i;
+
+	for (y = 0; y < ysize; y++) {
+		const unsigned char *p = src + 3 * (2 * y * xsize_src);
+		for (x = 0; x < xsize; x++) {
+			const unsigned char *q[4] = { p, p + dx, p + dy, p + dx + dy };
+			unsigned int r = 0, g = 0, b = 0, n = 0;
+			for (i = 0; i < 4; i++) {
+				if (q[i][2] != 0xff)
+					continue;
+				unsigned short pixel = READ_UINT16(q[i]);
+				r += pixel >> 11;
+				g += (pixel >> 5) & 0x3f;
+				b += pixel & 0x1f;
+				n++;
+			}
+			if (n > 0)
+				WRITE_UINT16(dest, ((r / n) << 11) | ((g / n) << 5) | (b / n));
+			else
+				WRITE_UINT16(dest, READ_UINT16(q[0]));
+			dest[2] = n >= 2 ? 0xff : 0;
+			dest += 3;
+			p += 2 * dx;
+		}
+	}
+}
+
 // linear interpolation with xf, yf normalized to 2^16
 
 #define INTERP_NORM_BITS  16
@@ -169,6 +169,15 @@ void glInit(void *zbuffer1) {
 	// shadow mode
 	c->shadow_mode = 0;
 
+	// tiled rasterization, off until tglSetTileCount() is called
+	c->tile_count = 0;
+	c->tile_height = 0;
+	c->tiles = NULL;
+	c->tile_triangles = NULL;
+	c->tile_triangles_count = 0;
+	c->tile_triangles_max = 0;
+	c->tile_job = NULL;
+
 	// clear the resize callback function pointer
 	c->gl_resize_viewport = NULL;
 
@@ -183,6 +192,7 @@ void glInit(void *zbuffer1) {
 
 void glClose() {
 	GLContext *c = gl_get_context();
+	gl_set_tile_count(c, 0);
 	endSharedState(c);
 	gl_free(c);
 }
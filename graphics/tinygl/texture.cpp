@@ -22,6 +22,8 @@ static void free_texture(GLContext *c, int h) {
 	GLImage *im;
 	int i;
 
+	// binned triangles may still read the images
+	gl_flush_tiles(c);
 	t = find_texture(c, h);
 	if (!t->prev) {
 		ht = &c->shared_state.texture_hash_table[t->handle % TEXTURE_HASH_TABLE_SIZE];
@@ -55,6 +57,7 @@ GLTexture *alloc_texture(GLContext *c, int h) {
 	*ht = t;
 
 	t->handle = h;
+	t->min_filter = TGL_NEAREST_MIPMAP_LINEAR;
 
 	return t;
 }
@@ -79,6 +82,65 @@ void glopBindTexture(GLContext *c, GLParam *p) {
 	c->current_texture = t;
 }
 
+// log2 of the power of two a texture size is stored at, textures with other
+// sizes are resampled to the next power of two
+static int texture_size_bits(int size) {
+	int bits = 0;
+	while ((1 << bits) < size && bits < MAX_TEXTURE_LEVELS - 1)
+		bits++;
+	return bits;
+}
+
+static GLImage *alloc_texture_image(GLTexture *t, int level, int wbits, int hbits) {
+	GLImage *im = &t->images[level];
+	if (im->pixmap)
+		gl_free(im->pixmap);
+	im->xsize_bits = wbits;
+	im->ysize_bits = hbits;
+	im->xsize = 1 << wbits;
+	im->ysize = 1 << hbits;
+	im->pixmap = gl_malloc(im->xsize * im->ysize * 3);
+	return im;
+}
+
+static void update_texture_levels(GLTexture *t) {
+	t->num_levels = t->images[0].pixmap ? 1 : 0;
+	while (t->num_levels > 0 && t->num_levels < MAX_TEXTURE_LEVELS) {
+		GLImage *prev = &t->images[t->num_levels - 1];
+		GLImage *im = &t->images[t->num_levels];
+		if ((prev->xsize == 1 && prev->ysize == 1) || !im->pixmap ||
+				im->xsize != MAX(prev->xsize >> 1, 1) || im->ysize != MAX(prev->ysize >> 1, 1))
+			break;
+		t->num_levels++;
+	}
+}
+
+// Picks the mip level whose texels are closest to the size of a screen pixel,
+// from the areas the triangle covers in texture and in screen space
+GLImage *gl_select_texture_level(GLContext *c, ZBufferPoint *p0, ZBufferPoint *p1, ZBufferPoint *p2) {
+	GLTexture *t = c->current_texture;
+	int level = 0;
+
+	if (t->num_levels > 1 && t->min_filter != TGL_NEAREST && t->min_filter != TGL_LINEAR) {
+		const float range = (float)(ZB_POINT_S_MAX - ZB_POINT_S_MIN);
+		float ds1 = (p1->s - p0->s) / range, dt1 = (p1->t - p0->t) / range;
+		float ds2 = (p2->s - p0->s) / range, dt2 = (p2->t - p0->t) / range;
+		float screen_area = fabs((float)(p1->x - p0->x) * (p2->y - p0->y) - (float)(p2->x - p0->x) * (p1->y - p0->y));
+		float texture_area = fabs(ds1 * dt2 - ds2 * dt1) * t->images[0].xsize * t->images[0].ysize;
+
+		if (screen_area > 0) {
+			// texels per pixel, squared
+			float ratio = texture_area / screen_area;
+			while (level < t->num_levels - 1 && ratio >= 2.0f) {
+				ratio *= 0.25f;
+				level++;
+			}
+		}
+	}
+
+	return &t->images[level];
+}
+
 void glopTexImage2D(GLContext *c, GLParam *p) {
 	int target = p[1].i;
 	int level = p[2].i;
@@ -89,39 +151,59 @@ void glopTexImage2D(GLContext *c, GLParam *p) {
 	int format = p[7].i;
 	int type = p[8].i;
 	void *pixels = p[9].p;
+	GLTexture *t = c->current_texture;
 	GLImage *im;
 	unsigned char *pixels1;
-	int do_free;
+	int do_free, wbits, hbits;
 
-	if (!(target == TGL_TEXTURE_2D && level == 0 && components == 3 && border == 0
-				&& format == TGL_RGBA && type == TGL_UNSIGNED_BYTE)) {
+	if (!(target == TGL_TEXTURE_2D && level >= 0 && level < MAX_TEXTURE_LEVELS && components == 3 && border == 0
+				&& ((format == TGL_RGBA && type == TGL_UNSIGNED_BYTE) || (format == TGL_RGB && type == TGL_UNSIGNED_SHORT_5_6_5)))) {
 		error("glTexImage2D: combination of parameters not handled");
 	}
 
+	wbits = texture_size_bits(width);
+	hbits = texture_size_bits(height);
+
 	do_free = 0;
-	if (width != 256 || height != 256) {
-		pixels1 = (unsigned char *)gl_malloc(256 * 256 * 4);
+	if (width != (1 << wbits) || height != (1 << hbits)) {
+		if (type != TGL_UNSIGNED_BYTE)
+			error("glTexImage2D: 16 bit textures must have power of two sizes");
+		pixels1 = (unsigned char *)gl_malloc((1 << wbits) * (1 << hbits) * 4);
 		// no interpolation is done here to respect the original image aliasing !
-		//gl_resizeImageNoInterpolate(pixels1, 256, 256, (unsigned char *)pixels, width, height);
+		//gl_resizeImageNoInterpolate(pixels1, 1 << wbits, 1 << hbits, (unsigned char *)pixels, width, height);
 		// used interpolation anyway, it look much better :) --- aquadran
-		gl_resizeImage(pixels1, 256, 256, (unsigned char *)pixels, width, height);
+		gl_resizeImage(pixels1, 1 << wbits, 1 << hbits, (unsigned char *)pixels, width, height);
 		do_free = 1;
-		width = 256;
-		height = 256;
 	} else {
 		pixels1 = (unsigned char *)pixels;
 	}
 
-	im = &c->current_texture->images[level];
-	im->xsize = width;
-	im->ysize = height;
-	if (im->pixmap)
-		gl_free(im->pixmap);
-	im->pixmap = gl_malloc(width * height * 3);
-	if (im->pixmap)
-		gl_convertRGB_to_5R6G5B8A((unsigned short *)im->pixmap, pixels1, width, height);
+	// binned triangles may still read the images replaced here
+	gl_flush_tiles(c);
+	im = alloc_texture_image(t, level, wbits, hbits);
+	if (im->pixmap) {
+		if (type == TGL_UNSIGNED_BYTE)
+			gl_convertRGB_to_5R6G5B8A((unsigned short *)im->pixmap, pixels1, im->xsize, im->ysize);
+		else
+			gl_convert565_to_5R6G5B8A((unsigned char *)im->pixmap, (const unsigned short *)pixels1, im->xsize, im->ysize);
+	}
 	if (do_free)
 		gl_free(pixels1);
+
+	// build the rest of the chain from the level just uploaded
+	if (level == 0 && t->generate_mipmap && im->pixmap) {
+		while (level < MAX_TEXTURE_LEVELS - 1 && (wbits > 0 || hbits > 0)) {
+			GLImage *prev = im;
+			wbits = MAX(wbits - 1, 0);
+			hbits = MAX(hbits - 1, 0);
+			im = alloc_texture_image(t, ++level, wbits, hbits);
+			if (!im->pixmap)
+				break;
+			gl_halveImage5R6G5B8A((unsigned char *)im->pixmap, (unsigned char *)prev->pixmap, prev->xsize, prev->ysize);
+		}
+	}
+
+	update_texture_levels(t);
 }
 
 // TODO: not all tests are done
@@ -143,7 +225,7 @@ error:
 }
 
 // TODO: not all tests are done
-void glopTexParameter(GLContext *, GLParam *p) {
+void glopTexParameter(GLContext *c, GLParam *p) {
 	int target = p[1].i;
 	int pname = p[2].i;
 	int param = p[3].i;
@@ -159,6 +241,12 @@ error:
 		if (param != TGL_REPEAT)
 			goto error;
 		break;
+	case TGL_TEXTURE_MIN_FILTER:
+		c->current_texture->min_filter = param;
+		break;
+	case TGL_GENERATE_MIPMAP:
+		c->current_texture->generate_mipmap = param;
+		break;
 	default:
 		;
 	}
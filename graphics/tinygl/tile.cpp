@@ -0,0 +1,232 @@
+// Tiled rasterization: filled triangles are binned into horizontal strips of
+// the screen and rasterized strip by strip when the tiles are flushed. A strip
+// only touches its own lines of the color, depth and shadow mask buffers, so
+// different strips are drawn at the same time without locking any pixel.
+//
+// The thread flushing the tiles works through them from the first one, and a
+// timer proc takes the tiles nobody has started yet whenever the timer fires
+// during a flush. The timer thread is the only other thread the backends give
+// us, so at most two tiles are rasterized at once.
+
+#include "common/mutex.h"
+#include "common/system.h"
+#include "common/timer.h"
+
+#include "graphics/tinygl/zgl.h"
+
+namespace TinyGL {
+
+// As often as the backend timer allows, the worker returns at once between flushes
+enum {
+	kTileWorkerInterval = 1000
+};
+
+struct GLTileTriangle {
+	ZBufferPoint p[3];
+	ZB_fillTriangleFunc fill;
+	PIXEL *texture;
+	int texture_wbits, texture_hbits;
+	unsigned char *shadow_mask_buf;
+	int shadow_color_r, shadow_color_g, shadow_color_b;
+};
+
+struct GLTile {
+	int *triangles; // indices in GLContext::tile_triangles, in submission order
+	int count, max;
+
+	// statistics since the tile count was set
+	int triangles_drawn;
+	unsigned int millis;
+	int worker_flushes; // flushes in which the timer worker drew this tile
+};
+
+// Shared between the flushing thread and the timer worker
+struct GLTileJob {
+	Common::Mutex mutex;
+	int next; // next tile to hand out, tile_count outside of a flush
+	int busy; // tiles handed out and not finished yet
+};
+
+static void *grow_array(void *array, int count, int *max, int size) {
+	int new_max = *max ? *max * 2 : 64;
+	void *new_array = gl_malloc(new_max * size);
+	if (!new_array)
+		error("could not grow tile array");
+	if (array) {
+		memcpy(new_array, array, count * size);
+		gl_free(array);
+	}
+	*max = new_max;
+	return new_array;
+}
+
+static void rasterize_tile(GLContext *c, int i, bool worker) {
+	GLTile *tile = &c->tiles[i];
+	if (tile->count == 0)
+		return;
+
+	// Each thread draws through its own copy of the ZBuffer, which limits the
+	// fillers to the tile and holds the state of the triangle being drawn
+	ZBuffer zb = *c->zb;
+	zb.tile_y1 = i * c->tile_height;
+	zb.tile_y2 = MIN(zb.tile_y1 + c->tile_height, zb.ysize);
+
+	// getMillis() is coarser than most tiles take, but the sums stay right on average
+	unsigned int start = g_system->getMillis();
+	for (int j = 0; j < tile->count; j++) {
+		GLTileTriangle *t = &c->tile_triangles[tile->triangles[j]];
+		// the fillers write to the points, and other tiles share them
+		ZBufferPoint p0 = t->p[0], p1 = t->p[1], p2 = t->p[2];
+		zb.shadow_mask_buf = t->shadow_mask_buf;
+		zb.shadow_color_r = t->shadow_color_r;
+		zb.shadow_color_g = t->shadow_color_g;
+		zb.shadow_color_b = t->shadow_color_b;
+		if (t->texture)
+			ZB_setTexture(&zb, t->texture, t->texture_wbits, t->texture_hbits);
+		t->fill(&zb, &p0, &p1, &p2);
+	}
+	tile->triangles_drawn += tile->count;
+	tile->millis += g_system->getMillis() - start;
+	if (worker)
+		tile->worker_flushes++;
+	tile->count = 0;
+}
+
+// Draws tiles until every tile of the flush has been handed out
+static void rasterize_tiles(GLContext *c, bool worker) {
+	GLTileJob *job = c->tile_job;
+
+	for (;;) {
+		int i;
+		{
+			Common::StackLock lock(job->mutex);
+			if (job->next >= c->tile_count)
+				return;
+			i = job->next++;
+			job->busy++;
+		}
+
+		rasterize_tile(c, i, worker);
+
+		Common::StackLock lock(job->mutex);
+		job->busy--;
+	}
+}
+
+static void tile_worker(void *refCon) {
+	rasterize_tiles((GLContext *)refCon, true);
+}
+
+static void free_tiles(GLContext *c) {
+	if (c->tile_job) {
+		g_system->getTimerManager()->removeTimerProc(tile_worker);
+		delete c->tile_job;
+		c->tile_job = NULL;
+	}
+	for (int i = 0; i < c->tile_count; i++)
+		gl_free(c->tiles[i].triangles);
+	gl_free(c->tiles);
+	gl_free(c->tile_triangles);
+	c->tiles = NULL;
+	c->tile_triangles = NULL;
+	c->tile_triangles_count = 0;
+	c->tile_triangles_max = 0;
+	c->tile_count = 0;
+}
+
+void gl_set_tile_count(GLContext *c, int count) {
+	gl_flush_tiles(c);
+	free_tiles(c);
+
+	if (count > c->zb->ysize)
+		count = c->zb->ysize;
+	if (count <= 1)
+		return;
+
+	c->tile_count = count;
+	c->tile_height = (c->zb->ysize + count - 1) / count;
+	c->tiles = (GLTile *)gl_zalloc(count * sizeof(GLTile));
+	if (!c->tiles)
+		error("could not allocate tiles");
+
+	c->tile_job = new GLTileJob();
+	c->tile_job->next = count;
+	c->tile_job->busy = 0;
+	g_system->getTimerManager()->installTimerProc(tile_worker, kTileWorkerInterval, c);
+}
+
+void gl_add_tile_triangle(GLContext *c, ZB_fillTriangleFunc fill, GLImage *texture,
+						  ZBufferPoint *p0, ZBufferPoint *p1, ZBufferPoint *p2) {
+	ZBuffer *zb = c->zb;
+	GLTileTriangle *t;
+	int index, ymin, ymax, first, last;
+
+	if (c->tile_triangles_count == c->tile_triangles_max)
+		c->tile_triangles = (GLTileTriangle *)grow_array(c->tile_triangles, c->tile_triangles_count,
+														 &c->tile_triangles_max, sizeof(GLTileTriangle));
+	index = c->tile_triangles_count++;
+	t = &c->tile_triangles[index];
+	t->p[0] = *p0;
+	t->p[1] = *p1;
+	t->p[2] = *p2;
+	t->fill = fill;
+	if (texture) {
+		t->texture = (PIXEL *)texture->pixmap;
+		t->texture_wbits = texture->xsize_bits;
+		t->texture_hbits = texture->ysize_bits;
+	} else {
+		t->texture = NULL;
+	}
+	t->shadow_mask_buf = zb->shadow_mask_buf;
+	t->shadow_color_r = zb->shadow_color_r;
+	t->shadow_color_g = zb->shadow_color_g;
+	t->shadow_color_b = zb->shadow_color_b;
+
+	ymin = MIN(p0->y, MIN(p1->y, p2->y));
+	ymax = MAX(p0->y, MAX(p1->y, p2->y));
+	first = CLIP(ymin, 0, zb->ysize - 1) / c->tile_height;
+	last = CLIP(ymax, 0, zb->ysize - 1) / c->tile_height;
+
+	for (int i = first; i <= last; i++) {
+		GLTile *tile = &c->tiles[i];
+		if (tile->count == tile->max)
+			tile->triangles = (int *)grow_array(tile->triangles, tile->count, &tile->max, sizeof(int));
+		tile->triangles[tile->count++] = index;
+	}
+}
+
+void gl_flush_tiles(GLContext *c) {
+	GLTileJob *job = c->tile_job;
+
+	if (c->tile_triangles_count == 0)
+		return;
+
+	{
+		Common::StackLock lock(job->mutex);
+		job->next = 0;
+	}
+	rasterize_tiles(c, false);
+
+	// wait for the tiles the worker is still drawing
+	for (;;) {
+		Common::StackLock lock(job->mutex);
+		if (job->busy == 0)
+			break;
+	}
+
+	c->tile_triangles_count = 0;
+}
+
+void gl_get_tile_stats(GLContext *c, int tile, int *triangles, unsigned int *millis, int *worker_flushes) {
+	if (tile < 0 || tile >= c->tile_count) {
+		*triangles = 0;
+		*millis = 0;
+		*worker_flushes = 0;
+		return;
+	}
+	*triangles = c->tiles[tile].triangles_drawn;
+	*millis = c->tiles[tile].millis;
+	*worker_flushes = c->tiles[tile].worker_flushes;
+}
+
+} // end of namespace TinyGL
@@ -2,6 +2,7 @@
 // Z buffer: 16,32 bits Z / 16 bits color
 
 #include "common/scummsys.h"
+#include "common/util.h"
 
 #include "graphics/tinygl/zbuffer.h"
 
@@ -17,6 +18,8 @@ ZBuffer *ZB_open(int xsize, int ysize, int mode, void *frame_buffer) {
 
 	zb->xsize = xsize;
 	zb->ysize = ysize;
+	zb->tile_y1 = 0;
+	zb->tile_y2 = ysize;
 	zb->mode = mode;
 	zb->linesize = (xsize * PSZB + 3) & ~3;
 
@@ -54,7 +57,10 @@ ZBuffer *ZB_open(int xsize, int ysize, int mode, void *frame_buffer) {
 	}
 
 	zb->current_texture = NULL;
+	zb->current_texture_wbits = 0;
+	zb->current_texture_hbits = 0;
 	zb->shadow_mask_buf = NULL;
+	zb->dirty_blocks = NULL;
 
 	return zb;
 error:
@@ -68,6 +74,7 @@ void ZB_close(ZBuffer *zb) {
 
     gl_free(zb->zbuf);
     gl_free(zb->zbuf2);
+    gl_free(zb->dirty_blocks);
     gl_free(zb);
 }
 
@@ -79,6 +86,8 @@ void ZB_resize(ZBuffer *zb, void *frame_buffer, int xsize, int ysize) {
 
 	zb->xsize = xsize;
 	zb->ysize = ysize;
+	zb->tile_y1 = 0;
+	zb->tile_y2 = ysize;
 	zb->linesize = (xsize * PSZB + 3) & ~3;
 
 	size = zb->xsize * zb->ysize * sizeof(unsigned short);
@@ -101,6 +110,45 @@ void ZB_resize(ZBuffer *zb, void *frame_buffer, int xsize, int ysize) {
 		zb->pbuf = (PIXEL *)frame_buffer;
 		zb->frame_buffer_allocated = 0;
 	}
+
+	if (zb->dirty_blocks)
+		ZB_enableDirtyBlocks(zb, 1);
+}
+
+void ZB_enableDirtyBlocks(ZBuffer *zb, int enable) {
+	gl_free(zb->dirty_blocks);
+	zb->dirty_blocks = NULL;
+	if (!enable)
+		return;
+
+	zb->dirty_blocks_width = (zb->xsize + (1 << ZB_DIRTY_BLOCK_BITS) - 1) >> ZB_DIRTY_BLOCK_BITS;
+	zb->dirty_blocks_height = (zb->ysize + (1 << ZB_DIRTY_BLOCK_BITS) - 1) >> ZB_DIRTY_BLOCK_BITS;
+	zb->dirty_blocks = (unsigned char *)gl_zalloc(zb->dirty_blocks_width * zb->dirty_blocks_height);
+}
+
+void ZB_markDirty(ZBuffer *zb, int x1, int y1, int x2, int y2) {
+	unsigned char *p;
+	int y;
+
+	if (!zb->dirty_blocks)
+		return;
+
+	x1 = MAX(x1, 0);
+	y1 = MAX(y1, 0);
+	x2 = MIN(x2, zb->xsize - 1);
+	y2 = MIN(y2, zb->ysize - 1);
+	if (x1 > x2 || y1 > y2)
+		return;
+
+	x1 >>= ZB_DIRTY_BLOCK_BITS;
+	x2 >>= ZB_DIRTY_BLOCK_BITS;
+	y1 >>= ZB_DIRTY_BLOCK_BITS;
+	y2 >>= ZB_DIRTY_BLOCK_BITS;
+	p = zb->dirty_blocks + y1 * zb->dirty_blocks_width + x1;
+	for (y = y1; y <= y2; y++) {
+		memset(p, 1, x2 - x1 + 1);
+		p += zb->dirty_blocks_width;
+	}
 }
 
 static void ZB_copyBuffer(ZBuffer *zb, void *buf, int linesize) {
@@ -183,6 +231,8 @@ void ZB_clear(ZBuffer *zb, int clear_z, int z, int clear_color, int r, int g, in
 	if (clear_z) {
 		memset_l(zb->zbuf2, z, zb->xsize * zb->ysize);
 	}
+	if (clear_z || clear_color)
+		ZB_markDirty(zb, 0, 0, zb->xsize - 1, zb->ysize - 1);
 	if (clear_color) {
 		pp = zb->pbuf;
 		for (y = 0; y < zb->ysize; y++) {
@@ -21,6 +21,9 @@ namespace TinyGL {
 #define ZB_POINT_BLUE_MIN ( (1 << 10) )
 #define ZB_POINT_BLUE_MAX ( (1 << 16) - (1 << 10) )
 
+// dirty blocks are squares of 2^ZB_DIRTY_BLOCK_BITS pixels
+#define ZB_DIRTY_BLOCK_BITS 5
+
 // display modes
 #define ZB_MODE_5R6G5B  1  // true color 16 bits
 
@@ -34,6 +37,8 @@ typedef struct {
 	int xsize, ysize;
 	int linesize; // line size, in bytes
 	int mode;
+	// lines the triangle fillers draw, the whole screen unless rasterizing a tile
+	int tile_y1, tile_y2;
 
 	unsigned short *zbuf;
 	unsigned int *zbuf2;
@@ -47,6 +52,12 @@ typedef struct {
 	unsigned char *dctable;
 	int *ctable;
 	PIXEL *current_texture;
+	int current_texture_wbits, current_texture_hbits; // log2 of its size
+
+	// one byte per block, set when something is drawn in the block.
+	// NULL unless enabled with ZB_enableDirtyBlocks()
+	unsigned char *dirty_blocks;
+	int dirty_blocks_width, dirty_blocks_height;
 } ZBuffer;
 
 typedef struct {
@@ -65,6 +76,9 @@ void ZB_resize(ZBuffer *zb, void *frame_buffer, int xsize, int ysize);
 void ZB_clear(ZBuffer *zb, int clear_z, int z, int clear_color, int r, int g, int b);
 // linesize is in BYTES
 void ZB_copyFrameBuffer(ZBuffer *zb, void *buf, int linesize);
+void ZB_enableDirtyBlocks(ZBuffer *zb, int enable);
+// the rectangle is inclusive and clipped to the buffer
+void ZB_markDirty(ZBuffer *zb, int x1, int y1, int x2, int y2);
 
 // zline.c
 
@@ -74,7 +88,7 @@ void ZB_line_z(ZBuffer * zb, ZBufferPoint * p1, ZBufferPoint * p2);
 
 // ztriangle.c */
 
-void ZB_setTexture(ZBuffer *zb, PIXEL *texture);
+void ZB_setTexture(ZBuffer *zb, PIXEL *texture, int wbits, int hbits);
 void ZB_fillTriangleFlat(ZBuffer *zb, ZBufferPoint *p1, 
 						 ZBufferPoint *p2, ZBufferPoint *p3);
 void ZB_fillTriangleFlatShadowMask(ZBuffer *zb, ZBufferPoint *p1, 
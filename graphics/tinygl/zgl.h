@@ -126,6 +126,7 @@ typedef struct GLVertex {
 typedef struct GLImage {
 	void *pixmap;
 	int xsize, ysize;
+	int xsize_bits, ysize_bits; // log2 of xsize and ysize
 } GLImage;
 
 // textures
@@ -134,6 +135,9 @@ typedef struct GLImage {
 
 typedef struct GLTexture {
 	GLImage images[MAX_TEXTURE_LEVELS];
+	int num_levels; // length of the complete mip chain starting at images[0]
+	int min_filter;
+	int generate_mipmap;
 	int handle;
 	struct GLTexture *next, *prev;
 } GLTexture;
@@ -147,6 +151,9 @@ typedef struct GLSharedState {
 } GLSharedState;
 
 struct GLContext;
+struct GLTile;
+struct GLTileTriangle;
+struct GLTileJob;
 
 typedef void (*gl_draw_triangle_func)(GLContext *c, GLVertex *p0, GLVertex *p1, GLVertex *p2);
 
@@ -259,6 +266,14 @@ typedef struct GLContext {
 
 	int shadow_mode;
 
+	// tiled rasterization
+	int tile_count;
+	int tile_height;
+	GLTile *tiles;
+	GLTileTriangle *tile_triangles;
+	int tile_triangles_count, tile_triangles_max;
+	GLTileJob *tile_job;
+
 	// specular buffer. could probably be shared between contexts, 
 	// but that wouldn't be 100% thread safe
 	GLSpecBuf *specbuf_first;
@@ -300,9 +315,12 @@ void gl_shade_vertex(GLContext *c, GLVertex *v);
 void glInitTextures(GLContext *c);
 void glEndTextures(GLContext *c);
 GLTexture *alloc_texture(GLContext *c, int h);
+GLImage *gl_select_texture_level(GLContext *c, ZBufferPoint *p0, ZBufferPoint *p1, ZBufferPoint *p2);
 
 // image_util.c
 void gl_convertRGB_to_5R6G5B8A(unsigned short *pixmap, unsigned char *rgba, int xsize, int ysize);
+void gl_convert565_to_5R6G5B8A(unsigned char *pixmap, const unsigned short *rgb, int xsize, int ysize);
+void gl_halveImage5R6G5B8A(unsigned char *dest, const unsigned char *src, int xsize_src, int ysize_src);
 void gl_resizeImage(unsigned char *dest, int xsize_dest, int ysize_dest,
 					unsigned char *src, int xsize_src, int ysize_src);
 void gl_resizeImageNoInterpolate(unsigned char *dest, int xsize_dest, int ysize_dest,
@@ -310,6 +328,13 @@ void gl_resizeImageNoInterpolate(unsigned char *dest, int xsize_dest, int ysize_
 
 GLContext *gl_get_context();
 
+// tile.c
+void gl_set_tile_count(GLContext *c, int count);
+void gl_add_tile_triangle(GLContext *c, ZB_fillTriangleFunc fill, GLImage *texture,
+						  ZBufferPoint *p0, ZBufferPoint *p1, ZBufferPoint *p2);
+void gl_flush_tiles(GLContext *c);
+void gl_get_tile_stats(GLContext *c, int tile, int *triangles, unsigned int *millis, int *worker_flushes);
+
 // specular buffer "api"
 GLSpecBuf *specbuf_get_buffer(GLContext *c, const int shininess_i, const float shininess);
 
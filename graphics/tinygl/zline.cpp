@@ -1,4 +1,6 @@
 
+#include "common/util.h"
+
 #include "graphics/tinygl/zbuffer.h"
 
 namespace TinyGL {
@@ -11,6 +13,7 @@ void ZB_plot(ZBuffer * zb, ZBufferPoint * p) {
 	PIXEL *pp;
 	unsigned int zz;
 
+	ZB_markDirty(zb, p->x, p->y, p->x, p->y);
 	pz = zb->zbuf + (p->y * zb->xsize + p->x);
 	pz_2 = zb->zbuf2 + (p->y * zb->xsize + p->x);
 	pp = (PIXEL *)((char *) zb->pbuf + zb->linesize * p->y + p->x * PSZB);
@@ -46,6 +49,7 @@ static void ZB_line_interp(ZBuffer *zb, ZBufferPoint *p1, ZBufferPoint *p2) {
 void ZB_line_z(ZBuffer *zb, ZBufferPoint *p1, ZBufferPoint *p2) {
 	int color1, color2;
 
+	ZB_markDirty(zb, MIN(p1->x, p2->x), MIN(p1->y, p2->y), MAX(p1->x, p2->x), MAX(p1->y, p2->y));
 	color1 = RGB_TO_PIXEL(p1->r, p1->g, p1->b);
 	color2 = RGB_TO_PIXEL(p2->r, p2->g, p2->b);
 
@@ -60,6 +64,7 @@ void ZB_line_z(ZBuffer *zb, ZBufferPoint *p1, ZBufferPoint *p2) {
 void ZB_line(ZBuffer *zb, ZBufferPoint *p1, ZBufferPoint *p2) {
 	int color1, color2;
 
+	ZB_markDirty(zb, MIN(p1->x, p2->x), MIN(p1->y, p2->y), MAX(p1->x, p2->x), MAX(p1->y, p2->y));
 	color1 = RGB_TO_PIXEL(p1->r, p1->g, p1->b);
 	color2 = RGB_TO_PIXEL(p2->r, p2->g, p2->b);
 
@@ -1,11 +1,157 @@
 
 #include "common/endian.h"
+#include "common/util.h"
 #include "graphics/tinygl/zbuffer.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 namespace TinyGL {
 
 #define ZCMP(z, zpix) ((z) >= (zpix))
 
+#ifdef __SSE2__
+
+// The span fillers below handle 8 pixels per iteration with SSE2. The scalar
+// loops after them are the reference implementation and draw the remaining pixels.
+
+// Depth tests the 8 pixels whose z values are in z0 (pixels 0-3) and z1 (pixels 4-7),
+// stores the new z values of the visible ones and returns a mask with 0xffff
+// in the 16-bit lanes of the hidden pixels.
+static inline __m128i zTest8(unsigned short *pz, unsigned int *pz_2, __m128i z0, __m128i z1) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i bias = _mm_set1_epi32((int)0x80000000);
+
+	__m128i zbuf = _mm_loadu_si128((const __m128i *)pz);
+	__m128i zbuf2_0 = _mm_loadu_si128((const __m128i *)pz_2);
+	__m128i zbuf2_1 = _mm_loadu_si128((const __m128i *)(pz_2 + 4));
+
+	// zz >= pz[i], both fit in 18 bits so a signed compare is enough
+	__m128i hidden0 = _mm_cmpgt_epi32(_mm_unpacklo_epi16(zbuf, zero), _mm_srli_epi32(z0, ZB_POINT_Z_FRAC_BITS));
+	__m128i hidden1 = _mm_cmpgt_epi32(_mm_unpackhi_epi16(zbuf, zero), _mm_srli_epi32(z1, ZB_POINT_Z_FRAC_BITS));
+	// z >= pz_2[i], unsigned
+	hidden0 = _mm_or_si128(hidden0, _mm_cmpgt_epi32(_mm_xor_si128(zbuf2_0, bias), _mm_xor_si128(z0, bias)));
+	hidden1 = _mm_or_si128(hidden1, _mm_cmpgt_epi32(_mm_xor_si128(zbuf2_1, bias), _mm_xor_si128(z1, bias)));
+
+	_mm_storeu_si128((__m128i *)pz_2, _mm_or_si128(_mm_and_si128(hidden0, zbuf2_0), _mm_andnot_si128(hidden0, z0)));
+	_mm_storeu_si128((__m128i *)(pz_2 + 4), _mm_or_si128(_mm_and_si128(hidden1, zbuf2_1), _mm_andnot_si128(hidden1, z1)));
+
+	return _mm_packs_epi32(hidden0, hidden1);
+}
+
+static inline void putPixels8(PIXEL *pp, __m128i pixels, __m128i hidden) {
+	__m128i old = _mm_loadu_si128((const __m128i *)pp);
+	_mm_storeu_si128((__m128i *)pp, _mm_or_si128(_mm_and_si128(hidden, old), _mm_andnot_si128(hidden, pixels)));
+}
+
+#endif
+
+// Draws the n + 1 pixels of a flat shaded span
+static inline void fillFlatSpan(PIXEL *pp, unsigned short *pz, unsigned int *pz_2, int n,
+								unsigned int z, int dzdx, PIXEL color) {
+	unsigned int zz;
+
+#ifdef __SSE2__
+	if (n >= 7) {
+		const __m128i pixels = _mm_set1_epi16((short)color);
+		const __m128i step = _mm_set1_epi32(dzdx * 8);
+		__m128i z0 = _mm_add_epi32(_mm_set1_epi32(z), _mm_set_epi32(dzdx * 3, dzdx * 2, dzdx, 0));
+		__m128i z1 = _mm_add_epi32(z0, _mm_set1_epi32(dzdx * 4));
+		while (n >= 7) {
+			putPixels8(pp, pixels, zTest8(pz, pz_2, z0, z1));
+			z0 = _mm_add_epi32(z0, step);
+			z1 = _mm_add_epi32(z1, step);
+			z += dzdx * 8;
+			pp += 8;
+			pz += 8;
+			pz_2 += 8;
+			n -= 8;
+		}
+	}
+#endif
+
+	while (n >= 0) {
+		zz = z >> ZB_POINT_Z_FRAC_BITS;
+		if ((ZCMP(zz, pz[0])) && (ZCMP(z, pz_2[0]))) {
+			pp[0] = color;
+			pz_2[0] = z;
+		}
+		z += dzdx;
+		pp += 1;
+		pz += 1;
+		pz_2 += 1;
+		n -= 1;
+	}
+}
+
+// Draws the n + 1 pixels of a smooth shaded span. rgb holds the color in the
+// packed format described in ZB_fillTriangleSmooth().
+static inline void fillSmoothSpan(PIXEL *pp, unsigned short *pz, unsigned int *pz_2, int n,
+								  unsigned int z, int dzdx, unsigned int rgb, unsigned int drgbdx) {
+	unsigned int zz, tmp;
+
+#ifdef __SSE2__
+	if (n >= 7) {
+		// The fields of the packed color wrap around independently, so each
+		// one is stepped on its own and they are merged again per pixel
+		const __m128i zstep = _mm_set1_epi32(dzdx * 8);
+		const __m128i rmask = _mm_set1_epi32((int)0xFFC00000);
+		const __m128i bmask = _mm_set1_epi32(0x001FF000);
+		const __m128i gmask = _mm_set1_epi32(0x000007FF);
+		const __m128i pmask = _mm_set1_epi32((int)0xF81F07E0);
+		unsigned int dr = drgbdx & 0xFFC00000, db = drgbdx & 0x001FF000, dg = drgbdx & 0x000007FF;
+		__m128i r0 = _mm_add_epi32(_mm_set1_epi32(rgb & 0xFFC00000), _mm_set_epi32(dr * 3, dr * 2, dr, 0));
+		__m128i b0 = _mm_add_epi32(_mm_set1_epi32(rgb & 0x001FF000), _mm_set_epi32(db * 3, db * 2, db, 0));
+		__m128i g0 = _mm_add_epi32(_mm_set1_epi32(rgb & 0x000007FF), _mm_set_epi32(dg * 3, dg * 2, dg, 0));
+		__m128i z0 = _mm_add_epi32(_mm_set1_epi32(z), _mm_set_epi32(dzdx * 3, dzdx * 2, dzdx, 0));
+		while (n >= 7) {
+			__m128i rgb0 = _mm_or_si128(_mm_and_si128(r0, rmask),
+							_mm_or_si128(_mm_and_si128(b0, bmask), _mm_and_si128(g0, gmask)));
+			__m128i rgb1 = _mm_or_si128(_mm_and_si128(_mm_add_epi32(r0, _mm_set1_epi32(dr * 4)), rmask),
+							_mm_or_si128(_mm_and_si128(_mm_add_epi32(b0, _mm_set1_epi32(db * 4)), bmask),
+										 _mm_and_si128(_mm_add_epi32(g0, _mm_set1_epi32(dg * 4)), gmask)));
+			__m128i z1 = _mm_add_epi32(z0, _mm_set1_epi32(dzdx * 4));
+
+			// tmp | (tmp >> 16) in the low half of each lane, sign extended so that
+			// the saturating pack keeps the 16 bits unchanged
+			rgb0 = _mm_and_si128(rgb0, pmask);
+			rgb1 = _mm_and_si128(rgb1, pmask);
+			rgb0 = _mm_srai_epi32(_mm_slli_epi32(_mm_or_si128(rgb0, _mm_srli_epi32(rgb0, 16)), 16), 16);
+			rgb1 = _mm_srai_epi32(_mm_slli_epi32(_mm_or_si128(rgb1, _mm_srli_epi32(rgb1, 16)), 16), 16);
+
+			putPixels8(pp, _mm_packs_epi32(rgb0, rgb1), zTest8(pz, pz_2, z0, z1));
+
+			r0 = _mm_add_epi32(r0, _mm_set1_epi32(dr * 8));
+			b0 = _mm_add_epi32(b0, _mm_set1_epi32(db * 8));
+			g0 = _mm_add_epi32(g0, _mm_set1_epi32(dg * 8));
+			z0 = _mm_add_epi32(z0, zstep);
+			z += dzdx * 8;
+			rgb = ((rgb + dr * 8) & 0xFFC00000) | ((rgb + db * 8) & 0x001FF000) | ((rgb + dg * 8) & 0x000007FF);
+			pp += 8;
+			pz += 8;
+			pz_2 += 8;
+			n -= 8;
+		}
+	}
+#endif
+
+	while (n >= 0) {
+		zz = z >> ZB_POINT_Z_FRAC_BITS;
+		if ((ZCMP(zz, pz[0])) && (ZCMP(z, pz_2[0]))) {
+			tmp = rgb & 0xF81F07E0;
+			pp[0] = tmp | (tmp >> 16);
+			pz_2[0] = z;
+		}
+		z += dzdx;
+		rgb = (rgb + drgbdx) & (~0x00200800);
+		pp += 1;
+		pz += 1;
+		pz_2 += 1;
+		n -= 1;
+	}
+}
+
 void ZB_fillTriangleFlat(ZBuffer *zb, ZBufferPoint *p0, ZBufferPoint *p1, ZBufferPoint *p2) {
 	int color;
 
@@ -15,13 +161,8 @@ void ZB_fillTriangleFlat(ZBuffer *zb, ZBufferPoint *p0, ZBufferPoint *p1, ZBuffe
 	color = RGB_TO_PIXEL(p2->r, p2->g, p2->b);	\
 }
 
-#define PUT_PIXEL(_a) {						\
-	zz = z >> ZB_POINT_Z_FRAC_BITS;			\
-	if ((ZCMP(zz, pz[_a])) && (ZCMP(z, pz_2[_a]))) {	\
-	pp[_a] = color;						\
-	pz_2[_a] = z;							\
-	}										\
-	z += dzdx;								\
+#define DRAW_LINE()	{												\
+	fillFlatSpan(pp1 + x1, pz1 + x1, pz2 + x1, (x2 >> 16) - x1, z1, dzdx, color);	\
 }
 
 #include "graphics/tinygl/ztriangle.h"
@@ -44,56 +185,21 @@ void ZB_fillTriangleSmooth(ZBuffer *zb, ZBufferPoint *p0, ZBufferPoint *p1, ZBuf
 	_drgbdx |= (SAR_RND_TO_ZERO(dbdx, 7) << 12) & 0x001FF000; 	\
 }
 
-#define PUT_PIXEL(_a) {						\
-	zz = z >> ZB_POINT_Z_FRAC_BITS;			\
-	if ((ZCMP(zz, pz[_a])) && (ZCMP(z, pz_2[_a]))) {	\
-		tmp = rgb & 0xF81F07E0;				\
-		pp[_a] = tmp | (tmp >> 16);			\
-		pz_2[_a] = z;						\
-	}										\
-	z += dzdx;								\
-	rgb = (rgb + drgbdx) & (~0x00200800);	\
-}
-
 #define DRAW_LINE()	{								\
-	register unsigned short *pz;					\
-	register unsigned int *pz_2;					\
-	register PIXEL *pp;								\
-	register unsigned int z, zz, rgb, drgbdx;	\
-	register int n;									\
-	n = (x2 >> 16) - x1;							\
-	pp = pp1 + x1;									\
-	pz = pz1 + x1;									\
-	pz_2 = pz2 + x1;								\
-	z = z1;											\
+	register unsigned int rgb;						\
 	rgb =(r1 << 16) & 0xFFC00000;					\
 	rgb |= (g1 >> 5) & 0x000007FF;					\
 	rgb |= (b1 << 5) & 0x001FF000;					\
-	drgbdx = _drgbdx;								\
-	while (n >= 3) {								\
-		PUT_PIXEL(0);								\
-		PUT_PIXEL(1);								\
-		PUT_PIXEL(2);								\
-		PUT_PIXEL(3);								\
-		pz += 4;									\
-		pz_2 += 4;									\
-		pp += 4;									\
-		n -= 4;										\
-	}												\
-	while (n >= 0) {								\
-		PUT_PIXEL(0);								\
-		pz += 1;									\
-		pz_2 += 1;									\
-		pp += 1;									\
-		n -= 1;										\
-	}												\
+	fillSmoothSpan(pp1 + x1, pz1 + x1, pz2 + x1, (x2 >> 16) - x1, z1, dzdx, rgb, _drgbdx);	\
 }
 
 #include "graphics/tinygl/ztriangle.h"
 }
 
-void ZB_setTexture(ZBuffer *zb, PIXEL *texture) {
-	zb->current_texture=texture;
+void ZB_setTexture(ZBuffer *zb, PIXEL *texture, int wbits, int hbits) {
+	zb->current_texture = texture;
+	zb->current_texture_wbits = wbits;
+	zb->current_texture_hbits = hbits;
 }
 
 void ZB_fillTriangleMapping(ZBuffer *zb, ZBufferPoint *p0, ZBufferPoint *p1, ZBufferPoint *p2) {
@@ -124,6 +230,8 @@ void ZB_fillTriangleMappingPerspective(ZBuffer *zb, ZBufferPoint *p0, ZBufferPoi
 	PIXEL *texture;
 	float fdzdx, fndzdx, ndszdx, ndtzdx;
 	int _drgbdx;
+	int wbits, s_shift, t_shift;
+	unsigned int s_mask, t_mask;
 
 #define NB_INTERP 8
 
@@ -134,7 +242,7 @@ void ZB_fillTriangleMappingPerspective(ZBuffer *zb, ZBufferPoint *p0, ZBufferPoi
 	PIXEL *pp1;
 	int part, update_left, update_right;
 
-	int nb_lines, dx1, dy1, tmp, dx2, dy2;
+	int nb_lines, line_y, skip, steps, dx1, dy1, tmp, dx2, dy2;
 
 	int error = 0, derror = 0;
 	int x1 = 0, dxdy_min = 0, dxdy_max = 0;
@@ -234,7 +342,13 @@ void ZB_fillTriangleMappingPerspective(ZBuffer *zb, ZBufferPoint *p0, ZBufferPoi
 	pz1 = zb->zbuf + p0->y * zb->xsize;
 	pz2 = zb->zbuf2 + p0->y * zb->xsize;
 
+	// s and t have 22 fractional bits, the texel coordinates are their top bits
 	texture = zb->current_texture;
+	wbits = zb->current_texture_wbits;
+	s_shift = 22 - wbits;
+	t_shift = 22 - zb->current_texture_hbits;
+	s_mask = (1 << wbits) - 1;
+	t_mask = (1 << zb->current_texture_hbits) - 1;
 	fdzdx = (float)dzdx;
 	fndzdx = NB_INTERP * fdzdx;
 	ndszdx = NB_INTERP * dszdx;
@@ -261,6 +375,7 @@ void ZB_fillTriangleMappingPerspective(ZBuffer *zb, ZBufferPoint *p0, ZBufferPoi
 				pr2 = p2;
 			}
 			nb_lines = p1->y - p0->y;
+			line_y = p0->y;
 		} else {
 			// second part
 			if (fz0 > 0) {
@@ -275,6 +390,7 @@ void ZB_fillTriangleMappingPerspective(ZBuffer *zb, ZBufferPoint *p0, ZBufferPoi
 				l2 = p2;
 			}
 			nb_lines = p2->y - p1->y + 1;
+			line_y = p1->y;
 		}
 
 		// compute the values for the left edge
@@ -329,6 +445,40 @@ void ZB_fillTriangleMappingPerspective(ZBuffer *zb, ZBufferPoint *p0, ZBufferPoi
 			x2 = pr1->x << 16;
 		}
 
+		// only the lines of the current tile are drawn: the edges are moved past
+		// the lines above it in one step and the part stops at its last line
+		skip = MIN(zb->tile_y1 - line_y, nb_lines);
+		if (skip > 0) {
+			// sz and tz are stepped line by line to round as they do on drawn lines,
+			// counting the lines on which the left edge took its bigger step
+			steps = 0;
+			for (int i = 0; i < skip; i++) {
+				error += derror;
+				if (error > 0) {
+					error -= 0x10000;
+					sz1 += dszdl_max;
+					tz1 += dtzdl_max;
+					steps++;
+				} else {
+					sz1 += dszdl_min;
+					tz1 += dtzdl_min;
+				}
+			}
+			x1 += skip * dxdy_min + steps;
+			z1 += skip * dzdl_min + steps * dzdx;
+			r1 += skip * drdl_min + steps * drdx;
+			g1 += skip * dgdl_min + steps * dgdx;
+			b1 += skip * dbdl_min + steps * dbdx;
+			x2 += skip * dx2dy2;
+			pp1 = (PIXEL *)((char *)pp1 + skip * zb->linesize);
+			pz1 += skip * zb->xsize;
+			pz2 += skip * zb->xsize;
+			nb_lines -= skip;
+			line_y += skip;
+		}
+		if (nb_lines > zb->tile_y2 - line_y)
+			nb_lines = zb->tile_y2 - line_y;
+
 		// we draw all the scan line of the part
 
 		while (nb_lines > 0) {
@@ -368,9 +518,8 @@ void ZB_fillTriangleMappingPerspective(ZBuffer *zb, ZBufferPoint *p0, ZBufferPoi
 					for (int _a = 0; _a < 8; _a++) {
 						zz = z >> ZB_POINT_Z_FRAC_BITS;
 						if ((ZCMP(zz, pz[_a])) && (ZCMP(z, pz_2[_a]))) {
-							unsigned ttt = (t & 0x003FC000) >> (9 - PSZSH);
-							unsigned sss = (s & 0x003FC000) >> (17 - PSZSH);
-							char *ptr = (char *)(texture) + (((ttt | sss) >> 1) * 3);
+							unsigned texel = (((t >> t_shift) & t_mask) << wbits) | ((s >> s_shift) & s_mask);
+							char *ptr = (char *)(texture) + texel * 3;
 							PIXEL pixel = READ_UINT16(ptr);
 							char alpha = *(ptr + 2);
 							if (alpha == '\xff') {
@@ -418,9 +567,8 @@ void ZB_fillTriangleMappingPerspective(ZBuffer *zb, ZBufferPoint *p0, ZBufferPoi
 					{
 						zz = z >> ZB_POINT_Z_FRAC_BITS;
 						if ((ZCMP(zz, pz[0])) && (ZCMP(z, pz_2[0]))) {
-							unsigned ttt = (t & 0x003FC000) >> (9 - PSZSH);
-							unsigned sss = (s & 0x003FC000) >> (17 - PSZSH);
-							char *ptr = (char *)(texture) + (((ttt | sss) >> 1) * 3);
+							unsigned texel = (((t >> t_shift) & t_mask) << wbits) | ((s >> s_shift) & s_mask);
+							char *ptr = (char *)(texture) + texel * 3;
 							PIXEL pixel = READ_UINT16(ptr);
 							char alpha = *(ptr + 2);
 							if (alpha == '\xff') {
@@ -9,7 +9,7 @@
 	PIXEL *pp1;
 	int part, update_left, update_right;
 
-	int nb_lines, dx1, dy1, tmp, dx2, dy2;
+	int nb_lines, line_y, skip, steps, dx1, dy1, tmp, dx2, dy2;
 
 	int error = 0, derror = 0;
 	int x1 = 0, dxdy_min = 0, dxdy_max = 0;
@@ -156,6 +156,7 @@
 				pr2 = p2;
 			}
 			nb_lines = p1->y - p0->y;
+			line_y = p0->y;
 		} else {
 			// second part
 			if (fz > 0) {
@@ -170,6 +171,7 @@
 				l2 = p2;
 			}
 			nb_lines = p2->y - p1->y + 1;
+			line_y = p1->y;
 		}
 
 		// compute the values for the left edge
@@ -237,6 +239,55 @@
 			x2 = pr1->x << 16;
 		}
 
+		// only the lines of the current tile are drawn: the edges are moved past
+		// the lines above it in one step and the part stops at its last line
+		skip = MIN(zb->tile_y1 - line_y, nb_lines);
+		if (skip > 0) {
+#ifdef INTERP_STZ
+			// sz and tz are stepped line by line to round as they do on drawn lines,
+			// counting the lines on which the left edge took its bigger step
+			steps = 0;
+			for (int i = 0; i < skip; i++) {
+				error += derror;
+				if (error > 0) {
+					error -= 0x10000;
+					sz1 += dszdl_max;
+					tz1 += dtzdl_max;
+					steps++;
+				} else {
+					sz1 += dszdl_min;
+					tz1 += dtzdl_min;
+				}
+			}
+#else
+			// the left edge took its bigger step on the lines where the error overflowed
+			error += skip * derror;
+			steps = (error + 0xffff) >> 16;
+			error -= steps << 16;
+#endif
+			x1 += skip * dxdy_min + steps;
+#ifdef INTERP_Z
+			z1 += skip * dzdl_min + steps * dzdx;
+#endif
+#ifdef INTERP_RGB
+			r1 += skip * drdl_min + steps * drdx;
+			g1 += skip * dgdl_min + steps * dgdx;
+			b1 += skip * dbdl_min + steps * dbdx;
+#endif
+#ifdef INTERP_ST
+			s1 += skip * dsdl_min + steps * dsdx;
+			t1 += skip * dtdl_min + steps * dtdx;
+#endif
+			x2 += skip * dx2dy2;
+			pp1 = (PIXEL *)((char *)pp1 + skip * zb->linesize);
+			pz1 += skip * zb->xsize;
+			pz2 += skip * zb->xsize;
+			nb_lines -= skip;
+			line_y += skip;
+		}
+		if (nb_lines > zb->tile_y2 - line_y)
+			nb_lines = zb->tile_y2 - line_y;
+
 		// we draw all the scan line of the part
 
 		while (nb_lines>0) {
@@ -1,4 +1,6 @@
 
+#include "common/util.h"
+
 #include "graphics/tinygl/zbuffer.h"
 
 namespace TinyGL {
@@ -11,7 +13,7 @@ void ZB_fillTriangleFlatShadowMask(ZBuffer *zb, ZBufferPoint *p0, ZBufferPoint *
 	unsigned char *pm1;
 	int part, update_left, update_right;
 
-	int nb_lines, dx1, dy1, tmp, dx2, dy2;
+	int nb_lines, line_y, skip, steps, dx1, dy1, tmp, dx2, dy2;
 
 	int error = 0, derror = 0;
 	int x1 = 0, dxdy_min = 0, dxdy_max = 0;
@@ -75,6 +77,7 @@ void ZB_fillTriangleFlatShadowMask(ZBuffer *zb, ZBufferPoint *p0, ZBufferPoint *
 				pr2 = p2;
 			}
 			nb_lines = p1->y - p0->y;
+			line_y = p0->y;
 		} else {
 			// second part
 			if (fz > 0) {
@@ -89,6 +92,7 @@ void ZB_fillTriangleFlatShadowMask(ZBuffer *zb, ZBufferPoint *p0, ZBufferPoint *
 				l2 = p2;
 			}
 			nb_lines = p2->y - p1->y + 1;
+			line_y = p1->y;
 		}
 
 		// compute the values for the left edge
@@ -118,6 +122,23 @@ void ZB_fillTriangleFlatShadowMask(ZBuffer *zb, ZBufferPoint *p0, ZBufferPoint *
 			x2 = pr1->x << 16;
 		}
 
+		// only the lines of the current tile are drawn: the edges are moved past
+		// the lines above it in one step and the part stops at its last line
+		skip = MIN(zb->tile_y1 - line_y, nb_lines);
+		if (skip > 0) {
+			// the left edge took its bigger step on the lines where the error overflowed
+			error += skip * derror;
+			steps = (error + 0xffff) >> 16;
+			error -= steps << 16;
+			x1 += skip * dxdy_min + steps;
+			x2 += skip * dx2dy2;
+			pm1 += skip * zb->xsize;
+			nb_lines -= skip;
+			line_y += skip;
+		}
+		if (nb_lines > zb->tile_y2 - line_y)
+			nb_lines = zb->tile_y2 - line_y;
+
 		// we draw all the scan line of the part
 		while (nb_lines > 0) {
 			nb_lines--;
@@ -170,7 +191,7 @@ void ZB_fillTriangleFlatShadow(ZBuffer *zb, ZBufferPoint *p0, ZBufferPoint *p1,
 	PIXEL *pp1;
 	int part, update_left, update_right;
 
-	int nb_lines, dx1, dy1, tmp, dx2, dy2;
+	int nb_lines, line_y, skip, steps, dx1, dy1, tmp, dx2, dy2;
 
 	int error = 0, derror = 0;
 	int x1 = 0, dxdy_min = 0, dxdy_max = 0;
@@ -246,6 +267,7 @@ void ZB_fillTriangleFlatShadow(ZBuffer *zb, ZBufferPoint *p0, ZBufferPoint *p1,
 				pr2 = p2;
 			}
 			nb_lines = p1->y - p0->y;
+			line_y = p0->y;
 		} else {
 			// second part
 			if (fz > 0) {
@@ -260,6 +282,7 @@ void ZB_fillTriangleFlatShadow(ZBuffer *zb, ZBufferPoint *p0, ZBufferPoint *p1,
 				l2 = p2;
 			}
 			nb_lines = p2->y - p1->y + 1;
+			line_y = p1->y;
 		}
 
 		// compute the values for the left edge
@@ -294,6 +317,27 @@ void ZB_fillTriangleFlatShadow(ZBuffer *zb, ZBufferPoint *p0, ZBufferPoint *p1,
 			x2 = pr1->x << 16;
 		}
 
+		// only the lines of the current tile are drawn: the edges are moved past
+		// the lines above it in one step and the part stops at its last line
+		skip = MIN(zb->tile_y1 - line_y, nb_lines);
+		if (skip > 0) {
+			// the left edge took its bigger step on the lines where the error overflowed
+			error += skip * derror;
+			steps = (error + 0xffff) >> 16;
+			error -= steps << 16;
+			x1 += skip * dxdy_min + steps;
+			z1 += skip * dzdl_min + steps * dzdx;
+			x2 += skip * dx2dy2;
+			pp1 = (PIXEL *)((char *)pp1 + skip * zb->linesize);
+			pz1 += skip * zb->xsize;
+			pz2 += skip * zb->xsize;
+			pm1 += skip * zb->xsize;
+			nb_lines -= skip;
+			line_y += skip;
+		}
+		if (nb_lines > zb->tile_y2 - line_y)
+			nb_lines = zb->tile_y2 - line_y;
+
 		// we draw all the scan line of the part
 
 		while (nb_lines > 0) {
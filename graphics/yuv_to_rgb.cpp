@@ -91,6 +91,10 @@
 
 #include "graphics/surface.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 namespace Graphics {
 
 class YUVToRGBLookup {
@@ -240,6 +244,90 @@ void convertYUV420ToRGB(byte *dstPtr, int dstPitch, const YUVToRGBLookup *lookup
 	}
 }
 
+#ifdef __SSE2__
+
+// Converts 8 pixels of a row, with the chroma offsets of each pixel in dr,
+// dg and db, to RGB565.
+static inline void putRGB565Pixels8(byte *dstPtr, const byte *ySrc, __m128i dr, __m128i dg, __m128i db) {
+	const __m128i zero = _mm_setzero_si128();
+	__m128i y = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)ySrc), zero);
+
+	// Saturating to bytes clamps the components like the spread out
+	// entries of the rgbToPix table do
+	__m128i r = _mm_unpacklo_epi8(_mm_packus_epi16(_mm_add_epi16(y, dr), zero), zero);
+	__m128i g = _mm_unpacklo_epi8(_mm_packus_epi16(_mm_add_epi16(y, dg), zero), zero);
+	__m128i b = _mm_unpacklo_epi8(_mm_packus_epi16(_mm_add_epi16(y, db), zero), zero);
+
+	r = _mm_slli_epi16(_mm_and_si128(r, _mm_set1_epi16(0xF8)), 8);
+	g = _mm_slli_epi16(_mm_and_si128(g, _mm_set1_epi16(0xFC)), 3);
+	b = _mm_srli_epi16(b, 3);
+	_mm_storeu_si128((__m128i *)dstPtr, _mm_or_si128(_mm_or_si128(r, g), b));
+}
+
+// RGB565 is what the movies are decoded to, so it gets an SSE2 version of the
+// loop above, converting 8x2 pixels at a time. The chroma offsets are read from
+// the same tables, so that both versions produce the same pixels.
+static void convertYUV420ToRGB565(byte *dstPtr, int dstPitch, const YUVToRGBLookup *lookup, const byte *ySrc, const byte *uSrc, const byte *vSrc, int yWidth, int yHeight, int yPitch, int uvPitch) {
+	typedef uint16 PixelInt;
+	int halfHeight = yHeight >> 1;
+	int halfWidth = yWidth >> 1;
+
+	const int16 *Cr_r_tab = lookup->_colorTab;
+	const int16 *Cr_g_tab = Cr_r_tab + 256;
+	const int16 *Cb_g_tab = Cr_g_tab + 256;
+	const int16 *Cb_b_tab = Cb_g_tab + 256;
+	const uint32 *rgbToPix = lookup->_rgbToPix;
+
+	for (int h = 0; h < halfHeight; h++) {
+		int w = 0;
+		for (; w + 4 <= halfWidth; w += 4) {
+			int16 r[4], g[4], b[4];
+			for (int i = 0; i < 4; i++) {
+				// Remove the offsets of the component tables in rgbToPix
+				r[i] = Cr_r_tab[vSrc[i]] - (0 * 768 + 256);
+				g[i] = Cr_g_tab[vSrc[i]] + Cb_g_tab[uSrc[i]] - (1 * 768 + 256);
+				b[i] = Cb_b_tab[uSrc[i]] - (2 * 768 + 256);
+			}
+			__m128i dr = _mm_set_epi16(r[3], r[3], r[2], r[2], r[1], r[1], r[0], r[0]);
+			__m128i dg = _mm_set_epi16(g[3], g[3], g[2], g[2], g[1], g[1], g[0], g[0]);
+			__m128i db = _mm_set_epi16(b[3], b[3], b[2], b[2], b[1], b[1], b[0], b[0]);
+
+			putRGB565Pixels8(dstPtr, ySrc, dr, dg, db);
+			putRGB565Pixels8(dstPtr + dstPitch, ySrc + yPitch, dr, dg, db);
+			uSrc += 4;
+			vSrc += 4;
+			ySrc += 8;
+			dstPtr += 8 * sizeof(PixelInt);
+		}
+
+		for (; w < halfWidth; w++) {
+			register const uint32 *L;
+
+			int16 cr_r  = Cr_r_tab[*vSrc];
+			int16 crb_g = Cr_g_tab[*vSrc] + Cb_g_tab[*uSrc];
+			int16 cb_b  = Cb_b_tab[*uSrc];
+			++uSrc;
+			++vSrc;
+
+			PUT_PIXEL(*ySrc, dstPtr);
+			PUT_PIXEL(*(ySrc + yPitch), dstPtr + dstPitch);
+			ySrc++;
+			dstPtr += sizeof(PixelInt);
+			PUT_PIXEL(*ySrc, dstPtr);
+			PUT_PIXEL(*(ySrc + yPitch), dstPtr + dstPitch);
+			ySrc++;
+			dstPtr += sizeof(PixelInt);
+		}
+
+		dstPtr += dstPitch * 2 - yWidth * sizeof(PixelInt);
+		ySrc += (yPitch << 1) - yWidth;
+		uSrc += uvPitch - halfWidth;
+		vSrc += uvPitch - halfWidth;
+	}
+}
+
+#endif
+
 void convertYUV420ToRGB(Graphics::Surface *dst, const byte *ySrc, const byte *uSrc, const byte *vSrc, int yWidth, int yHeight, int yPitch, int uvPitch) {
 	// Sanity checks
 	assert(dst && dst->pixels);
@@ -250,6 +338,13 @@ void convertYUV420ToRGB(Graphics::Surface *dst, const byte *ySrc, const byte *uS
 
 	const YUVToRGBLookup *lookup = YUVToRGBMan.getLookup(dst->format);
 
+#ifdef __SSE2__
+	if (dst->format == Graphics::PixelFormat(2, 5, 6, 5, 0, 11, 5, 0, 0)) {
+		convertYUV420ToRGB565((byte *)dst->pixels, dst->pitch, lookup, ySrc, uSrc, vSrc, yWidth, yHeight, yPitch, uvPitch);
+		return;
+	}
+#endif
+
 	// Use a templated function to avoid an if check on every pixel
 	if (dst->format.bytesPerPixel == 2)
 		convertYUV420ToRGB<uint16>((byte *)dst->pixels, dst->pitch, lookup, ySrc, uSrc, vSrc, yWidth, yHeight, yPitch, uvPitch);
@@ -27,6 +27,7 @@
 #include "audio/decoders/raw.h"
 
 #include "common/util.h"
+#include "common/debug.h"
 #include "common/textconsole.h"
 #include "common/math.h"
 #include "common/stream.h"
@@ -44,6 +45,10 @@
 #include "video/binkdata.h"
 #include "video/bink_decoder.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 static const uint32 kBIKfID = MKTAG('B', 'I', 'K', 'f');
 static const uint32 kBIKgID = MKTAG('B', 'I', 'K', 'g');
 static const uint32 kBIKhID = MKTAG('B', 'I', 'K', 'h');
@@ -502,6 +507,15 @@ void BinkDecoder::mergeHuffmanSymbols(VideoFrame &video, byte *dst, const byte *
 bool BinkDecoder::loadStream(Common::SeekableReadStream *stream) {
 	close();
 
+#ifdef __SSE2__
+	// With -d1 or more, the SSE2 IDCT is checked once against the scalar one
+	static bool idctChecked = false;
+	if (!idctChecked && gDebugLevel >= 1) {
+		idctChecked = true;
+		checkIDCT();
+	}
+#endif
+
 	_id = stream->readUint32BE();
 	if ((_id != kBIKfID) && (_id != kBIKgID) && (_id != kBIKhID) && (_id != kBIKiID))
 		return false;
@@ -947,11 +961,7 @@ void BinkDecoder::blockResidue(DecodeContext &ctx) {
 
 	readResidue(*ctx.video, block, v);
 
-	byte  *dst = ctx.dest;
-	int16 *src = block;
-	for (int i = 0; i < 8; i++, dst += ctx.pitch, src += 8)
-		for (int j = 0; j < 8; j++)
-			dst[j] += src[j];
+	addBlock(ctx.dest, ctx.pitch, block);
 }
 
 void BinkDecoder::blockIntra(DecodeContext &ctx) {
@@ -1609,7 +1619,9 @@ static inline void IDCTCol(int16 *dest, const int16 *src)
 	}
 }
 
-void BinkDecoder::IDCT(int16 *block) {
+// The scalar versions, the reference for the SIMD ones
+
+void BinkDecoder::IDCTScalar(int16 *block) {
 	int i;
 	int16 temp[64];
 
@@ -1620,17 +1632,12 @@ void BinkDecoder::IDCT(int16 *block) {
 	}
 }
 
-void BinkDecoder::IDCTAdd(DecodeContext &ctx, int16 *block) {
-	int i, j;
-
-	IDCT(block);
-	byte *dest = ctx.dest;
-	for (i = 0; i < 8; i++, dest += ctx.pitch, block += 8)
-		for (j = 0; j < 8; j++)
-			 dest[j] += block[j];
+void BinkDecoder::IDCTAddScalar(DecodeContext &ctx, int16 *block) {
+	IDCTScalar(block);
+	addBlockScalar(ctx.dest, ctx.pitch, block);
 }
 
-void BinkDecoder::IDCTPut(DecodeContext &ctx, int16 *block) {
+void BinkDecoder::IDCTPutScalar(DecodeContext &ctx, int16 *block) {
 	int i;
 	int16 temp[64];
 	for (i = 0; i < 8; i++)
@@ -1640,4 +1647,279 @@ void BinkDecoder::IDCTPut(DecodeContext &ctx, int16 *block) {
 	}
 }
 
+void BinkDecoder::addBlockScalar(byte *dest, uint32 pitch, const int16 *block) {
+	for (int i = 0; i < 8; i++, dest += pitch, block += 8)
+		for (int j = 0; j < 8; j++)
+			dest[j] += block[j];
+}
+
+#ifdef __SSE2__
+
+// The SSE2 versions below transform the 8 columns, or the 8 rows after a
+// transpose, at once. They give the same results as the scalar macros
+// above, including the truncation of the intermediates to 16 bits, and
+// the wrap-around of the pixels.
+
+// Low 32 bits of the products of the 32-bit lanes, SSE2 has no pmulld
+static inline __m128i mulLo32(__m128i a, __m128i b) {
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd  = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+	                          _mm_shuffle_epi32(odd,  _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// IDCT_TRANSFORM on four lanes of 32-bit values
+static inline void IDCTTransform4(__m128i *d, const __m128i *s, bool munge) {
+	const __m128i c1 = _mm_set1_epi32(A1);
+	const __m128i c2 = _mm_set1_epi32(A2);
+	const __m128i c3 = _mm_set1_epi32(A3);
+	const __m128i c4 = _mm_set1_epi32(A4);
+
+	const __m128i a0 = _mm_add_epi32(s[0], s[4]);
+	const __m128i a1 = _mm_sub_epi32(s[0], s[4]);
+	const __m128i a2 = _mm_add_epi32(s[2], s[6]);
+	const __m128i a3 = _mm_srai_epi32(mulLo32(c1, _mm_sub_epi32(s[2], s[6])), 11);
+	const __m128i a4 = _mm_add_epi32(s[5], s[3]);
+	const __m128i a5 = _mm_sub_epi32(s[5], s[3]);
+	const __m128i a6 = _mm_add_epi32(s[1], s[7]);
+	const __m128i a7 = _mm_sub_epi32(s[1], s[7]);
+	const __m128i b0 = _mm_add_epi32(a4, a6);
+	const __m128i b1 = _mm_srai_epi32(mulLo32(c3, _mm_add_epi32(a5, a7)), 11);
+	const __m128i b2 = _mm_add_epi32(_mm_sub_epi32(_mm_srai_epi32(mulLo32(c4, a5), 11), b0), b1);
+	const __m128i b3 = _mm_sub_epi32(_mm_srai_epi32(mulLo32(c1, _mm_sub_epi32(a6, a4)), 11), b2);
+	const __m128i b4 = _mm_sub_epi32(_mm_add_epi32(_mm_srai_epi32(mulLo32(c2, a7), 11), b3), b1);
+
+	const __m128i a02 = _mm_add_epi32(a0, a2);
+	const __m128i a0_2 = _mm_sub_epi32(a0, a2);
+	const __m128i a13_2 = _mm_sub_epi32(_mm_add_epi32(a1, a3), a2);
+	const __m128i a1_32 = _mm_add_epi32(_mm_sub_epi32(a1, a3), a2);
+	d[0] = _mm_add_epi32(a02, b0);
+	d[1] = _mm_add_epi32(a13_2, b2);
+	d[2] = _mm_add_epi32(a1_32, b3);
+	d[3] = _mm_sub_epi32(a0_2, b4);
+	d[4] = _mm_add_epi32(a0_2, b4);
+	d[5] = _mm_sub_epi32(a1_32, b3);
+	d[6] = _mm_sub_epi32(a13_2, b2);
+	d[7] = _mm_sub_epi32(a02, b0);
+
+	if (munge) {
+		const __m128i round = _mm_set1_epi32(0x7F);
+		for (int i = 0; i < 8; i++)
+			d[i] = _mm_srai_epi32(_mm_add_epi32(d[i], round), 8);
+	}
+}
+
+// Packs two vectors of 32-bit values to 16 bits, truncating like a store to int16
+static inline __m128i packTruncate32(__m128i lo, __m128i hi) {
+	lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+	hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+	return _mm_packs_epi32(lo, hi);
+}
+
+// Transforms each of the 8 lanes of v[0..7] down the vectors
+static inline void IDCTTransform8(__m128i *v, bool munge) {
+	__m128i lo[8], hi[8];
+	for (int i = 0; i < 8; i++) {
+		lo[i] = _mm_srai_epi32(_mm_unpacklo_epi16(v[i], v[i]), 16);
+		hi[i] = _mm_srai_epi32(_mm_unpackhi_epi16(v[i], v[i]), 16);
+	}
+	IDCTTransform4(lo, lo, munge);
+	IDCTTransform4(hi, hi, munge);
+	for (int i = 0; i < 8; i++)
+		v[i] = packTruncate32(lo[i], hi[i]);
+}
+
+static inline void transpose8x8(__m128i *v) {
+	__m128i a0 = _mm_unpacklo_epi16(v[0], v[1]);
+	__m128i a1 = _mm_unpackhi_epi16(v[0], v[1]);
+	__m128i a2 = _mm_unpacklo_epi16(v[2], v[3]);
+	__m128i a3 = _mm_unpackhi_epi16(v[2], v[3]);
+	__m128i a4 = _mm_unpacklo_epi16(v[4], v[5]);
+	__m128i a5 = _mm_unpackhi_epi16(v[4], v[5]);
+	__m128i a6 = _mm_unpacklo_epi16(v[6], v[7]);
+	__m128i a7 = _mm_unpackhi_epi16(v[6], v[7]);
+
+	__m128i b0 = _mm_unpacklo_epi32(a0, a2);
+	__m128i b1 = _mm_unpackhi_epi32(a0, a2);
+	__m128i b2 = _mm_unpacklo_epi32(a1, a3);
+	__m128i b3 = _mm_unpackhi_epi32(a1, a3);
+	__m128i b4 = _mm_unpacklo_epi32(a4, a6);
+	__m128i b5 = _mm_unpackhi_epi32(a4, a6);
+	__m128i b6 = _mm_unpacklo_epi32(a5, a7);
+	__m128i b7 = _mm_unpackhi_epi32(a5, a7);
+
+	v[0] = _mm_unpacklo_epi64(b0, b4);
+	v[1] = _mm_unpackhi_epi64(b0, b4);
+	v[2] = _mm_unpacklo_epi64(b1, b5);
+	v[3] = _mm_unpackhi_epi64(b1, b5);
+	v[4] = _mm_unpacklo_epi64(b2, b6);
+	v[5] = _mm_unpackhi_epi64(b2, b6);
+	v[6] = _mm_unpacklo_epi64(b3, b7);
+	v[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+// Columns, then rows of the block, leaving the rows in v
+static inline void IDCTRows(__m128i *v, const int16 *block) {
+	for (int i = 0; i < 8; i++)
+		v[i] = _mm_loadu_si128((const __m128i *)(block + 8 * i));
+	IDCTTransform8(v, false);
+	transpose8x8(v);
+	IDCTTransform8(v, true);
+	transpose8x8(v);
+}
+
+// The low bytes of the 16-bit lanes of two rows, a byte store truncates the same way
+static inline __m128i packLowBytes(__m128i row0, __m128i row1) {
+	const __m128i mask = _mm_set1_epi16(0xFF);
+	return _mm_packus_epi16(_mm_and_si128(row0, mask), _mm_and_si128(row1, mask));
+}
+
+static inline void storeRows(byte *dest, uint32 pitch, __m128i rows) {
+	_mm_storel_epi64((__m128i *)dest, rows);
+	_mm_storel_epi64((__m128i *)(dest + pitch), _mm_srli_si128(rows, 8));
+}
+
+static inline __m128i loadRows(const byte *src, uint32 pitch) {
+	return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)src),
+	                          _mm_loadl_epi64((const __m128i *)(src + pitch)));
+}
+
+void BinkDecoder::IDCT(int16 *block) {
+	__m128i v[8];
+	IDCTRows(v, block);
+	for (int i = 0; i < 8; i++)
+		_mm_storeu_si128((__m128i *)(block + 8 * i), v[i]);
+}
+
+void BinkDecoder::IDCTAdd(DecodeContext &ctx, int16 *block) {
+	IDCT(block);
+	addBlock(ctx.dest, ctx.pitch, block);
+}
+
+void BinkDecoder::IDCTPut(DecodeContext &ctx, int16 *block) {
+	__m128i v[8];
+	IDCTRows(v, block);
+	for (int i = 0; i < 8; i += 2)
+		storeRows(ctx.dest + i * ctx.pitch, ctx.pitch, packLowBytes(v[i], v[i + 1]));
+}
+
+void BinkDecoder::addBlock(byte *dest, uint32 pitch, const int16 *block) {
+	for (int i = 0; i < 8; i += 2, dest += 2 * pitch, block += 16) {
+		__m128i rows = packLowBytes(_mm_loadu_si128((const __m128i *)block),
+		                            _mm_loadu_si128((const __m128i *)(block + 8)));
+		storeRows(dest, pitch, _mm_add_epi8(loadRows(dest, pitch), rows));
+	}
+}
+
+// Test blocks for checkIDCT(): coefficients at the limits of their range,
+// alone and filling the block, then random ones over the full range and over
+// the range the bitstream actually produces
+static const int16 IDCTTestEdges[] = { 1, -1, 255, -256, 2047, -2048, 32767, -32768 };
+
+static void makeTestBlock(int n, int16 *coeffs, byte *pixels, uint32 &seed) {
+	const int16 *edges = IDCTTestEdges;
+	const int edgeCount = ARRAYSIZE(IDCTTestEdges);
+
+	for (int i = 0; i < 8 * 16; i++) {
+		seed = seed * 1103515245 + 12345;
+		pixels[i] = seed >> 24;
+	}
+
+	if (n < edgeCount * 64) {
+		memset(coeffs, 0, 64 * sizeof(int16));
+		coeffs[n % 64] = edges[n / 64];
+		return;
+	}
+	n -= edgeCount * 64;
+
+	if (n < edgeCount * 3) {
+		for (int i = 0; i < 64; i++) {
+			if (n < edgeCount)
+				coeffs[i] = edges[n];
+			else if (n < 2 * edgeCount)
+				coeffs[i] = ((i ^ (i >> 3)) & 1) ? edges[n - edgeCount] : -edges[n - edgeCount];
+			else
+				coeffs[i] = (i & 1) ? 32767 : edges[n - 2 * edgeCount];
+		}
+		return;
+	}
+	n -= edgeCount * 3;
+
+	for (int i = 0; i < 64; i++) {
+		seed = seed * 1103515245 + 12345;
+		coeffs[i] = (n & 1) ? (int16)(seed >> 16) >> 4 : (int16)(seed >> 16);
+	}
+}
+
+bool BinkDecoder::checkIDCT() {
+	const int blockCount = ARRAYSIZE(IDCTTestEdges) * (64 + 3) + 20000;
+	uint32 seed = 1;
+
+	for (int n = 0; n < blockCount; n++) {
+		int16 coeffs[64], simd[64], scalar[64];
+		byte pixels[8 * 16], simdPixels[8 * 16], scalarPixels[8 * 16];
+		DecodeContext simdCtx, scalarCtx;
+		const char *function = 0;
+
+		makeTestBlock(n, coeffs, pixels, seed);
+		simdCtx.dest = simdPixels;
+		simdCtx.pitch = 16;
+		scalarCtx.dest = scalarPixels;
+		scalarCtx.pitch = 16;
+
+		memcpy(simd, coeffs, sizeof(coeffs));
+		memcpy(scalar, coeffs, sizeof(coeffs));
+		IDCT(simd);
+		IDCTScalar(scalar);
+		if (memcmp(simd, scalar, sizeof(coeffs)))
+			function = "IDCT";
+
+		memcpy(simd, coeffs, sizeof(coeffs));
+		memcpy(scalar, coeffs, sizeof(coeffs));
+		memcpy(simdPixels, pixels, sizeof(pixels));
+		memcpy(scalarPixels, pixels, sizeof(pixels));
+		IDCTPut(simdCtx, simd);
+		IDCTPutScalar(scalarCtx, scalar);
+		if (memcmp(simdPixels, scalarPixels, sizeof(pixels)))
+			function = "IDCTPut";
+
+		memcpy(simd, coeffs, sizeof(coeffs));
+		memcpy(scalar, coeffs, sizeof(coeffs));
+		memcpy(simdPixels, pixels, sizeof(pixels));
+		memcpy(scalarPixels, pixels, sizeof(pixels));
+		IDCTAdd(simdCtx, simd);
+		IDCTAddScalar(scalarCtx, scalar);
+		if (memcmp(simdPixels, scalarPixels, sizeof(pixels)))
+			function = "IDCTAdd";
+
+		if (function) {
+			warning("Bink SSE2 %s differs from the scalar version on test block %d", function, n);
+			return false;
+		}
+	}
+
+	debug(1, "Bink SSE2 IDCT matches the scalar version on %d test blocks", blockCount);
+	return true;
+}
+
+#else
+
+void BinkDecoder::IDCT(int16 *block) {
+	IDCTScalar(block);
+}
+
+void BinkDecoder::IDCTAdd(DecodeContext &ctx, int16 *block) {
+	IDCTAddScalar(ctx, block);
+}
+
+void BinkDecoder::IDCTPut(DecodeContext &ctx, int16 *block) {
+	IDCTPutScalar(ctx, block);
+}
+
+void BinkDecoder::addBlock(byte *dest, uint32 pitch, const int16 *block) {
+	addBlockScalar(dest, pitch, block);
+}
+
+#endif
+
 } // End of namespace Video
@@ -325,6 +325,20 @@ private:
 	void IDCT(int16 *block);
 	void IDCTPut(DecodeContext &ctx, int16 *block);
 	void IDCTAdd(DecodeContext &ctx, int16 *block);
+
+	/** Add a block of residues to the 8x8 pixels at dest. */
+	void addBlock(byte *dest, uint32 pitch, const int16 *block);
+
+	// Portable versions of the above, which the SIMD ones must match
+	void IDCTScalar(int16 *block);
+	void IDCTPutScalar(DecodeContext &ctx, int16 *block);
+	void IDCTAddScalar(DecodeContext &ctx, int16 *block);
+	void addBlockScalar(byte *dest, uint32 pitch, const int16 *block);
+
+#ifdef __SSE2__
+	/** Compare the SSE2 IDCT with the scalar one, warning on any difference. */
+	bool checkIDCT();
+#endif
 };
 
 } // End of namespace Video